@@ -0,0 +1,37 @@
+// Micro benchmarks of the front end, for `leoml -b`.
+
+#ifndef LEOML_BENCH_H
+#define LEOML_BENCH_H
+
+#include <list>
+#include <string>
+
+/// Benchmark
+// Run every benchmark over the sources, report to the stdout.
+void Benchmark(const std::list<std::string> &sources);
+
+/// Source loading: fgetc loop vs SourceBuffer
+void BenchLoad(const std::string &source);
+
+/// Lexing: throughput and the token arena footprint
+void BenchLex(const std::string &source);
+
+/// Keywords: KwClassify switch vs the KwMap lookups, over the words of the source
+void BenchKeyword(const std::string &source);
+
+/// Parsing: TokenSequence cursor moves dominate. Also on a pool of all the cores
+void BenchParse(const std::string &source);
+
+/// Lex and parse: tokenized first vs streamed on demand
+void BenchStream(const std::string &source);
+
+/// Caches: lexing vs reading the tokens back from a .tsb image, parsing vs reading the tree image
+void BenchCache(const std::string &source);
+
+/// Inference: the pass over the tree, alone and with the types of the globals printed
+void BenchInfer(const std::string &source);
+
+/// Editing: single char edits on a Document vs parsing the whole text again
+void BenchEdit(const std::string &source);
+
+#endif //LEOML_BENCH_H
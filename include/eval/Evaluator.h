@@ -0,0 +1,148 @@
+#ifndef LEOML_EVALUATOR_H
+#define LEOML_EVALUATOR_H
+
+#include "syntax/Arena.h"
+#include "syntax/FlatTree.h"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+class OutBuffer;
+
+/// Evaluator
+// A tree-walking interpreter over the lowered tree, for `leoml -e`. One
+// instance walks the whole program by a switch on the kind of the node, no
+// visitor object per node. The bindings live in frames of slots addressed by
+// their (depth, slot), see Resolver: the global frame, and one frame per call
+// of a func, whose parent is the frame the func was made in. A frame goes
+// back to a free list of its size on return, and the closures made in it to
+// a free list of theirs, unless the value returned reaches one of them: the
+// values only leave a call by its return, as there is no assignment. Then
+// the frame is captured, kept until the end. The pairs, the closures and the
+// frames live in the arena of the evaluator, released with it.
+//
+// The values are checked as they are used, the types of the tree are not
+// relied on. A runtime error is reported at the root token of the node, by
+// CompileError, or by CompilePanic for a tree read from the tree cache, and
+// ends the evaluation.
+class Evaluator {
+public:
+    using NodeId = FlatTree::NodeId;
+
+    explicit Evaluator(const FlatTree &tree);
+
+    Evaluator(const Evaluator &other) = delete;
+
+    Evaluator &operator=(const Evaluator &other) = delete;
+
+    /// Run
+    // Evaluate the statements in order, print "val name = value" for every
+    // global binding, "- = value" for a statement naming a global, as each is
+    // evaluated. Through an OutBuffer: the stream's own if it is one, else one
+    // writing to the stream.
+    void Run(std::ostream &os);
+
+    void Run(OutBuffer &out);
+
+    // Stat: calls of funcs
+    size_t Calls() const { return _calls; }
+
+private:
+    struct Frame;
+    struct Pair;
+    struct Closure;
+
+    /// Value
+    // Of a Type kind, T_Unit for ().
+    struct Value {
+        int kind;
+        union {
+            int64_t i;
+            double f;
+            bool b;
+            const char *s;  // the text of the constant, quoted, in the chars pool
+            Pair *pair;
+            Closure *func;
+        };
+    };
+
+    struct Pair {
+        Value first;
+        Value second;
+        uint64_t stamp;  // of the latest frame at the time it was made
+        uint64_t seen;  // by the walk, see Reaches
+    };
+
+    struct Closure {
+        NodeId func;
+        Frame *env;
+        Closure *next;  // made in the same frame, or free
+    };
+
+    struct Frame {
+        Frame *parent;
+        uint32_t size;
+        bool captured;  // by a closure returned, never released
+        uint64_t stamp;  // in the order of the calls, the global frame first
+        uint64_t seen;  // by the walk, see Reaches
+        Closure *closures;  // made in it
+        Value slots[1];  // size of them
+    };
+
+    const FlatTree &_tree;
+    Arena _arena;
+    std::vector<uint32_t> _frameSizes;  // by node id, of the root and the funcs
+    std::vector<Frame *> _free;  // the released frames, by size, linked by parent
+    Closure *_freeClosures{nullptr};
+    Frame *_frame{nullptr};  // current
+    uint64_t _stamp{0};  // of the latest frame
+    uint64_t _walk{0};  // of the latest walk
+    std::vector<Value> _work;  // of the walk
+    const char *_stackBase{nullptr};
+    size_t _stackLimit{0};  // bytes of the native stack the calls may take
+    size_t _calls{0};
+
+    static Value Unit();
+
+    // The frame sizes of the funcs in the node, owned by the frame of owner.
+    void SizeFrames(NodeId id, NodeId owner);
+
+    Frame *NewFrame(uint32_t size, Frame *parent);
+
+    void Release(Frame *frame);
+
+    /// Reaches
+    // Whether the value reaches a closure made in the frame, through the pairs,
+    // the closures and the frames made since the frame, the only ones that may.
+    bool Reaches(const Value &value, const Frame *frame);
+
+    // The slot of the binding at (depth, slot) of the node.
+    Value &Lookup(NodeId at);
+
+    // Make the closure of the func in the current frame, and bind its name there.
+    Value MakeClosure(NodeId func);
+
+    Value Apply(NodeId at, const Value &func, const NodeId *args, size_t count);
+
+    Value Eval(NodeId id);
+
+    // A chain of N_Binary along its lhs, in a loop, see FlatTree::Spine.
+    Value Binary(NodeId id);
+
+    // The value of the binary node, of the value of its lhs.
+    Value Operate(NodeId id, const Value &lhs);
+
+    // The children of a N_Let.
+    Value Let(const NodeId *child, uint32_t count);
+
+    bool Truth(NodeId at, const Value &value);
+
+    void Stmt(NodeId id, OutBuffer &out);
+
+    static void Print(OutBuffer &out, const Value &value);
+
+    [[noreturn]] void Error(NodeId at, const char *message);
+};
+
+#endif //LEOML_EVALUATOR_H
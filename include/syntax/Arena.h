@@ -0,0 +1,125 @@
+#ifndef LEOML_ARENA_H
+#define LEOML_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+
+/// Arena
+// Bump allocator. Objects are carved out of big blocks, and all of them
+// are released in one shot when the arena dies. No destructor is run.
+class Arena {
+public:
+    static const size_t kBlockSize = 64 * 1024;
+
+    explicit Arena(size_t blockSize = kBlockSize) : _blockSize(blockSize) {}
+
+    ~Arena() {
+        for (auto block:_blocks) free(block);
+    }
+
+    Arena(const Arena &other) = delete;
+
+    Arena &operator=(const Arena &other) = delete;
+
+    void *Alloc(size_t size, size_t align = alignof(std::max_align_t)) {
+        auto p = (char *) (((uintptr_t) _cur + align - 1) & ~(uintptr_t) (align - 1));
+        if (p + size > _end) {
+            p = Grow(size, align);
+        }
+        _cur = p + size;
+        _allocated += size;
+        return p;
+    }
+
+    template<typename T, typename... Args>
+    T *New(Args &&... args) {
+        return new(Alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    /// CopyStr
+    // Copy the text into the arena, NUL terminated.
+    const char *CopyStr(const char *str, size_t size) {
+        auto ret = (char *) Alloc(size + 1, 1);
+        memcpy(ret, str, size);
+        ret[size] = 0;
+        return ret;
+    }
+
+    // Stat: bytes handed out
+    size_t Allocated() const { return _allocated; }
+
+    // Stat: bytes held by the blocks
+    size_t Reserved() const { return _reserved; }
+
+    // Stat: count of blocks, which is the count of mallocs
+    size_t Blocks() const { return _blocks.size(); }
+
+    /// Current
+    // The arena of the compilation running on this thread, see ArenaGuard.
+    // Out of any compilation, a per-thread arena that is never released.
+    static Arena *Current() {
+        if (auto arena = CurrentSlot()) return arena;
+        static thread_local Arena *fallback = new Arena;
+        return fallback;
+    }
+
+private:
+    size_t _blockSize;
+    std::vector<char *> _blocks;
+    char *_cur{nullptr};
+    char *_end{nullptr};
+    size_t _allocated{0};
+    size_t _reserved{0};
+
+    char *Grow(size_t size, size_t align) {
+        auto blockSize = size + align > _blockSize ? size + align : _blockSize;
+        auto block = (char *) malloc(blockSize);
+        if (block == nullptr) throw std::bad_alloc();
+        _blocks.push_back(block);
+        _reserved += blockSize;
+        _cur = block;
+        _end = block + blockSize;
+        return (char *) (((uintptr_t) _cur + align - 1) & ~(uintptr_t) (align - 1));
+    }
+
+    friend class ArenaGuard;
+
+    static Arena *&CurrentSlot() {
+        static thread_local Arena *current = nullptr;
+        return current;
+    }
+};
+
+/// ArenaGuard
+// Make the arena current on this thread while the guard lives.
+class ArenaGuard {
+public:
+    explicit ArenaGuard(Arena *arena) : _prev(Arena::CurrentSlot()) { Arena::CurrentSlot() = arena; }
+
+    ~ArenaGuard() { Arena::CurrentSlot() = _prev; }
+
+    ArenaGuard(const ArenaGuard &other) = delete;
+
+    ArenaGuard &operator=(const ArenaGuard &other) = delete;
+
+private:
+    Arena *_prev;
+};
+
+/// ArenaObject
+// Base of the classes whose objects are carved out of Arena::Current().
+// delete does nothing, the arena releases them all at once without running
+// destructors, so the members must hold nothing but arena memory.
+class ArenaObject {
+public:
+    static void *operator new(size_t size) { return Arena::Current()->Alloc(size); }
+
+    static void operator delete(void *) {}
+};
+
+#endif //LEOML_ARENA_H
@@ -0,0 +1,104 @@
+#ifndef LEOML_DIAGNOSTICS_H
+#define LEOML_DIAGNOSTICS_H
+
+#include "Token.h"
+#include <cstddef>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// Diagnostics
+// The errors of one compilation, collected instead of aborting on the first.
+// CompileError reports to the engine current on the thread, see
+// DiagnosticsGuard, then throws Diagnostics::Recovery. The Parser catches it
+// and synchronizes at the "in" of the let, the "done" of the while, or past
+// the ";;" of the statement, which is dropped; Sema and Inference skip the
+// rest of the statement. Out of any engine, an error is fatal as it was.
+//
+// At the limit of errors, the compilation stops. The errors are printed in
+// the order of their location, whatever the order the passes found them in.
+class Diagnostics {
+public:
+    static const size_t kLimit = 20;
+
+    /// Recovery
+    // Thrown after an error is reported, the token is where, if any.
+    struct Recovery {
+        const Token *token;
+    };
+
+    // No limit for 0.
+    explicit Diagnostics(size_t limit = kLimit) : _limit(limit) {}
+
+    Diagnostics(const Diagnostics &other) = delete;
+
+    Diagnostics &operator=(const Diagnostics &other) = delete;
+
+    // The engine of the compilation running on this thread, nullptr if none.
+    static Diagnostics *Current() { return CurrentSlot(); }
+
+    // The current engine has errors.
+    static bool HasErrors() { return Current() && Current()->Errors() > 0; }
+
+    // The current engine is at the limit, the compilation stops.
+    static bool Stopped() { return Current() && Current()->Full(); }
+
+    /// Report
+    // Keep the error, formatted, up to the limit. From any thread.
+    void Report(const SourceLocation &loc, std::string text);
+
+    // The count of the errors, those past the limit included.
+    size_t Errors() const { return _errors; }
+
+    size_t Limit() const { return _limit; }
+
+    bool Full() const { return _limit > 0 && _errors >= _limit; }
+
+    /// Merge
+    // Take over the errors of the other, of a part of the same compilation.
+    void Merge(Diagnostics &other);
+
+    /// Print
+    // The errors, then "too many errors" at the limit, and the count.
+    void Print(FILE *out);
+
+private:
+    struct Diagnostic {
+        unsigned line;
+        unsigned column;
+        std::string text;
+    };
+
+    size_t _limit;
+    size_t _errors{0};
+    std::vector<Diagnostic> _list;
+    std::mutex _mutex;
+
+    friend class DiagnosticsGuard;
+
+    static Diagnostics *&CurrentSlot() {
+        static thread_local Diagnostics *current = nullptr;
+        return current;
+    }
+};
+
+/// DiagnosticsGuard
+// Make the engine current on this thread while the guard lives.
+class DiagnosticsGuard {
+public:
+    explicit DiagnosticsGuard(Diagnostics *diags) : _prev(Diagnostics::CurrentSlot()) {
+        Diagnostics::CurrentSlot() = diags;
+    }
+
+    ~DiagnosticsGuard() { Diagnostics::CurrentSlot() = _prev; }
+
+    DiagnosticsGuard(const DiagnosticsGuard &other) = delete;
+
+    DiagnosticsGuard &operator=(const DiagnosticsGuard &other) = delete;
+
+private:
+    Diagnostics *_prev;
+};
+
+#endif //LEOML_DIAGNOSTICS_H
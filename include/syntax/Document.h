@@ -0,0 +1,146 @@
+#ifndef LEOML_DOCUMENT_H
+#define LEOML_DOCUMENT_H
+
+#include "Parser.h"
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// DocumentStats
+// Counters of the incremental work, over all the edits.
+struct DocumentStats {
+    size_t edits{0};
+    size_t relexed{0};  // bytes lexed again
+    size_t reparsed{0};  // pieces parsed again, the dependents included
+    size_t resolved{0};  // pieces resolved and lowered again
+
+    void Print(FILE *out) const;
+};
+
+/// Document
+// A source kept parsed across the edits of an editor. The text is cut into
+// pieces of whole lines, after the lines where a statement ends, and every
+// piece keeps its tokens, its statements and their scopes. An edit lexes again
+// the pieces it touches, until the lexer is back on a cut, and parses again
+// their statements and the later ones naming the globals they define, or used
+// to. The other pieces are kept as they are. The tree is the one the Parser
+// builds from the whole text.
+//
+// The globals visible from a piece are bound in a program scope of its own,
+// filled with the latest definitions before it of the names in its tokens.
+// Unlike the Parser, the root token of a global is not moved to its last use
+// in the later pieces, so that a piece never points at the tokens of another.
+//
+// New and Edit run under a Diagnostics engine of their own: a statement with
+// an error is dropped, as by the Parser, and the pieces with errors are not
+// resolved. While the text has errors, the tree stays the last one built
+// without any, and there is no program.
+class Document {
+public:
+    ~Document();
+
+    Document(const Document &other) = delete;
+
+    Document &operator=(const Document &other) = delete;
+
+    static Document *New(const std::string &text, const std::string &filename);
+
+    /// Edit
+    // Replace the removed bytes at the offset with the inserted text.
+    void Edit(size_t offset, size_t removed, const std::string &inserted);
+
+    std::string Text() const;
+
+    /// GetDiagnostics
+    // The errors found by the last edit, or by New, in the text lexed and parsed
+    // again. The errors of the pieces left as they were are not reported again.
+    Diagnostics &GetDiagnostics() { return *_diags; }
+
+    // The count of the errors in the whole text.
+    size_t Errors() const;
+
+    size_t Size() const { return _size; }
+
+    size_t Pieces() const { return _pieces.size(); }
+
+    /// GetProgram
+    // The statements of all the pieces, in order, until the next edit.
+    // Its own scope is empty, see above. Null while the text has errors.
+    Program *GetProgram();
+
+    /// GetTree
+    // The trees of the pieces joined, until the next edit. The last tree of a
+    // text without errors while the text has some, null if it never had none.
+    const FlatTree *GetTree();
+
+    void Serialize(std::ostream &os) {
+        if (auto tree = GetTree()) tree->Serialize(os);
+    }
+
+    const DocumentStats &GetStats() const { return _stats; }
+
+private:
+    struct Region;
+    struct Piece;
+
+    std::string _filename;
+    size_t _size{0};
+    std::vector<Piece *> _pieces;
+    std::vector<size_t> _offsets;  // of the pieces in the text, apart so that an edit shifts them fast
+    std::vector<unsigned> _lines;  // of the first lines of the pieces
+    std::unordered_map<Symbol, std::vector<Piece *>> _defs;  // pieces defining the global, in order
+    std::unordered_map<Symbol, std::vector<Piece *>> _uses;  // pieces naming it, in order
+    size_t _unresolved{SIZE_MAX};  // first piece whose global slots moved, see Update
+    size_t _stamp{0};  // of the updates, so that a piece is queued once
+    Arena _arena;  // of the program
+    Program *_program{nullptr};
+    bool _programDirty{true};
+    FlatTree *_tree{nullptr};  // of the last text without errors
+    bool _treeDirty{true};
+    std::unique_ptr<Diagnostics> _diags;  // of the last edit
+    DocumentStats _stats;
+
+    explicit Document(const std::string &filename) : _filename(filename), _arena(4096) {}
+
+    void Build(const std::string &text);
+
+    // Index of the piece holding the offset.
+    size_t Locate(size_t offset) const;
+
+    std::shared_ptr<Region> Lex(const std::string &text, unsigned line, bool part, bool *closed);
+
+    // Whether the lexer is on a cut at the end of the region, as it was.
+    bool Resynced(const Region &region, const std::string &text) const;
+
+    // Take in the other pieces of the regions with lexing errors at the ends.
+    void Widen(size_t &first, size_t &last) const;
+
+    // Cut the lexed region into pieces, the first at the line.
+    std::vector<Piece *> Cut(const std::shared_ptr<Region> &region, unsigned line);
+
+    /// Update
+    // Parse the count of new pieces from the first, and the later pieces naming
+    // the globals of the dropped pieces and of the parsed ones, then resolve them.
+    void Update(size_t first, size_t count, const std::vector<Symbol> &dropped, int droppedSlots);
+
+    // Resolve the pieces whose global slots moved, before the program or the tree is read.
+    void ResolveRest();
+
+    void Parse(Piece *piece);
+
+    void Resolve(Piece *piece, int base);
+
+    // The latest definition of the global before the piece at the index.
+    Var *Global(Symbol name, size_t index) const;
+
+    // Bring the lines of the tokens up to date, after the edits above the piece.
+    void Settle(Piece *piece);
+
+    void Invalidate();
+};
+
+#endif //LEOML_DOCUMENT_H
@@ -19,8 +19,16 @@ inline void CompilePanic(const char *msg)
     exit(-1);
 }
 
-void CompileError(const SourceLocation &loc, const char *format, ...);
+/// CompileError
+// Report the error. Under a Diagnostics engine the error is kept, and
+// Diagnostics::Recovery is thrown for a caller to recover, else the error is
+// printed and the compiler aborts.
+[[noreturn]] void CompileError(const SourceLocation &loc, const char *format, ...);
 
-void CompileError(const Token *tok, const char *format, ...);
+[[noreturn]] void CompileError(const Token *tok, const char *format, ...);
+
+/// ReportError
+// CompileError, but the caller goes on past the error itself, no throw under an engine.
+void ReportError(const SourceLocation &loc, const char *format, ...);
 
 #endif // LEOML_ERROR_H
\ No newline at end of file
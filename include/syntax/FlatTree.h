@@ -0,0 +1,177 @@
+#ifndef LEOML_FLATTREE_H
+#define LEOML_FLATTREE_H
+
+#include "SmallVec.h"
+#include "Symbol.h"
+#include "Type.h"
+#include <cstdint>
+#include <initializer_list>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class OutBuffer;
+
+class Program;
+
+struct SourceLocation;
+
+class ThreadPool;
+
+class Token;
+
+/// FlatTree
+// The AST lowered into parallel arrays indexed by a 32-bit node id.
+// Nodes are laid out in post-order, children before their parent and the
+// Program last, so bottom-up passes are linear scans over the columns.
+// Children of a node are a range of the children pool, where kNoNode stands
+// for an absent optional child (else expr, func body, let pair value).
+//
+// Column meaning by kind:
+//     type   the id of the type of an expression, Type::Unknown for none
+//     tag    op of N_Binary/N_Unary, token tag of N_Constant,
+//            count of params of N_Func
+//     name   symbol of N_Var/N_Func/N_FuncCall
+//     depth, slot   lexical address of N_Var/N_Func/N_FuncCall, see Resolver
+//     aux    value bits of N_Constant (int, float or bool), or the offset of
+//            the NUL terminated text in the chars pool for a string;
+//            signature offset of N_Func in the sigs pool:
+//            [count of param types, param types..., ret type]
+class FlatTree {
+public:
+    using NodeId = uint32_t;
+
+    static const NodeId kNoNode = UINT32_MAX;
+
+    enum Kind : uint8_t {
+        N_Program,
+        N_VarStmt,  // [var]
+        N_VarAssignStmt,  // [var, exp]
+        N_FuncAssignStmt,  // [func]
+        N_Exp,  // [var or kNoNode, expb...]
+        N_Var,  // []
+        N_Func,  // [param..., body or kNoNode]
+        N_FuncCall,  // [arg...]
+        N_Constant,  // []
+        N_Binary,  // [lhs, rhs]
+        N_Unary,  // [oprand]
+        N_Cons,  // [first, second]
+        N_Compound,  // [first, second]
+        N_Fst,  // [first, second]
+        N_Snd,  // [first, second]
+        N_If,  // [cond, then, else or kNoNode]
+        N_While,  // [cond, body]
+        N_Let,  // [var or func, value or kNoNode]..., body
+    };
+
+    /// Build
+    // Lower the parsed and resolved program.
+    static FlatTree *Build(Program *program);
+
+    /// Build on the pool
+    // Lower runs of statements concurrently, then join them in order.
+    // Same tree as Build(program).
+    static FlatTree *Build(Program *program, ThreadPool *pool);
+
+    /// Join
+    // Append the nodes and the pools of the other tree, rebasing its ids and
+    // offsets, return the id of its first node here.
+    NodeId Join(const FlatTree &other);
+
+    /// Add
+    // Append a node over the children already added, return its id.
+    NodeId Add(Kind kind, const Token *token, Type::Id type, const NodeId *children, size_t count);
+
+    NodeId Add(Kind kind, const Token *token, Type::Id type, std::initializer_list<NodeId> children) {
+        return Add(kind, token, type, children.begin(), children.size());
+    }
+
+    // Copy the text into the chars pool, NUL terminated, return its offset.
+    uint32_t AddChars(const char *data, size_t size);
+
+    // Copy the signature into the sigs pool, return its offset.
+    uint32_t AddSig(const std::vector<int8_t> &sig);
+
+    NodeId Root() const { return (NodeId) kind.size() - 1; }
+
+    size_t Size() const { return kind.size(); }
+
+    const NodeId *ChildBegin(NodeId id) const { return children.data() + first[id]; }
+
+    const NodeId *ChildEnd(NodeId id) const { return children.data() + first[id] + count[id]; }
+
+    /// Spine
+    // As ExpbBinary::Spine: the N_Binary nodes down the lhs from the node, the
+    // node first, and return the first operand.
+    NodeId Spine(NodeId id, SmallVec<NodeId> &spine) const {
+        while (kind[id] == N_Binary) {
+            spine.push_back(id);
+            id = *ChildBegin(id);
+        }
+        return id;
+    }
+
+    // Bytes held by the columns and the pools.
+    size_t Bytes() const;
+
+    /// Serialize
+    // Print the same text as Program::Serialize, through an OutBuffer: the
+    // stream's own if it is one, else one writing to the stream.
+    void Serialize(std::ostream &os) const;
+
+    void Serialize(OutBuffer &out) const;
+
+    /// Write
+    // The binary image of the tree, see TreeCache: the columns and the pools as
+    // they are in memory, the names as indices of a table of their texts, the
+    // types as indices of a table of their shapes, as the ids are per process.
+    void Write(std::ostream &os) const;
+
+    /// Read
+    // The tree of the image, nullptr if it is corrupt. The columns are copied
+    // in one go each, the names and the types interned once each, the root
+    // tokens are null:
+    // their lines and columns are kept instead, see Locate.
+    static FlatTree *Read(const char *data, size_t size);
+
+    /// SetSource
+    // The text a read tree was parsed from, and its name, for Locate.
+    void SetSource(const char *text, size_t size, const std::string *filename) {
+        _text = text;
+        _textSize = size;
+        _filename = filename;
+    }
+
+    /// Locate
+    // Where the root token of a read tree was in its source, for diagnostics.
+    // false if the node has none, or the source is not set or does not match.
+    bool Locate(NodeId id, SourceLocation &loc) const;
+
+    // Columns
+    std::vector<uint8_t> kind;
+    std::vector<Type::Id> type;
+    std::vector<int16_t> tag;
+    std::vector<int32_t> depth;
+    std::vector<int32_t> slot;
+    std::vector<Symbol> name;
+    std::vector<uint32_t> first;
+    std::vector<uint32_t> count;
+    std::vector<uint32_t> aux;
+    std::vector<const Token *> token;  // root token, for diagnostics
+    std::vector<uint32_t> line;  // of the root token of a read tree, 0 if none
+    std::vector<uint32_t> column;
+
+    // Pools
+    std::vector<NodeId> children;
+    std::vector<char> chars;
+    std::vector<int8_t> sigs;
+
+private:
+    class Printer;
+
+    const char *_text{nullptr};  // of a read tree, see SetSource
+    size_t _textSize{0};
+    const std::string *_filename{nullptr};
+};
+
+#endif //LEOML_FLATTREE_H
@@ -0,0 +1,162 @@
+#ifndef LEOML_INFERENCE_H
+#define LEOML_INFERENCE_H
+
+#include "FlatTree.h"
+#include "Type.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// Inference
+// Hindley-Milner type inference, a pass of its own over the lowered tree,
+// run once the program is parsed and resolved. One walk from the root makes
+// a term per node and unifies the terms as it goes. A type variable is a
+// union-find node, linked by rank with the paths halved, so that the walk is
+// near linear. A variable has the let level where it was made; at the end of
+// a let binding the variables of its value above the level are generalized,
+// and every use of the binding copies them fresh. The bindings are found by
+// their (depth, slot) address, see Resolver, in a stack of the frames.
+//
+// The operators are not overloaded per type: the operands of + - * / and of
+// the unary + - are of a numeric variable, int or float, those of the
+// comparisons of a comparable one, int, float or bool. Such a variable is not
+// generalized, and is int if nothing fixed it by the end. As in the checks of
+// the Parser, an if without else and a while are of the type of their body.
+class Inference {
+public:
+    using NodeId = FlatTree::NodeId;
+
+    explicit Inference(const FlatTree &tree);
+
+    Inference(const Inference &other) = delete;
+
+    Inference &operator=(const Inference &other) = delete;
+
+    /// Run
+    // Infer the types of all the nodes. A type error is reported at the root
+    // token of the node, by CompileError, or by CompilePanic for a tree read
+    // from the tree cache, which has no tokens. Under a Diagnostics engine,
+    // the statement with the error is skipped and the next are inferred.
+    void Run();
+
+    /// TypeOf
+    // The type of the node, its variables numbered from 'a in the order they appear.
+    Type::Id TypeOf(NodeId id);
+
+    /// Serialize
+    // "val name : type" for every global binding, "- : type" for a statement
+    // naming a global, in the order of the statements.
+    void Serialize(std::ostream &os);
+
+    // Stat: terms made, the copies of the schemes included
+    size_t Terms() const { return _terms.size(); }
+
+private:
+    static const uint32_t kNone = UINT32_MAX;
+    static const int kGeneric = INT32_MAX;  // level of a generalized variable
+
+    // The kinds that a variable may take, as bits; 0 for any.
+    static const uint16_t kNumeric = 1 << Type::T_Int | 1 << Type::T_Float;
+    static const uint16_t kComparable = kNumeric | 1 << Type::T_Bool;
+
+    enum Failure {
+        F_None,
+        F_Mismatch,
+        F_Recursive,
+    };
+
+    /// Term
+    // A type constructor, of its kind and args, or a type variable, linked to
+    // the term it is bound to, or to itself while it is open.
+    struct Term {
+        int kind;
+        uint32_t parent;
+        uint32_t first;  // of the args in the pool
+        uint16_t nargs;
+        uint16_t allowed;  // of a variable
+        uint32_t rank;  // of a variable
+        int level;  // of a variable
+    };
+
+    struct Binding {
+        uint32_t term;  // kNone while unbound
+        bool generic;  // has generalized variables, to copy on a use
+    };
+
+    const FlatTree &_tree;
+    std::vector<Term> _terms;
+    std::vector<uint32_t> _args;  // pool
+    std::vector<uint32_t> _types;  // term by node id
+    std::vector<Binding> _bindings;  // of the frames, the innermost last
+    std::vector<size_t> _frames;  // the index of the slot 0 of every open frame
+    int _level{0};
+
+    uint32_t NewTerm(int kind, const uint32_t *args, size_t nargs);
+
+    uint32_t NewVar(uint16_t allowed = 0);
+
+    // The primitive types are the first terms, in the order of their ids.
+    static uint32_t Prim(Type::Id id) { return id - Type::Int; }
+
+    uint32_t Find(uint32_t term);
+
+    uint32_t Arg(const Term &term, size_t i) const { return _args[term.first + i]; }
+
+    /// Unify
+    // Unify the term of the node with the type expected there, else report the error at the node.
+    void Unify(NodeId at, uint32_t actual, uint32_t expected);
+
+    Failure Unite(uint32_t a, uint32_t b);
+
+    // Bind the open variable to the term.
+    Failure Bind(uint32_t var, uint32_t term);
+
+    // Check that the variable does not occur in the term, and lower the levels of the term to its.
+    bool Occurs(uint32_t var, uint32_t term);
+
+    // Return whether any variable was generalized.
+    bool Generalize(uint32_t term);
+
+    uint32_t Instantiate(uint32_t term, std::vector<std::pair<uint32_t, uint32_t>> &fresh);
+
+    /// Export
+    // The interned type of the term. The open variables are numbered in the
+    // order of the vars met, the numeric and the comparable ones are int.
+    Type::Id Export(uint32_t term, std::vector<uint32_t> &vars);
+
+    void EnterFrame();
+
+    void LeaveFrame();
+
+    // Bind the slot of the innermost frame.
+    void Define(int slot, uint32_t term, bool generic);
+
+    // The term of a use of the binding at (depth, slot).
+    uint32_t Lookup(NodeId at);
+
+    // Infer the statement. After an error, bind its name to any type, and go on.
+    void VisitStmt(NodeId id);
+
+    // Infer the value of a let, a level deeper, and generalize it.
+    std::pair<uint32_t, bool> Let(NodeId value);
+
+    // The term of a func, once its name is bound in the frame around it.
+    uint32_t Func(NodeId id);
+
+    // The term of a use of the func, applied to the args.
+    uint32_t Apply(NodeId at, uint32_t func, const NodeId *args, size_t count);
+
+    uint32_t Visit(NodeId id);
+
+    // N_Binary walks its chain of lhs in a loop, see FlatTree::Spine.
+    uint32_t VisitNode(NodeId id);
+
+    // The term of the binary node, of the terms of its operands.
+    uint32_t Binary(NodeId id, uint32_t lhs, uint32_t rhs);
+
+    void Error(NodeId at, const std::string &message);
+};
+
+#endif //LEOML_INFERENCE_H
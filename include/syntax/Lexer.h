@@ -7,36 +7,53 @@
 #define LEOML_LEXER_H
 
 #include "Token.h"
+#include "Scan.h"
+#include "Source.h"
 #include <cassert>
 #include <cstring>
 
+class Pipeline;
+
 /// Lexer
-class Lexer {
+class Lexer : public TokenSource {
 private:
-    const std::string *_text;  // source text
+    const char *_text;  // source text, NUL terminated
+    const char *_limit;  // end of the readable bytes, for the vector scanners
     const char *_p;  // text offset
     SourceLocation _loc{}; // location
     Token _token{Token::END}; // current token
+    Arena *_arena{nullptr}; // where the tokens are allocated
+    const ScanKernel *_scan{ScanKernel::Current()};
+    bool _partial{false}; // a part of a source, see TokenizePart
+    bool _open{false}; // the part ends inside a comment or a string
+    bool _stream{false}; // tokens pulled on demand, see Stream
+    Pipeline *_pipe{nullptr}; // the thread lexing ahead, see Pipe
 
-    Lexer(const Token *token) : Lexer(&token->str, token->loc) {}
-
-    Lexer(const std::string *text, const SourceLocation &loc) : Lexer(text, loc.filename, loc.line, loc.column) {}
+    Lexer(const std::string *text, const SourceLocation &loc)
+            : Lexer(text->c_str(), text->c_str() + text->size() + 1, loc.filename, loc.line, loc.column) {}
 
-    Lexer(const std::string *text, const std::string *filename = nullptr, unsigned line = 1,
+    Lexer(const char *text, const char *limit, const std::string *filename = nullptr, unsigned line = 1,
           unsigned column = 1) {
         _token = Token(Token::END);
         _text = text;
-        _p = &(*_text)[0];
+        _limit = limit;
+        _p = _text;
         _loc = {filename, _p, line, 1};
     }
 
 public:
     static Lexer *New(const std::string *text, const std::string *filename) {
-        auto ret = new Lexer(text, filename);
+        auto ret = new Lexer(text->c_str(), text->c_str() + text->size() + 1, filename);
+        return ret;
+    }
+
+    // Scan the buffer in place, no copy. Its first line is the line of the source.
+    static Lexer *New(const SourceBuffer *source, const std::string *filename, unsigned line = 1) {
+        auto ret = new Lexer(source->Begin(), source->End() + SourceBuffer::kPadding, filename, line);
         return ret;
     }
 
-    virtual ~Lexer() = default;
+    ~Lexer() override;
 
     Lexer(const Lexer &other) = delete;
 
@@ -45,7 +62,30 @@ public:
     // main API
     void Tokenize(TokenSequence &ts);
 
+    /// TokenizePart
+    // Tokenize whole lines cut out of a source. Return false if they end inside
+    // a comment or a string, that goes on in the rest of the source.
+    bool TokenizePart(TokenSequence &ts);
+
+    /// Stream
+    // Tokenize on demand instead: the sequence pulls the tokens as the parser
+    // reads them, and keeps a window of them only, see TokenSequence::Release.
+    // The newlines are dropped. The lexer must outlive the sequence.
+    void Stream(TokenSequence &ts);
+
+    /// Pipe
+    // Stream, but lex ahead on a thread of its own, which hands the tokens over
+    // in batches through a ring. The thread is joined with the lexer.
+    void Pipe(TokenSequence &ts);
+
+    /// Pull
+    // The next significant token, END at the end. Of a streaming lexer.
+    const Token *Pull() override;
+
 private:
+    // Make the sequence pull from the source.
+    void Open(TokenSequence &ts, TokenSource *source);
+
     Token *MakeToken(int tag);
 
     Token *MakeNewLine();
@@ -87,6 +127,12 @@ private:
 
     void PutBack();
 
+    // Jump over a run of the current line, found by the ScanKernel.
+    void Advance(const char *p) {
+        _loc.column += p - _p;
+        _p = p;
+    }
+
     bool Try(int c) {
         if (Peek() == c) {
             Next();
@@ -0,0 +1,151 @@
+#ifndef LEOML_OUTBUFFER_H
+#define LEOML_OUTBUFFER_H
+
+#include "Symbol.h"
+#include <cstddef>
+#include <cstring>
+#include <ostream>
+#include <streambuf>
+#include <string>
+
+/// OutBuffer
+// A large output buffer, written to a file descriptor with one write per
+// buffer, or to a stream with one write call. The memory is kept per thread
+// and reused by the next buffer. The text goes in with Write and operator<<,
+// no allocation nor formatting by the iostreams, while it is also the
+// streambuf of a std::ostream for the writers of the streams.
+class OutBuffer : public std::streambuf {
+public:
+    static const size_t kSize = 1 << 20;
+
+    // Write to the descriptor, which is not closed.
+    explicit OutBuffer(int fd) : OutBuffer(fd, nullptr) {}
+
+    // Write to the stream.
+    explicit OutBuffer(std::ostream &os) : OutBuffer(-1, &os) {}
+
+    // Flush, and hand the memory over to the next buffer of the thread.
+    ~OutBuffer() override;
+
+    OutBuffer(const OutBuffer &other) = delete;
+
+    OutBuffer &operator=(const OutBuffer &other) = delete;
+
+    void Write(const char *data, size_t size) {
+        if (size > (size_t) (epptr() - pptr())) {
+            Spill(data, size);
+            return;
+        }
+        memcpy(pptr(), data, size);
+        pbump((int) size);
+    }
+
+    void Put(char c) {
+        if (pptr() == epptr()) Flush();
+        *pptr() = c;
+        pbump(1);
+    }
+
+    // n times the char.
+    void Fill(char c, size_t n);
+
+    /// Flush
+    // Write the buffered text out. Return false if the sink failed, once or before.
+    bool Flush();
+
+    OutBuffer &operator<<(char c) {
+        Put(c);
+        return *this;
+    }
+
+    OutBuffer &operator<<(const char *str) {
+        Write(str, strlen(str));
+        return *this;
+    }
+
+    OutBuffer &operator<<(const std::string &str) {
+        Write(str.data(), str.size());
+        return *this;
+    }
+
+    // As std::ostream prints them, 0 or 1.
+    OutBuffer &operator<<(bool value) { return *this << (value ? '1' : '0'); }
+
+    OutBuffer &operator<<(int value) { return *this << (long long) value; }
+
+    OutBuffer &operator<<(long long value);
+
+    // As std::ostream prints them by default, %g.
+    OutBuffer &operator<<(double value);
+
+    OutBuffer &operator<<(Symbol symbol) {
+        Write(symbol.data(), symbol.size());
+        if (symbol.IsTag()) *this << "@:tag";
+        return *this;
+    }
+
+    // Stat: count of the writes to the sink
+    size_t Flushes() const { return _flushes; }
+
+protected:
+    int_type overflow(int_type c) override;
+
+    std::streamsize xsputn(const char *s, std::streamsize n) override;
+
+    int sync() override { return Flush() ? 0 : -1; }
+
+private:
+    int _fd;
+    std::ostream *_os;
+    char *_data;
+    size_t _flushes{0};
+    bool _failed{false};
+
+    OutBuffer(int fd, std::ostream *os);
+
+    // Past the end of the buffer: flush, then buffer the rest or write it through.
+    void Spill(const char *data, size_t size);
+
+    bool Sink(const char *data, size_t size);
+};
+
+/// TreeWriter
+// The indentation of the tree printers, kept per call instead of global, over
+// the OutBuffer they write to.
+class TreeWriter {
+public:
+    explicit TreeWriter(OutBuffer &out) : _out(out) {}
+
+    template<typename T>
+    TreeWriter &operator<<(const T &value) {
+        _out << value;
+        return *this;
+    }
+
+    void Write(const char *data, size_t size) { _out.Write(data, size); }
+
+    void INC() { _ntab++; }
+
+    void DEC() { _ntab--; }
+
+    void TAB() { _out.Fill(' ', 2 * _ntab); }
+
+    // A new line, one level in.
+    void ILT() {
+        _ntab++;
+        _out << '\n';
+        TAB();
+    }
+
+    // A new line, at the level.
+    void LT() {
+        _out << '\n';
+        TAB();
+    }
+
+protected:
+    OutBuffer &_out;
+    int _ntab{0};
+};
+
+#endif //LEOML_OUTBUFFER_H
@@ -11,28 +11,30 @@
 #include "Token.h"
 #include "Scope.h"
 #include "Type.h"
-#include <list>
+#include "SmallVec.h"
+#include "FlatTree.h"
 #include <unordered_map>
 #include <iostream>
 #include <ostream>
 
-class Visitor;
+class Resolver;
+
+class TreeWriter;
 
 /// AST Node Interface
 /*
  * Interface:
- *     - Accept;
  *     - operator<<;
+ * Nodes, with their types, lists and scopes, live in the Arena of the
+ * compilation (see Parser), and are released with it.
  * */
-class ParseTreeNode {
+class ParseTreeNode : public ArenaObject {
 public:
     ParseTreeNode() {};
 
     virtual ~ParseTreeNode() {};
 
-//    virtual void Accept(Visitor *v) = 0;  // Terminate the visiting.
-
-    virtual void Serialize(std::ostream &os) = 0;  // Serialize the node.
+    virtual void Serialize(TreeWriter &w) = 0;  // Serialize the node.
 
 //    virtual llvm::Value *codegen() = 0;  // JIT codegen
 
@@ -41,7 +43,7 @@ public:
 /// Language Hierarchy Model
 class Stmt;  // Stmt
 
-using StmtList = std::list<Stmt *>; // StmtList
+using StmtList = SmallVec<Stmt *>; // StmtList
 
 class Func;  // Func
 
@@ -49,13 +51,13 @@ class FuncCall;  // FuncCall
 
 class Var;
 
-using VarList = std::list<Var *>; // Varlist
+using VarList = SmallVec<Var *>; // Varlist
 
 class Exp; // Exp
 
 class Expb; //Expb
 
-using ExpbList = std::list<Expb *>; // Explist
+using ExpbList = SmallVec<Expb *>; // Explist
 
 class ExpbBinary;
 
@@ -65,7 +67,7 @@ class ExpbCompound;
 
 class Expa; //Expa
 
-using ExpPairList = std::list<std::pair<Expa *, Exp *>>;
+using ExpPairList = SmallVec<std::pair<Expa *, Exp *>>;
 
 class ExpaIf;
 
@@ -76,24 +78,27 @@ class ExpaLet;
 
 /// Program
 class Program : public ParseTreeNode {
-    template<typename T> friend
-    class TreeVisitor;
-
 private:
-    Program() : stmtList(new StmtList), scope(Scope::New(nullptr, S_FILE)) {};
+    Program() : stmtList(new StmtList(Arena::Current())), scope(Scope::New(nullptr, S_FILE)) {};
 
 public:
     StmtList *stmtList;
     Scope *scope;
-
-    ~Program() { delete stmtList, scope; };
+    int frameSize{0};  // slots of the global frame, set by the Resolver
 
     static Program *New() {
         return new Program();
     }
 
+    /// Serialize
+    // Print the tree through an OutBuffer: the stream's own if it is one,
+    // else one writing to the stream.
     void Serialize(std::ostream &os);
 
+    void Serialize(TreeWriter &w);
+
+    void Flatten(FlatTree *tree);
+
 //    virtual llvm::Value *codegen() { return nullptr; }
 
 
@@ -107,9 +112,6 @@ public:
  * stmt's old-name is decl.
  * */
 class Stmt : public ParseTreeNode {
-    template<typename T> friend
-    class TreeVisitor;
-
 private:
     Stmt(Program *program) : scope(Scope::New(program->scope, S_BLOCK)) {}
 
@@ -121,20 +123,22 @@ public:
         VarAssignStmt,
     };
 
-    Var *var;
-    Func *func;
-    Exp *exp;
+    Var *var{nullptr};
+    Func *func{nullptr};
+    Exp *exp{nullptr};
     int kind;
     Scope *scope;
 
-    ~Stmt();
-
     static Stmt *New(Program *program) {
         assert(program != nullptr);
         return new Stmt(program);
     }
 
-    void Serialize(std::ostream &os);
+    void Serialize(TreeWriter &w);
+
+    void Resolve(Resolver *resolver);
+
+    FlatTree::NodeId Flatten(FlatTree *tree);
 
 //    virtual llvm::Value *codegen() { return nullptr; }
 
@@ -151,40 +155,45 @@ public:
  *
  * */
 class Exp : public ParseTreeNode {
-    template<typename T> friend
-    class TreeVisitor;
-
     friend class Expa;
 
 protected:
     const Token *_root;
-    Type *_type;
+    Type::Id _type{Type::Unknown};
 
-    Exp(const Token *token) : _root(token), _type(Type::New(Type::T_Unknown)), expbList(new ExpbList),
-                              scope(new Scope(nullptr, S_BLOCK)) {};
+    Exp(const Token *token) : _root(token), expbList(new ExpbList(Arena::Current())), scope(new Scope(nullptr, S_BLOCK)) {};
 
 public:
-    Var *var;
+    Var *var{nullptr};
     ExpbList *expbList;
     Scope *scope;
 
-    virtual ~Exp() { delete _root, _type, var, expbList; };
-
     static Exp *New(const Token *token) { return new Exp(token); }
 
-    virtual void Serialize(std::ostream &os);
+    virtual void Serialize(TreeWriter &w);
 
     virtual void TypeCheck() {};
 
     virtual void ScopeCheck();
 
+    // Address the vars, see Resolver.
+    virtual void Resolve(Resolver *resolver);
+
+    // Lower into the tree, return the node id, see FlatTree.
+    virtual FlatTree::NodeId Flatten(FlatTree *tree);
+
     const Token *GetRoot() const { return _root; };
 
-    virtual Type *GetType() { return _type; }
+    /// TypeRef
+    // The slot of the type of the exp, which the inference fills in.
+    virtual Type::Id &TypeRef() { return _type; }
 
-    void SetType(Type *type) { *_type = *type; }
+    Type::Id GetType() { return TypeRef(); }
 
-    void SetType(int kind) { _type->kind = kind; }
+    void SetType(Type::Id type) { _type = type; }
+
+    // Type::ExpectOrInfer at the root.
+    void ExpectOrInfer(Type::Id expect) { Type::ExpectOrInfer(TypeRef(), expect, _root); }
 
     bool IsVar() const { return _root->tag == Token::Var; }
 
@@ -207,19 +216,14 @@ public:
  *     First(expbCompound) = { !LeftRecur! }
  * */
 class Expb : public Exp {
-    template<typename T> friend
-    class TreeVisitor;
-
 protected:
     Expb(const Token *token) : Exp(token) {};
 
 public:
-    virtual ~Expb() {}
-
     static Expb *New(const Token *token) { return new Expb(token); }
 
     // Expb should not be directly serilizated.
-//    virtual void Serialize(std::ostream &os);
+//    virtual void Serialize(TreeWriter &w);
 
     virtual void TypeCheck() {};
 
@@ -235,9 +239,6 @@ public:
  * BinaryOp: +, -, *, /, <, >, <=, >=, ==, !=
  * */
 class ExpbBinary : public Expb {
-    template<typename T> friend
-    class TreeVisitor;
-
 private:
     Expb *_lhs;
     Expb *_rhs;
@@ -247,8 +248,6 @@ private:
     }
 
 public:
-    ~ExpbBinary();;
-
     static ExpbBinary *New(const Token *token, Expb *lhs, Expb *rhs) {
         return new ExpbBinary(token, token->tag, lhs, rhs);
     }
@@ -257,7 +256,18 @@ public:
         return new ExpbBinary(token, op, lhs, rhs);
     };
 
-    virtual void Serialize(std::ostream &os);
+    /// Spine
+    // The binary nodes down the lhs from this one, this one first, and return
+    // the first operand, the lhs of the last. A chain of left associative
+    // operators is as deep as it is long, the passes walk it with this
+    // instead of recursing.
+    Expb *Spine(SmallVec<ExpbBinary *> &spine);
+
+    virtual void Serialize(TreeWriter &w);
+
+    virtual void Resolve(Resolver *resolver);
+
+    virtual FlatTree::NodeId Flatten(FlatTree *tree);
 
     /*
      * match(op) => AdditiveOpTypeCheck/EqualityOpTypeCheck
@@ -308,9 +318,6 @@ public:
  *     +, -
  * */
 class ExpbUnary : public Expb {
-    template<typename T> friend
-    class TreeVisitor;
-
 private:
     Expb *_oprand;
     int _op;
@@ -318,13 +325,15 @@ private:
     ExpbUnary(const Token *root, int op, Expb *oprand) : Expb(root), _op(op), _oprand(oprand) {}
 
 public:
-    ~ExpbUnary() { delete _oprand; };
-
     static ExpbUnary *New(const Token *token, Expb *oprand) { return new ExpbUnary(token, token->tag, oprand); }
 
     static ExpbUnary *New(const Token *token, int op, Expb *oprand) { return new ExpbUnary(token, op, oprand); };
 
-    virtual void Serialize(std::ostream &os);
+    virtual void Serialize(TreeWriter &w);
+
+    virtual void Resolve(Resolver *resolver);
+
+    virtual FlatTree::NodeId Flatten(FlatTree *tree);
 
     /*
      * check rule:
@@ -344,9 +353,6 @@ public:
  * expb ::= ( expa, expb )
  * */
 class ExpbCons : public Expb {
-    template<typename T> friend
-    class TreeVisitor;
-
 private:
     Expb *_first;
     Expb *_second;
@@ -354,11 +360,13 @@ private:
     ExpbCons(const Token *token, Expb *first, Expb *second) : Expb(token), _first(first), _second(second) {}
 
 public:
-    ~ExpbCons();
-
     static ExpbCons *New(const Token *token, Expb *first, Expb *second) { return new ExpbCons(token, first, second); }
 
-    virtual void Serialize(std::ostream &os);
+    virtual void Serialize(TreeWriter &w);
+
+    virtual void Resolve(Resolver *resolver);
+
+    virtual FlatTree::NodeId Flatten(FlatTree *tree);
 
 };
 
@@ -367,9 +375,6 @@ public:
  * expb ::= expb; expb
  * */
 class ExpbCompound : public Expb {
-    template<typename T> friend
-    class TreeVisitor;
-
 private:
     Expa *_first;
     Expb *_second;
@@ -377,13 +382,15 @@ private:
     ExpbCompound(const Token *root, int op, Expa *lhs, Expb *rhs) : Expb(root), _first(lhs), _second(rhs) {}
 
 public:
-    ~ExpbCompound();
-
     static ExpbCompound *New(const Token *token, Expa *lhs, Expb *rhs) {
         return new ExpbCompound(token, token->tag, lhs, rhs);
     }
 
-    virtual void Serialize(std::ostream &os);
+    virtual void Serialize(TreeWriter &w);
+
+    virtual void Resolve(Resolver *resolver);
+
+    virtual FlatTree::NodeId Flatten(FlatTree *tree);
 
     /*
      * check rule:
@@ -400,9 +407,6 @@ public:
  * expb ::= fst ( expa, expb )
  * */
 class ExpbFst : public Expb {
-    template<typename T> friend
-    class TreeVisitor;
-
 private:
     Expb *_first;
     Expb *_second;
@@ -410,11 +414,13 @@ private:
     ExpbFst(const Token *token, Expb *first, Expb *second) : Expb(token), _first(first), _second(second) {}
 
 public:
-    ~ExpbFst();
-
     static ExpbFst *New(const Token *token, Expb *first, Expb *second) { return new ExpbFst(token, first, second); }
 
-    virtual void Serialize(std::ostream &os);
+    virtual void Serialize(TreeWriter &w);
+
+    virtual void Resolve(Resolver *resolver);
+
+    virtual FlatTree::NodeId Flatten(FlatTree *tree);
 
 };
 
@@ -423,9 +429,6 @@ public:
  * expb ::= snd ( expa, expb )
  * */
 class ExpbSnd : public Expb {
-    template<typename T> friend
-    class TreeVisitor;
-
 private:
     Expb *_first;
     Expb *_second;
@@ -433,11 +436,13 @@ private:
     ExpbSnd(const Token *token, Expb *first, Expb *second) : Expb(token), _first(first), _second(second) {}
 
 public:
-    ~ExpbSnd();
-
     static ExpbSnd *New(const Token *token, Expb *first, Expb *second) { return new ExpbSnd(token, first, second); }
 
-    virtual void Serialize(std::ostream &os);
+    virtual void Serialize(TreeWriter &w);
+
+    virtual void Resolve(Resolver *resolver);
+
+    virtual FlatTree::NodeId Flatten(FlatTree *tree);
 
 };
 
@@ -451,21 +456,16 @@ public:
  *        | ( exp )
  * */
 class Expa : public Expb {
-    template<typename T> friend
-    class TreeVisitor;
-
 protected:
     Expa(const Token *token) : Expb(token) {}
 
 public:
-    ~Expa() {};
-
     static Expa *New(Exp *exp) { return new Expa(exp->_root); }
 
     static Expa *New(const Token *token) { return new Expa(token); }
 
     // Expa should not be directly serilizated.
-//    virtual void Serialize(std::ostream &os);
+//    virtual void Serialize(TreeWriter &w);
 
 //    virtual llvm::Value *codegen() { return nullptr; }
 
@@ -474,22 +474,25 @@ public:
 
 /// Expa Var
 class Var : public Expa {
-    template<typename T> friend
-    class TreeVisitor;
-
 protected:
-    Var(const Token *token) : Expa(token) { name = token->str; }
+    Var(const Token *token) : Expa(token), name(token->Sym()) {}
 
 public:
-    std::string name;
-
-    ~Var() { delete _root; };
+    Symbol name;
+    // Lexical address set by the Resolver: frames crossed outward, and the
+    // slot in that frame. depth is -1 for an unbound name.
+    int depth{-1};
+    int slot{-1};
 
     static Var *New(const Token *token) { return new Var(token); }
 
     void SetTok(const Token *token) { _root = token; }
 
-    virtual void Serialize(std::ostream &os);
+    virtual void Serialize(TreeWriter &w);
+
+    virtual void Resolve(Resolver *resolver);
+
+    virtual FlatTree::NodeId Flatten(FlatTree *tree);
 
 //    virtual llvm::Value *codegen();
 
@@ -501,40 +504,48 @@ public:
  * func alias funcStmt, func extends var for scope.
  * */
 class Func : public Var {
-    template<typename T> friend
-    class TreeVisitor;
-
 protected:
-    Func(const Token *token) : Var(token), paramList(new VarList), fun(new TFunc()), isRec(false),
+    Func(const Token *token) : Var(token), paramList(new VarList(Arena::Current())), isRec(false),
                                scope(new Scope(nullptr, S_FUNC)) {}
 
 public:
-    Exp *body;
+    Exp *body{nullptr};
     VarList *paramList;
-    TFunc *fun;
+    Type::Id retType{Type::Unknown};
+    Type::Id *ret{&retType};  // the proto's, once a call is checked
+    Type::Id sig{Type::Unknown};  // the function type, as checked
     bool isRec;
+    bool failed{false};  // its checks had an error, those of its calls are skipped
     Scope *scope;
-
-    virtual ~Func() { delete body, paramList; }
+    int frameSize{0};  // slots of the params and the let-in vars of the body
 
     static Func *New(const Token *token) { return new Func(token); }
 
-    virtual void Serialize(std::ostream &os);
+    virtual void Serialize(TreeWriter &w);
+
+    virtual void Resolve(Resolver *resolver);
+
+    virtual FlatTree::NodeId Flatten(FlatTree *tree);
 
     /*
      * check rule:
      *     None
      * infer rule:
      *     _type = T_Func
-     *     fun.retType = type(body)
-     *     infer paramTypeList from body, scope needed
+     *     retType = type(body)
+     *     infer the param types from body, scope needed
+     *     sig = params -> retType
      * */
     virtual void TypeCheck();
 
     /*
-     * Return fun.retType instead of this._type as the type.
+     * Return the retType instead of this._type as the type.
      * */
-    virtual Type *GetType() { return fun->retType; }
+    virtual Type::Id &TypeRef() { return *ret; }
+
+    /// Signature
+    // The params of sig to the return type as inferred so far, Unknown if unchecked.
+    Type::Id Signature() const;
 
 //    virtual llvm::Value *codegen();
 
@@ -548,22 +559,21 @@ public:
  *     funcCall has the return llvm::Value as Exp*
  * */
 class FuncCall : public Func {
-    template<typename T> friend
-    class TreeVisitor;
-
 private:
-    FuncCall(const Token *token) : Func(token), argList(new ExpbList) {}
+    FuncCall(const Token *token) : Func(token), argList(new ExpbList(Arena::Current())) {}
 
 public:
-    Exp *retValue;
+    Exp *retValue{nullptr};
     ExpbList *argList;
-    Func *proto;
-
-    ~FuncCall() { delete retValue, argList; }
+    Func *proto{nullptr};
 
     static FuncCall *New(const Token *token) { return new FuncCall(token); }
 
-    virtual void Serialize(std::ostream &os);
+    virtual void Serialize(TreeWriter &w);
+
+    virtual void Resolve(Resolver *resolver);
+
+    virtual FlatTree::NodeId Flatten(FlatTree *tree);
 
     /*
      * check rule:
@@ -584,45 +594,40 @@ public:
  * Constant ::= intl | floatl | booll | stringl | Unit
  * */
 class ExpaConstant : public Expa {
-    template<typename T> friend
-    class TreeVisitor;
-
 private:
     union {
         int _ival;
         float _fval;
         bool _bval;
     };
-    std::string _sval{};
+    TokenStr _sval{};
 
     ExpaConstant(const Token *token) : Expa(token) {
         assert(token->tag == Token::Unit);
-        _type->kind = Type::T_Unit;
+        _type = Type::Unit;
     }
 
     ExpaConstant(const Token *token, int val) : Expa(token), _ival(val) {
         assert(token->tag == Token::Int);
-        _type->kind = Type::T_Int;
+        _type = Type::Int;
     }
 
     ExpaConstant(const Token *token, float val) : Expa(token), _fval(val) {
         assert(token->tag == Token::Float);
-        _type->kind = Type::T_Float;
+        _type = Type::Float;
     }
 
     ExpaConstant(const Token *token, bool bval) : Expa(token), _bval(bval) {
         assert(token->tag == Token::Bool);
-        _type->kind = Type::T_Bool;
+        _type = Type::Bool;
     }
 
-    ExpaConstant(const Token *token, const std::string &val) : Expa(token), _sval(val) {
+    ExpaConstant(const Token *token, const TokenStr &val) : Expa(token), _sval(val) {
         assert(token->tag == Token::String);
-        _type->kind = Type::T_Unknown;
+        _type = Type::Unknown;
     }
 
 public:
-    ~ExpaConstant() {}
-
     static ExpaConstant *New(const Token *token, int val) { return new ExpaConstant(token, val); }
 
     static ExpaConstant *New(const Token *token, float val) { return new ExpaConstant(token, val); }
@@ -631,9 +636,11 @@ public:
 
     static ExpaConstant *New(const Token *token) { return new ExpaConstant(token); }
 
-    static ExpaConstant *New(const Token *token, const std::string &val) { return new ExpaConstant(token, val); }
+    static ExpaConstant *New(const Token *token, const TokenStr &val) { return new ExpaConstant(token, val); }
 
-    virtual void Serialize(std::ostream &os);
+    virtual void Serialize(TreeWriter &w);
+
+    virtual FlatTree::NodeId Flatten(FlatTree *tree);
 
 //    virtual llvm::Value *codegen();
 
@@ -644,9 +651,6 @@ public:
  * expaIf ::= if exp then exp [else exp]
  * */
 class ExpaIf : public Expa {
-    template<typename T> friend
-    class TreeVisitor;
-
 private:
     Exp *_cond;
     Exp *_then;
@@ -655,13 +659,15 @@ private:
     ExpaIf(const Token *token, Exp *cond, Exp *then, Exp *els) : Expa(token), _cond(cond), _then(then), _els(els) {}
 
 public:
-    ~ExpaIf() { delete _cond, _then, _els; }
-
     static ExpaIf *New(const Token *token, Exp *cond, Exp *then, Exp *els = nullptr) {
         return new ExpaIf(token, cond, then, els);
     };
 
-    virtual void Serialize(std::ostream &os);
+    virtual void Serialize(TreeWriter &w);
+
+    virtual void Resolve(Resolver *resolver);
+
+    virtual FlatTree::NodeId Flatten(FlatTree *tree);
 
     /*
      * check rule:
@@ -682,9 +688,6 @@ public:
  * expaWhile ::= while exp do exp done
 * */
 class ExpaWhile : public Expa {
-    template<typename T> friend
-    class TreeVisitor;
-
 private:
     Exp *_cond;
     Exp *_body;
@@ -692,11 +695,13 @@ private:
     ExpaWhile(const Token *token, Exp *cond, Exp *body) : Expa(token), _cond(cond), _body(body) {}
 
 public:
-    ~ExpaWhile() { delete _cond, _body; }
-
     static ExpaWhile *New(const Token *token, Exp *cond, Exp *body) { return new ExpaWhile(token, cond, body); }
 
-    virtual void Serialize(std::ostream &os);
+    virtual void Serialize(TreeWriter &w);
+
+    virtual void Resolve(Resolver *resolver);
+
+    virtual FlatTree::NodeId Flatten(FlatTree *tree);
 
     /*
      * check rule:
@@ -716,23 +721,22 @@ public:
  * expaLet ::= let var = exp [and var = exp]* in exp
  * */
 class ExpaLet : public Expa {
-    template<typename T> friend
-    class TreeVisitor;
-
 private :
-    ExpaLet(const Token *token) : Expa(token), expPairList(new ExpPairList) {}
+    ExpaLet(const Token *token) : Expa(token), expPairList(new ExpPairList(Arena::Current())) {}
 
 public:
-    Exp *body;
+    Exp *body{nullptr};
     ExpPairList *expPairList;
 
-    ~ExpaLet() { delete body, expPairList; }
-
     static ExpaLet *New(const Token *token) {
         return new ExpaLet(token);
     }
 
-    virtual void Serialize(std::ostream &os);
+    virtual void Serialize(TreeWriter &w);
+
+    virtual void Resolve(Resolver *resolver);
+
+    virtual FlatTree::NodeId Flatten(FlatTree *tree);
 
     /*
      * check rule:
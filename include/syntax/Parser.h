@@ -6,38 +6,124 @@
 #ifndef LEOML_PARSER_H
 #define LEOML_PARSER_H
 
+#include "Diagnostics.h"
 #include "Lexer.h"
 #include "ParseTree.h"
+#include "FlatTree.h"
+#include "Sema.h"
+#include "ThreadPool.h"
+#include <cstdio>
 #include <ostream>
+#include <vector>
+
+/// ParserStats
+// Counters of the expression parser. The expas ParseExpb parses ahead, to see
+// whether an operator follows: each one followed by an operator is reused as
+// the lhs of the binary expression, not parsed again.
+struct ParserStats {
+    size_t lookaheads{0};
+    size_t reused{0};
+    size_t operators{0};  // binary operators parsed
+    size_t climbs{0};  // rhs parsed at a higher precedence
+
+    void Print(FILE *out) const;
+};
 
+/// Parser
+// One compilation: the Parser owns the Arena of the AST, which is released
+// with the Parser. The tokens are owned by the TokenSequence.
 class Parser {
+    friend class Document;
+
 private:
     TokenSequence _ts; // token stream
-    Program *_program; // the Root of AST
-    Scope *currentScope; // current scope
+    Arena *_arena; // nodes, types, lists and scopes of the AST
+    Program *_program{nullptr}; // the Root of AST
+    FlatTree *_tree{nullptr}; // the AST lowered, for the later passes
+    Scope *currentScope{nullptr}; // current scope
 
-    Parser(const TokenSequence &ts) : _ts(ts), _program(Program::New()) { currentScope = _program->scope; }
+    Sema _sema{_arena}; // the checks of the statements parsed
+    bool _syntaxOnly; // no checks
 
-    ~Parser() { delete _program; };
+    ParserStats _stats;
 
-public:
-    static Parser *New(const TokenSequence &ts) { return new Parser(ts); }
+    /// Chunks
+    // On a pool, every chunk of statements is parsed by a Parser of its own into
+    // its own arena. The worker runs the local checks of the chunk, the link
+    // pass the global ones, in source order.
+    std::vector<Parser *> _chunks;
+    std::vector<Stmt *> _stmts; // of a chunk
+    Diagnostics *_diags{nullptr}; // of a chunk, merged by the link pass
+
+    Parser(const TokenSequence &ts, bool syntaxOnly) : _ts(ts), _arena(new Arena), _syntaxOnly(syntaxOnly) {}
 
-    // main API
+    // A chunk of the program.
+    Parser(const TokenSequence &ts, Program *program, bool syntaxOnly, size_t blockSize = Arena::kBlockSize)
+            : _ts(ts), _arena(new Arena(blockSize)), _program(program), _syntaxOnly(syntaxOnly) {}
+
+public:
+    ~Parser() {
+        for (auto chunk:_chunks) delete chunk;
+        delete _diags;
+        delete _tree;
+        delete _arena;
+    };
+
+    /// New
+    // A syntax only parser builds the tree without the scope and type checks.
+    static Parser *New(const TokenSequence &ts, bool syntaxOnly = false) { return new Parser(ts, syntaxOnly); }
+
+    const Arena *GetArena() const { return _arena; }
+
+    /// Parse
+    // Under a Diagnostics engine, a statement with an error is dropped and the
+    // parse goes on with the next; the tree is not built if there were errors.
     void Parse();
 
+    /// Parse on the pool
+    // Split the program after the ";;"s, parse the chunks concurrently, then
+    // link the statements into the program. Same tree as Parse().
+    void Parse(ThreadPool *pool);
+
     Program* GetProgram(){
         return _program;
     }
 
+    const FlatTree *GetTree() const { return _tree; }
+
+    const ParserStats &GetStats() const { return _stats; }
+
     void Serialize(std::ostream &os);
 
     Program *ParseProgram();
 
 private:
+    /// Check
+    // Record the scope and type check of the node, run by Sema once the statements are parsed.
+    void Check(Sema::Kind kind, ParseTreeNode *node, ParseTreeNode *other = nullptr) {
+        if (!_syntaxOnly) _sema.Add(kind, node, other);
+    }
+
+    // Parse the statements of a chunk, on a worker.
+    void ParseChunk();
+
+    // Resolve and lower the parsed program, on the pool if any.
+    void Finish(ThreadPool *pool = nullptr);
+
     /// Parse Stmt
     Stmt *ParseStmt();
 
+    /// Try Parse Stmt
+    // ParseStmt and end its checks. After an error, drop its checks, skip past
+    // its ";;" and return nullptr.
+    Stmt *TryParseStmt();
+
+    /// Sync
+    // After the error at the token, skip to the tag, the "in" of the let or the
+    // "done" of the while being parsed, or the ";;". False if the statement
+    // ends before, or the compilation stops.
+    bool Sync(const Token *error, int tag);
+
     /// Parse Assign Stmt
     Stmt *ParseAssignStmt(const Token *token);
 
@@ -54,9 +140,11 @@ private:
     Expb *ParseExpb();
 
     /// Parse ExpbBinary
-    ExpbBinary *ParseExpbBinary(const Token *token);
+    // The lhs is parsed, an operator follows.
+    Expb *ParseExpbBinary(Expb *lhs);
 
-    /// Parse ExpbBinary. Precedence Aux
+    /// Parse ExpbBinary. Pratt loop
+    // Fold the operators binding at least as tight as prec into lhs, left to right.
     Expb *ParseExpbBinaryRHS(int prec, Expb *lhs);
 
     /// Parse ExpbUnary
@@ -92,6 +180,9 @@ private:
     /// Parse ExpaLet
     ExpaLet *ParseExpaLet(const Token *token);
 
+    // The "and"-separated bindings of the let.
+    void ParseExpaLetBindings(ExpaLet *ret);
+
     /// Parse ExpaParen
     Expb *ParseExpaParen(const Token *token);
 };
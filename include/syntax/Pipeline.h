@@ -0,0 +1,56 @@
+#ifndef LEOML_PIPELINE_H
+#define LEOML_PIPELINE_H
+
+#include "Diagnostics.h"
+#include "SpscRing.h"
+#include "Symbol.h"
+#include "Token.h"
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+class Lexer;
+
+/// Pipeline
+// The lexer runs ahead on a thread of its own, and hands its tokens over to
+// the streamed TokenList in batches through a SpscRing, see Lexer::Pipe. Both
+// sides spin a little, then yield, when the ring is full or empty.
+//
+// The thread reports the errors of the lexer to the Diagnostics of the parser's.
+class Pipeline : public TokenSource {
+public:
+    static const uint32_t kBatch = 256;  // tokens
+    static const size_t kSlots = 64;  // batches in flight
+
+    // Start lexing on the thread, the lexer is the thread's from here.
+    static Pipeline *New(Lexer *lexer) { return new Pipeline(lexer); }
+
+    // Join the thread, stopping it if the parser did not read to the END.
+    ~Pipeline() override;
+
+    Pipeline(const Pipeline &other) = delete;
+
+    Pipeline &operator=(const Pipeline &other) = delete;
+
+    const Token *Pull() override;
+
+private:
+    struct Batch {
+        uint32_t size;
+        const Token *tokens[kBatch];
+    };
+
+    Symbol::Shared _shared;  // the lexer interns on the thread
+    Diagnostics *_diags;  // of the parser's thread, for the lexer's
+    SpscRing<Batch, kSlots> _ring;
+    Batch *_batch{nullptr};  // being read, of the consumer
+    uint32_t _read{0};  // in the batch
+    std::atomic<bool> _stop{false};
+    std::thread _thread;
+
+    explicit Pipeline(Lexer *lexer);
+
+    void Produce(Lexer *lexer);
+};
+
+#endif //LEOML_PIPELINE_H
@@ -0,0 +1,80 @@
+#ifndef LEOML_RESOLVER_H
+#define LEOML_RESOLVER_H
+
+#include "Symbol.h"
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+class Program;
+
+class Stmt;
+
+class Var;
+
+/// Resolver
+// Lexical addressing pass, run once the Program is parsed.
+// A frame is the Program (the globals) or the body of a Func. Every binding
+// site (a global, a param, a let-in var, a func name) gets the next slot of
+// its frame; every reference gets the (depth, slot) of the binding it sees,
+// depth counting the frames crossed outward. Frame sizes are stored on the
+// Program and the Funcs, so storage can be indexed without name lookups.
+// Names bound nowhere keep depth -1.
+class Resolver {
+public:
+    Resolver() {}
+
+    Resolver(const Resolver &other) = delete;
+
+    Resolver &operator=(const Resolver &other) = delete;
+
+    void Resolve(Program *program);
+
+    /// Resolve statements
+    // Resolve statements following others already resolved, which took base
+    // slots of the global frame. A name bound nowhere in them is looked up by
+    // globals, for the global visible there, or nullptr. Return the slots of
+    // the global frame taken after them.
+    int Resolve(Stmt *const *stmts, size_t count, int base, std::function<Var *(Symbol)> globals);
+
+    /// Bind
+    // Give the var the next slot of the current frame, and make it visible
+    // until the end of the current block.
+    void Bind(Var *var);
+
+    /// Lookup
+    // Address the var by the innermost visible binding of its name.
+    void Lookup(Var *var) const;
+
+    void EnterFrame();
+
+    // Return the size of the frame left.
+    int LeaveFrame();
+
+    void EnterBlock();
+
+    void LeaveBlock();
+
+private:
+    static const uint32_t kNone = UINT32_MAX;
+
+    struct Binding {
+        Symbol name;
+        int frame;
+        int slot;
+        uint32_t shadowed;  // the binding of the same name it hides, or kNone
+    };
+
+    std::vector<Binding> _bindings;  // visible ones, innermost last
+
+    std::unordered_map<Symbol, uint32_t> _innermost;  // name => index in _bindings
+
+    std::vector<size_t> _blocks;  // size of _bindings at block entries
+
+    std::vector<int> _frames;  // next free slot of every open frame
+
+    std::function<Var *(Symbol)> _globals;  // of the statements resolved before, if any
+};
+
+#endif //LEOML_RESOLVER_H
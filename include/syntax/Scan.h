@@ -0,0 +1,39 @@
+#ifndef LEOML_SCAN_H
+#define LEOML_SCAN_H
+
+/// ScanKernel
+// Byte class scanners used by the Lexer, classifying 16/32 bytes at a time
+// with SSE2/AVX2 when the cpu has it. A scanner stops at the first byte out of
+// its class, NUL included, so the scalar tail never runs past the sentinel.
+// Vector loads stay below limit.
+struct ScanKernel {
+    const char *name;
+
+    // [ \t\r\v\f], the newline is not a white space here.
+    const char *(*skipSpace)(const char *p, const char *limit);
+
+    // [a-zA-Z0-9_]
+    const char *(*skipIdent)(const char *p, const char *limit);
+
+    // [0-9_]
+    const char *(*skipDigit)(const char *p, const char *limit);
+
+    // Stop at '*' or NUL. Count the newlines passed by into *lines,
+    // and set *lineBegin after the last of them.
+    const char *(*skipComment)(const char *p, const char *limit, unsigned *lines, const char **lineBegin);
+
+    /// Current
+    // The kernel in use, the best one by CPUID unless Use-d.
+    static const ScanKernel *Current();
+
+    static void Use(const ScanKernel *kernel);
+
+    static const ScanKernel *Scalar();
+
+    // nullptr if the cpu does not support it.
+    static const ScanKernel *Sse2();
+
+    static const ScanKernel *Avx2();
+};
+
+#endif //LEOML_SCAN_H
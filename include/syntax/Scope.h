@@ -6,8 +6,10 @@
 #ifndef LEOML_SCOPE_H
 #define LEOML_SCOPE_H
 
+#include "SmallVec.h"
+#include "Symbol.h"
 #include <iostream>
-#include <map>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <cassert>
@@ -22,13 +24,20 @@ typedef enum {
     S_FUNC,  // 函数作用域（函数参数&函数体）
 } ScopeKind;
 
-class Scope {
+/// Scope
+// Bindings live in a flat open addressing table keyed by Symbol id.
+// Append links another scope instead of copying its bindings, so a
+// lookup in the current scope searches the own table, then the linked
+// ones. Find goes on up the parent chain; hits out of the own table are
+// memoized until the next change to any scope on the thread.
+// Scopes live in the current Arena, and their tables and links grow in the
+// same one, whatever arena is current then.
+class Scope : public ArenaObject {
     using TagList = std::vector<Var *>;
-    using VarMap = std::map<std::string, Var *>;
 
 public:
     Scope(Scope *parent, ScopeKind kind)
-            : _parent(parent), _kind(kind) { _map = {}; }
+            : _parent(parent), _kind(kind), _arena(Arena::Current()), _linked(_arena) {}
 
     ~Scope() {}
 
@@ -36,7 +45,10 @@ public:
 
     Scope *Parent() { return _parent; }
 
-    void SetParent(Scope *parent) { _parent = parent; }
+    void SetParent(Scope *parent) {
+        _parent = parent;
+        ++Generation();
+    }
 
     ScopeKind Kind() const { return _kind; }
 
@@ -52,46 +64,74 @@ public:
 
     void Insert(Var *var);
 
-    void Insert(const std::string &name, Var *var);
+    void Insert(Symbol name, Var *var);
 
     void InsertTag(Var *var);
 
+    /// Append
+    // Link the other scope: its bindings, present and future, are visible
+    // from this one, after the own ones. Self and repeated links are ignored.
     void Append(Scope *other);
 
     void Serialize(std::ostream &os);
 
     bool operator==(const Scope &other) const { return _kind == other._kind; }
 
-    VarMap::iterator begin() { return _map.begin(); }
-
-    VarMap::iterator end() { return _map.end(); }
-
-    size_t size() const { return _map.size(); }
+    // Count of the own bindings.
+    size_t size() const { return _size; }
 
 private:
+    struct Binding {
+        Symbol name;
+        Var *var;
+    };
+
+    struct Memo {
+        Symbol name;
+        Var *var;
+        uint64_t generation;
+    };
+
+    static const size_t kMinSlots = 8;
+    static const size_t kMemoSlots = 4;
+
+    /// Generation
+    // Bumped by every change to any scope, invalidates the memos. Per thread:
+    // the threads count in disjoint ranges, so the memos made on one thread are
+    // cold on the others, once a scope is handed over after a join.
+    static uint64_t &Generation();
+
     Scope *_parent;
 
     ScopeKind _kind;
 
-    VarMap _map;
+    Arena *_arena;  // it lives in
+
+    Binding *_table{nullptr};  // empty slots are named kNoName
+
+    size_t _slots{0};
+
+    size_t _size{0};
+
+    SmallVec<Scope *, 2> _linked;
+
+    Memo _memo[kMemoSlots]{};
+
+    mutable bool _visiting{false};  // cycle guard of the linked search
 
     Scope(const Scope &scope);
 
-    Var *Find(const std::string &name);
+    Var *Find(Symbol name);
 
-    Var *FindInCurScope(const std::string &name);
+    Var *FindInCurScope(Symbol name);
 
-    Var *FindTag(const std::string &name);
+    Var *FindTag(Symbol name);
 
-    Var *FindTagInCurScope(const std::string &name);
+    Var *FindTagInCurScope(Symbol name);
 
-    std::string TagName(const std::string &name) {
-        return name + "@:tag";
-    }
+    Var *FindOwn(Symbol name) const;
 
-    static bool IsTagName(const std::string &name) {
-        return name.size() > 5 && name[name.size() - 5] == '@';
-    }
+    void Grow();
 
     const Scope &operator=(const Scope &other);
 
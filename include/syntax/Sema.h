@@ -0,0 +1,103 @@
+#ifndef LEOML_SEMA_H
+#define LEOML_SEMA_H
+
+#include "Arena.h"
+#include "ParseTree.h"
+#include <cstdint>
+#include <vector>
+
+/// Sema
+// The scope and type checks of the parsed statements, a pass of their own.
+// The Parser records the check of every node as it completes the node, a kind
+// and the nodes, and Sema runs them in that order once the statements are
+// parsed; a syntax only parse records none. A check is local if it touches the
+// nodes of its statement only, global if it reaches the program scope. The
+// first global check of a statement and the ones after it may read what it
+// infers, so they run in the order of the statements, while the local ones
+// before it may run concurrently with those of other statements.
+//
+// After an error, the rest of the checks of the statement are skipped, but
+// those binding its names, so that the uses after it are not reported again.
+class Sema {
+public:
+    enum Kind : uint8_t {
+        // local
+        C_Var,  // insert the var into its scope
+        C_Scope,  // ScopeCheck
+        C_Expb,  // the exp of an expb: its type and its scope
+        C_Type,  // TypeCheck
+        C_TypeScope,  // TypeCheck, then ScopeCheck
+        // global
+        C_RecFunc,  // insert the rec func into the program scope
+        C_FuncCall,  // find the proto in the program scope, TypeCheck
+        C_VarAssign,  // insert the var into the scope around, infer its type
+        C_FuncAssign,  // insert the func into the scope around, TypeCheck
+        C_VarStmt,  // find the global named in the program scope
+    };
+
+    // The checks allocate in the arena of the nodes.
+    explicit Sema(Arena *arena) : _arena(arena) {}
+
+    Sema(const Sema &other) = delete;
+
+    Sema &operator=(const Sema &other) = delete;
+
+    // Record a check of the statement being parsed.
+    void Add(Kind kind, ParseTreeNode *node, ParseTreeNode *other = nullptr);
+
+    // The statement is parsed, the next checks are of the next one.
+    void EndStmt();
+
+    // The statement failed to parse, drop its checks.
+    void DropStmt();
+
+    /// Run
+    // Run the checks recorded, in order, then drop them.
+    void Run(Program *program);
+
+    /// Run the local checks
+    // The checks of every statement before its first global one, on any thread.
+    void RunLocal();
+
+    /// Run the global checks
+    // The rest, after RunLocal, in order, then drop them all.
+    void RunGlobal(Program *program);
+
+    // Count of the checks recorded.
+    size_t Size() const { return _checks.size(); }
+
+private:
+    static const uint32_t kNone = UINT32_MAX;
+
+    struct Check {
+        Kind kind;
+        ParseTreeNode *node;
+        ParseTreeNode *other;
+    };
+
+    // The checks of a statement: [begin, global) local, [global, end) global.
+    struct Span {
+        uint32_t begin;
+        uint32_t global;
+        uint32_t end;
+        bool failed;
+    };
+
+    Arena *_arena;
+    std::vector<Check> _checks;
+    std::vector<Span> _spans;
+    uint32_t _begin{0};  // of the statement being parsed
+    uint32_t _global{kNone};  // of the statement being parsed
+
+    static void Do(const Check &check, Program *program);
+
+    // The part of the check that binds a name, of a failed statement.
+    static void Define(const Check &check, Program *program);
+
+    // The checks [begin, end) of the span, until one fails.
+    void Run(Span &span, uint32_t begin, uint32_t end, Program *program);
+
+    void Clear();
+};
+
+#endif //LEOML_SEMA_H
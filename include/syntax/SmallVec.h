@@ -0,0 +1,87 @@
+#ifndef LEOML_SMALLVEC_H
+#define LEOML_SMALLVEC_H
+
+#include "Arena.h"
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <type_traits>
+
+/// SmallVec
+// Vector whose first N elements live in place, the rest in the arena it is
+// given: that of the object holding it, which is not destroyed. Growing
+// abandons the old storage to the arena; nothing is ever freed on its own, so
+// the elements must be trivially destructible. Without an arena, for a local,
+// the rest is on the heap, freed with the vector.
+template<typename T, unsigned N = 4>
+class SmallVec : public ArenaObject {
+    static_assert(std::is_trivially_destructible<T>::value, "SmallVec never runs destructors");
+
+public:
+    SmallVec() : _data(_inline), _size(0), _capacity(N), _arena(nullptr) {}
+
+    explicit SmallVec(Arena *arena) : _data(_inline), _size(0), _capacity(N), _arena(arena) {}
+
+    ~SmallVec() {
+        if (_arena == nullptr && _data != _inline) free(_data);
+    }
+
+    SmallVec(const SmallVec &other) = delete;
+
+    SmallVec &operator=(const SmallVec &other) = delete;
+
+    void push_back(const T &value) {
+        if (_size == _capacity) Grow();
+        _data[_size++] = value;
+    }
+
+    void pop_back() {
+        assert(_size > 0);
+        --_size;
+    }
+
+    void clear() { _size = 0; }
+
+    size_t size() const { return _size; }
+
+    bool empty() const { return _size == 0; }
+
+    T &operator[](size_t i) { return _data[i]; }
+
+    const T &operator[](size_t i) const { return _data[i]; }
+
+    T &front() { return _data[0]; }
+
+    const T &front() const { return _data[0]; }
+
+    T &back() { return _data[_size - 1]; }
+
+    const T &back() const { return _data[_size - 1]; }
+
+    T *begin() { return _data; }
+
+    T *end() { return _data + _size; }
+
+    const T *begin() const { return _data; }
+
+    const T *end() const { return _data + _size; }
+
+private:
+    T *_data;
+    uint32_t _size;
+    uint32_t _capacity;
+    Arena *_arena;
+    T _inline[N];
+
+    void Grow() {
+        auto bytes = sizeof(T) * _capacity * 2;
+        auto data = (T *) (_arena ? _arena->Alloc(bytes, alignof(T)) : malloc(bytes));
+        if (data == nullptr) throw std::bad_alloc();
+        for (uint32_t i = 0; i < _size; ++i) new(data + i) T(_data[i]);
+        if (_arena == nullptr && _data != _inline) free(_data);
+        _data = data;
+        _capacity *= 2;
+    }
+};
+
+#endif //LEOML_SMALLVEC_H
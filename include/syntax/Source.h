@@ -0,0 +1,53 @@
+#ifndef LEOML_SOURCE_H
+#define LEOML_SOURCE_H
+
+#include <cstddef>
+#include <string>
+
+/// SourceBuffer
+// Read-only source text, terminated by a NUL sentinel.
+// At least kPadding zero bytes follow the text, so the Lexer may over-read.
+class SourceBuffer {
+public:
+    static const size_t kPadding = 64;
+
+    ~SourceBuffer();
+
+    SourceBuffer(const SourceBuffer &other) = delete;
+
+    SourceBuffer &operator=(const SourceBuffer &other) = delete;
+
+    /// Open
+    // Regular files are mmap-ed, pipes and stdin ("-") are streamed.
+    // Return nullptr if the file can not be read.
+    static SourceBuffer *Open(const std::string &path);
+
+    /// New
+    // Copy the text into a padded buffer.
+    static SourceBuffer *New(const char *text, size_t size);
+
+    static SourceBuffer *New(const std::string &text) { return New(text.data(), text.size()); }
+
+    const char *Begin() const { return _data; }
+
+    const char *End() const { return _data + _size; }
+
+    size_t Size() const { return _size; }
+
+    bool IsMapped() const { return _mapped; }
+
+private:
+    char *_data;
+    size_t _size;
+    size_t _capacity;  // mapped length when _mapped
+    bool _mapped;
+
+    SourceBuffer(char *data, size_t size, size_t capacity, bool mapped)
+            : _data(data), _size(size), _capacity(capacity), _mapped(mapped) {}
+
+    static SourceBuffer *Map(int fd, size_t size);
+
+    static SourceBuffer *Read(int fd, size_t hint);
+};
+
+#endif //LEOML_SOURCE_H
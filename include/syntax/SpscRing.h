@@ -0,0 +1,66 @@
+#ifndef LEOML_SPSCRING_H
+#define LEOML_SPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+
+/// SpscRing
+// Lock free ring of N slots, N a power of two, between one producer thread and
+// one consumer thread. The slots are filled and read in place: the producer
+// gets the free slot, fills it, then pushes it; the consumer gets the front
+// slot, reads it, then pops it. Each side keeps a copy of the index of the
+// other, and reloads it only when the ring looks full or empty.
+template<typename T, size_t N>
+class SpscRing {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+    SpscRing() = default;
+
+    SpscRing(const SpscRing &other) = delete;
+
+    SpscRing &operator=(const SpscRing &other) = delete;
+
+    /// Producer
+    // The free slot, or nullptr if the ring is full.
+    T *Back() {
+        auto tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _headCache == N) {
+            _headCache = _head.load(std::memory_order_acquire);
+            if (tail - _headCache == N) return nullptr;
+        }
+        return &_slots[tail & (N - 1)];
+    }
+
+    void Push() { _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    /// Consumer
+    // The front slot, or nullptr if the ring is empty.
+    T *Front() {
+        auto head = _head.load(std::memory_order_relaxed);
+        if (head == _tailCache) {
+            _tailCache = _tail.load(std::memory_order_acquire);
+            if (head == _tailCache) return nullptr;
+        }
+        return &_slots[head & (N - 1)];
+    }
+
+    void Pop() { _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+private:
+    // The indices of the two sides are a cache line apart, padded rather than
+    // aligned: new does not align past max_align_t in C++11.
+    static const size_t kLine = 64;
+    static const size_t kPad = kLine - sizeof(std::atomic<size_t>) - sizeof(size_t);
+
+    T _slots[N];
+    char _pad0[kLine];
+    std::atomic<size_t> _head{0};  // written by the consumer
+    size_t _tailCache{0};  // of the consumer
+    char _pad1[kPad];
+    std::atomic<size_t> _tail{0};  // written by the producer
+    size_t _headCache{0};  // of the producer
+    char _pad2[kPad];
+};
+
+#endif //LEOML_SPSCRING_H
@@ -0,0 +1,90 @@
+#ifndef LEOML_SYMBOL_H
+#define LEOML_SYMBOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+
+/// Symbol
+// Dense 32-bit id of an interned identifier. Every distinct name is stored
+// once, in the global SymbolTable, so that comparing and hashing names are
+// integer operations. Id 0 is the empty name, the high bit marks a tag.
+class Symbol {
+public:
+    static const uint32_t kTagBit = 1u << 31;
+
+    Symbol() : _id(0) {}
+
+    explicit Symbol(uint32_t id) : _id(id) {}
+
+    /// Intern
+    // Return the symbol of the name, adding it to the table on the first sight.
+    static Symbol Intern(const char *name, size_t size);
+
+    static Symbol Intern(const std::string &name) { return Intern(name.data(), name.size()); }
+
+    /// Shared
+    // While a guard lives, Intern takes a lock when the name misses a cache of
+    // the thread, so that threads may intern concurrently. Create it before
+    // the threads start, and drop it after they are joined. The names are read
+    // without the lock, their chunks never move.
+    class Shared {
+    public:
+        Shared();
+
+        ~Shared();
+
+        Shared(const Shared &other) = delete;
+
+        Shared &operator=(const Shared &other) = delete;
+    };
+
+    // Count of interned names.
+    static size_t Count();
+
+    uint32_t Id() const { return _id; }
+
+    bool Empty() const { return _id == 0; }
+
+    bool IsTag() const { return (_id & kTagBit) != 0; }
+
+    /// Tag
+    // The tag of a name lives in the same scope under a distinct key,
+    // formerly the name suffixed by "@:tag".
+    Symbol Tag() const { return Symbol(_id | kTagBit); }
+
+    Symbol Untag() const { return Symbol(_id & ~kTagBit); }
+
+    // The name, NUL terminated, without the tag mark.
+    const char *data() const;
+
+    size_t size() const;
+
+    std::string str() const { return {data(), size()}; }
+
+    bool operator==(const Symbol &rhs) const { return _id == rhs._id; }
+
+    bool operator!=(const Symbol &rhs) const { return _id != rhs._id; }
+
+    bool operator<(const Symbol &rhs) const { return _id < rhs._id; }
+
+    friend std::ostream &operator<<(std::ostream &os, const Symbol &symbol) {
+        os.write(symbol.data(), symbol.size());
+        if (symbol.IsTag()) os << "@:tag";
+        return os;
+    }
+
+private:
+    uint32_t _id;
+};
+
+namespace std {
+    template<>
+    struct hash<Symbol> {
+        size_t operator()(const Symbol &symbol) const { return symbol.Id(); }
+    };
+}
+
+#endif //LEOML_SYMBOL_H
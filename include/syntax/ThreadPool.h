@@ -0,0 +1,68 @@
+#ifndef LEOML_THREADPOOL_H
+#define LEOML_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// ThreadPool
+// Work stealing. Every worker has a deque of tasks, it takes the newest one
+// of its own and, when it runs dry, steals the oldest one of another worker,
+// so that uneven tasks, like files of any size, even out. The tasks must not
+// throw, and Wait must not be called from a task.
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &other) = delete;
+
+    ThreadPool &operator=(const ThreadPool &other) = delete;
+
+    // 0 for one worker per hardware thread.
+    static ThreadPool *New(unsigned threads = 0) { return new ThreadPool(threads); }
+
+    unsigned Size() const { return (unsigned) _queues.size(); }
+
+    /// Submit
+    // From a task, onto the deque of its worker; otherwise onto the deques in turn.
+    void Submit(Task task);
+
+    /// Wait
+    // Block until every task submitted so far is done.
+    void Wait();
+
+    // Stat: tasks taken from the deque of another worker
+    size_t Steals() const { return _steals; }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::thread> _workers;
+    std::vector<std::unique_ptr<Queue>> _queues;  // one per worker
+    std::mutex _lock;
+    std::condition_variable _ready;  // a task is queued, or stopping
+    std::condition_variable _idle;  // the last pending task is done
+    std::atomic<size_t> _queued{0};  // in the deques
+    std::atomic<size_t> _pending{0};  // submitted and not done
+    std::atomic<size_t> _steals{0};
+    std::atomic<unsigned> _next{0};  // round robin of the outer submits
+    bool _stop{false};
+
+    explicit ThreadPool(unsigned threads);
+
+    bool Take(unsigned self, Task &task);
+
+    void Work(unsigned self);
+};
+
+#endif //LEOML_THREADPOOL_H
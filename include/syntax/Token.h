@@ -16,6 +16,8 @@
 #include <fstream>
 #include <ostream>
 #include <vector>
+#include "Arena.h"
+#include "Symbol.h"
 
 class Parser;
 
@@ -25,7 +27,7 @@ class Token;
 
 class TokenSequence;
 
-using TokenList = std::list<const Token *>;
+class TokenList;
 
 struct SourceLocation {
     const std::string *filename;
@@ -43,10 +45,48 @@ struct SourceLocation {
     }
 };
 
+/// TokenStr
+// A view of the token text. The text lives in the source buffer,
+// or in the arena of the TokenSequence. Not NUL terminated.
+class TokenStr {
+public:
+    TokenStr() : _data(""), _size(0) {}
+
+    TokenStr(const char *data, size_t size) : _data(data), _size(size) {}
+
+    TokenStr(const char *cstr) : _data(cstr), _size(strlen(cstr)) {}
+
+    const char *data() const { return _data; }
+
+    size_t size() const { return _size; }
+
+    bool empty() const { return _size == 0; }
+
+    char operator[](size_t i) const { return _data[i]; }
+
+    std::string str() const { return {_data, _size}; }
+
+    bool operator==(const TokenStr &rhs) const {
+        return _size == rhs._size && memcmp(_data, rhs._data, _size) == 0;
+    }
+
+    bool operator!=(const TokenStr &rhs) const { return !(*this == rhs); }
+
+    friend std::ostream &operator<<(std::ostream &os, const TokenStr &str) {
+        return os.write(str._data, str._size);
+    }
+
+private:
+    const char *_data;
+    uint32_t _size;
+};
+
 /// Token
 class Token {
     friend class Lexer;
 
+    friend struct InfixTable;
+
 private:
     static const std::unordered_map<int, const char *> TagMap;
 
@@ -110,8 +150,9 @@ public:
     };
 
     int tag;
-    std::string str;
+    TokenStr str;
     SourceLocation loc;
+    Symbol sym;  // interned by the Lexer for identifiers
 
     explicit Token(int tag) : tag(tag) {};
 
@@ -119,16 +160,22 @@ public:
 
     static Token *New(const Token &other) { return new Token(other); };
 
-    static Token *New(int tag, const SourceLocation &loc, const std::string &str) { return new Token(tag, loc, str); };
+    static Token *New(int tag, const SourceLocation &loc, const TokenStr &str) { return new Token(tag, loc, str); };
+
+    // Bump allocated, no free.
+    static Token *New(Arena *arena, const Token &other) { return arena->New<Token>(other); };
 
     Token &operator=(const Token &other) {
         tag = other.tag;
         loc = other.loc;
         str = other.str;
+        sym = other.sym;
         return *this;
     }
 
-    virtual ~Token() = default;
+    /// Sym
+    // The interned name. Tokens not made by the Lexer are interned here.
+    Symbol Sym() const { return sym.Empty() ? Symbol::Intern(str.data(), str.size()) : sym; }
 
     // Aux: KwMap & TagMap & PrecMap
     static const char *TagLookup(int tag) {
@@ -147,6 +194,13 @@ public:
         return Token::INVALID != KwLookup(kw);
     }
 
+    /// KwClassify
+    // Keyword tag of the word, or Var. Switch on the length and the first char,
+    // then one memcmp, no allocation and no hashing. Agrees with KwLookup.
+    static int KwClassify(const char *word, size_t size);
+
+    static int KwClassify(const TokenStr &word) { return KwClassify(word.data(), word.size()); }
+
     static std::vector<const char *> KwList() {
         std::vector<const char *> ret{};
         for (auto item:KwMap) ret.push_back(item.first.c_str());
@@ -159,6 +213,20 @@ public:
         return ret->second;
     }
 
+    /// Infix
+    // Binding of a token after an operand: precedence, -1 for none, and associativity.
+    struct Infix {
+        int8_t prec;
+        bool rightAssoc;
+    };
+
+    static const int kTagCount = String + 1;
+
+    /// InfixLookup
+    // Dense array by tag, built from PrecMap, so it agrees with PrecLookup.
+    // All the operators are left associative for now.
+    static const Infix &InfixLookup(int tag);
+
     bool IsEOF() const { return tag == END; }
 
     bool IsConstant() const {
@@ -177,7 +245,9 @@ public:
 
 private:
 
-    Token(int tag, const SourceLocation &loc, const std::string &str)
+    friend class Arena;
+
+    Token(int tag, const SourceLocation &loc, const TokenStr &str)
             : tag(tag), loc(loc), str(str) {}
 
     Token(const Token &other) {
@@ -186,48 +256,137 @@ private:
 
 };
 
+/// TokenSource
+// Where a streamed TokenList pulls its tokens from: a Lexer, or the pipe of a
+// Lexer on another thread.
+class TokenSource {
+public:
+    virtual ~TokenSource() = default;
+
+    // The next significant token, END at the end.
+    virtual const Token *Pull() = 0;
+};
+
+/// TokenList
+// Flat array of the tokens, newlines included.
+// next[i] is the first significant (non newline) token index >= i,
+// prev[i] is the last significant token index < i, kNone if pending or none.
+//
+// A streamed list is filled on demand by its source, see Lexer::Stream, and
+// holds the newlines not. It is a window of the tokens from base on: the
+// arrays are indexed by i - base, the indices in them are absolute. The window
+// spans the lookahead of the parser, not a statement, see TokenSequence::Next.
+class TokenList {
+public:
+    static const uint32_t kNone = UINT32_MAX;
+
+    std::vector<const Token *> tokens;
+    std::vector<uint32_t> next{kNone};
+    std::vector<uint32_t> prev;
+    uint32_t last{kNone};  // last significant token index
+
+    TokenSource *source{nullptr};  // of a streamed list, until it ends
+    bool streamed{false};
+    uint32_t base{0};  // index of tokens[0]
+    Token eof{Token::END};  // of a streamed list, where the lexer ended
+    size_t peak{0};  // Stat: most tokens held by the window
+
+    void PushBack(const Token *tok) {
+        auto i = size();
+        tokens.push_back(tok);
+        prev.push_back(last);
+        next.push_back(kNone);
+        if (tok->tag != Token::NEW_LINE) {
+            for (auto j = _pending; j <= i; ++j) next[j - base] = i;
+            _pending = i + 1;
+            last = i;
+        }
+    }
+
+    // One past the last index.
+    uint32_t size() const { return base + (uint32_t) tokens.size(); }
+
+    const Token *At(uint32_t i) const { return tokens[i - base]; }
+
+    /// Next
+    // The first significant token index >= i, kNone if none, pulled from the
+    // source if need be.
+    uint32_t Next(uint32_t i) {
+        if (i >= size() && source) Fill(i);
+        return i - base < next.size() ? next[i - base] : kNone;
+    }
+
+    /// Prior
+    // The last significant token index < i.
+    uint32_t Prior(uint32_t i) const { return i - base < prev.size() ? prev[i - base] : last; }
+
+    /// Release
+    // The tokens before i are read no more, but the one put back from i.
+    // Drop them from the window of a streamed list.
+    void Release(uint32_t i);
+
+private:
+    uint32_t _pending{0};  // first index whose next[] is unknown yet
+
+    // Pull the tokens up to i from the source, or until it ends.
+    void Fill(uint32_t i);
+};
+
 /// TokenSequence (TokenStream)
 /// An abstraction of all tokens to be parse.
+// A view [_begin, _end) of a TokenList. The cursor is an index of the array,
+// always on a significant token or on _end.
 class TokenSequence {
+    friend class Lexer;
+
+    friend class TokenCache;
 
 public:
-    TokenSequence() : tokenList(new TokenList()),
-                      _begin(tokenList->begin()), _end(tokenList->end()) {}
+    using Position = uint32_t;
+
+    TokenSequence() : tokenList(new TokenList()), arena(new Arena()), _begin(0), _end(0), _owner(true) {}
 
-    explicit TokenSequence(Token *token) {
-        TokenSequence();
+    // Tokens allocated in blocks of the size, for short sequences.
+    explicit TokenSequence(size_t blockSize)
+            : tokenList(new TokenList()), arena(new Arena(blockSize)), _begin(0), _end(0), _owner(true) {}
+
+    explicit TokenSequence(Token *token) : TokenSequence() {
         InsertBack(token);
     }
 
-    explicit TokenSequence(TokenList *tokenList)
-            : tokenList(tokenList),
-              _begin(tokenList->begin()),
-              _end(tokenList->end()) {}
+    TokenSequence(TokenList *tokenList, Position begin, Position end)
+            : tokenList(tokenList), arena(nullptr), _begin(begin), _end(end) {
+        _begin = Normalize(begin);
+    }
 
-    TokenSequence(TokenList *tokenList,
-                  TokenList::iterator begin,
-                  TokenList::iterator end)
-            : tokenList(tokenList), _begin(begin), _end(end) {}
+    // Copies and lines are views, only the sequence that made the list frees it.
+    ~TokenSequence() {
+        if (_owner) {
+            delete tokenList;
+            delete arena;
+        }
+    }
 
-    ~TokenSequence() { delete tokenList; }
+    TokenSequence(const TokenSequence &other) : _owner(false) { *this = other; }
 
-    TokenSequence(const TokenSequence &other) { *this = other; }
+    // A streamed sequence is open ended until its source ends, see Lexer::Stream.
+    static const Position kOpen = TokenList::kNone - 1;
 
     const TokenSequence &operator=(const TokenSequence &other) {
+        if (this == &other) return *this;
+        if (_owner) {
+            delete tokenList;
+            delete arena;
+            _owner = false;
+        }
         tokenList = other.tokenList;
+        arena = other.arena;
         _begin = other._begin;
         _end = other._end;
+        exceed_end = other.exceed_end;
         return *this;
     }
 
-    void Copy(const TokenSequence &other) {
-        tokenList = new TokenList(other._begin, other._end);
-        _begin = tokenList->begin();
-        _end = tokenList->end();
-        for (auto iter = _begin; iter != _end; ++iter)
-            *iter = Token::New(**iter);
-    }
-
     /// Expect
     // Expect the Peek token. Expect its token kind.
     const Token *Expect(int expect);
@@ -258,9 +417,9 @@ public:
     // Get the Peek token. Then go next.
     const Token *Next() {
         auto ret = Peek();
-        if (!ret->IsEOF()) {
-            ++_begin;
-            Peek(); // May skip newline token
+        if (_begin < _end) {
+            _begin = Normalize(_begin + 1);
+            if (tokenList->streamed) Release();
         } else {
             ++exceed_end;
         }
@@ -270,13 +429,12 @@ public:
     /// PutBack
     // Put back the prior Peek token.
     void PutBack() {
-        assert(_begin != tokenList->begin());
         if (exceed_end > 0) {
             --exceed_end;
         } else {
-            --_begin;
-            if ((*_begin)->tag == Token::NEW_LINE)
-                PutBack();
+            auto prior = tokenList->Prior(_begin);
+            assert(prior != TokenList::kNone);
+            _begin = prior;
         }
     }
 
@@ -292,89 +450,95 @@ public:
 
     /// Peek
     // Get the current Peek token.
-    const Token *Peek() const;
+    const Token *Peek() const {
+        if (_begin < _end) return tokenList->At(_begin);
+        return Eof();
+    }
 
     /// PeekNext
-    // Get the next Peek token. First Next then PutBack.
-    const Token *PeekNext() {
-        if (Empty())
-            return Peek(); // Return the Token::END
-        Next();
-        auto ret = Peek();
-        PutBack();
-        return ret;
+    // Get the next Peek token, without moving.
+    const Token *PeekNext() const {
+        if (_begin >= _end)
+            return Eof(); // Return the Token::END
+        auto next = tokenList->Next(_begin + 1);
+        return next < _end ? tokenList->At(next) : Eof();
     }
 
-    const Token *Back() const {
-        auto back = _end;
-        return *--back;
-    }
+    const Token *Back() const { return tokenList->At(_end - 1); }
 
-    void PopBack() {
-        assert(!Empty());
-        assert(_end == tokenList->end());
-        auto size_eq1 = tokenList->back() == *_begin;
-        tokenList->pop_back();
-        _end = tokenList->end();
-        if (size_eq1)
+    Position Mark() const { return exceed_end ? _end + exceed_end : _begin; }
+
+    void ResetTo(Position mark) {
+        if (mark > _end) {
             _begin = _end;
+            exceed_end = mark - _end;
+        } else {
+            _begin = mark;
+            exceed_end = 0;
+        }
     }
 
-    TokenList::iterator Mark() { return _begin; }
-
-    void ResetTo(TokenList::iterator mark) { _begin = mark; }
+    bool Empty() const { return _begin >= _end; }
 
-    bool Empty() const { return Peek()->IsEOF(); }
+    /// Release
+    // The parser goes back before the cursor no more, but to put back one token:
+    // a streamed sequence frees the tokens behind on each Next. The marks before
+    // are void, so do not ResetTo on a streamed sequence.
+    void Release() {
+        if (tokenList->streamed && exceed_end == 0) tokenList->Release(_begin);
+    }
 
+    // Insert at the back of the TokenList, this view must reach the back.
     void InsertBack(TokenSequence &ts) {
-        auto pos = tokenList->insert(_end, ts._begin, ts._end);
-        if (_begin == _end) {
-            _begin = pos;
-        }
+        for (auto i = ts._begin; i < ts._end; ++i)
+            InsertBack(ts.tokenList->At(i));
     }
 
     void InsertBack(const Token *tok) {
-        auto pos = tokenList->insert(_end, tok);
-        if (_begin == _end) {
-            _begin = pos;
-        }
-    }
-
-    // If there is preceding newline
-    void InsertFront(TokenSequence &ts) {
-        auto pos = GetInsertFrontPos();
-        _begin = tokenList->insert(pos, ts._begin, ts._end);
-    }
-
-    void InsertFront(const Token *tok) {
-        auto pos = GetInsertFrontPos();
-        _begin = tokenList->insert(pos, tok);
+        assert(_end == tokenList->size() && !tokenList->streamed);
+        auto empty = Empty();
+        tokenList->PushBack(tok);
+        _end = tokenList->size();
+        if (empty) _begin = Normalize(_begin);
     }
 
     bool IsBeginOfLine() const;
 
     TokenSequence GetLine();
 
-    void SetParser(Parser *parser) { _parser = parser; }
+    /// Split
+    // Cut the sequence after the tokens of the tag, into about n views
+    // of about the same count of tokens.
+    std::vector<TokenSequence> Split(int tag, unsigned n) const;
+
+    // The list this sequence is a view of, newlines included.
+    TokenList *GetList() const { return tokenList; }
+
+    // Tokens of this sequence are allocated here.
+    Arena *GetArena() {
+        if (arena == nullptr) arena = new Arena();
+        return arena;
+    }
 
     void Serialize(std::ostream &os);
 
 private:
-    TokenList::iterator GetInsertFrontPos() {
-        auto pos = _begin;
-        if (pos == tokenList->begin())
-            return pos;
-        --pos;
-        while (pos != tokenList->begin() && (*pos)->tag == Token::NEW_LINE)
-            --pos;
-        return ++pos;
+    Position Normalize(Position pos) {
+        auto next = tokenList->Next(pos);
+        if (next == TokenList::kNone && _end == kOpen && !tokenList->source) _end = tokenList->size();  // ended
+        return next < _end ? next : _end;
     }
 
+    const Token *Eof() const;
+
     TokenList *tokenList;
-    mutable TokenList::iterator _begin;
-    TokenList::iterator _end;
-    Parser *_parser{nullptr};
+    Arena *arena;
+    Position _begin;
+    Position _end;
+    mutable Token _eof{Token::END};
+
     int exceed_end{0};
+    bool _owner{false};
 };
 
 #endif //LEOML_TOKEN_H
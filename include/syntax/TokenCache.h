@@ -0,0 +1,76 @@
+#ifndef LEOML_TOKENCACHE_H
+#define LEOML_TOKENCACHE_H
+
+#include "Source.h"
+#include "Token.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/// TokenCache
+// The tokens of a source, lexed once and kept on the disk, so that they are
+// read back into a TokenSequence without lexing. A .tsb file holds a header,
+// the source text, the table of the distinct token texts, and the tokens as
+// varints: the tag, the index of the text in the table, and the offset, the
+// line and the column in the source. The text is kept for the lines quoted by
+// the errors, and the tokens point in the file, which is mmap-ed if large.
+// The tags and the texts are checked as they are read, a file that the Lexer
+// would not have written does not read.
+class TokenCache {
+public:
+    static const uint32_t kMagic = 0x43544d4c;  // "LMTC"
+    static const uint32_t kFormat = 2;  // of the file, bumped with its layout
+
+    /// Version
+    // kFormat and the values of the tags the Lexer makes, so that the files
+    // written before the Token enum was renumbered are not read.
+    static uint32_t Version();
+    static const size_t kHeaderSize = 24;
+
+    /// Write
+    // Write the tokens of the sequence, lexed from the text by Tokenize.
+    static void Write(std::ostream &os, const char *text, size_t size, const TokenSequence &ts);
+
+    /// Open
+    // Return nullptr if the file can not be read, or is not a token cache of this version.
+    static TokenCache *Open(const std::string &path);
+
+    // Take the buffer, nullptr if it is not a token cache.
+    static TokenCache *New(SourceBuffer *file);
+
+    ~TokenCache() { delete _file; }
+
+    TokenCache(const TokenCache &other) = delete;
+
+    TokenCache &operator=(const TokenCache &other) = delete;
+
+    /// Read
+    // Fill the empty sequence with the tokens, as Lexer::Tokenize does. Return
+    // false if the tokens are corrupt, the Text may be lexed instead then. The
+    // cache must outlive the sequence.
+    bool Read(TokenSequence &ts, const std::string *filename);
+
+    // The source text, NUL terminated.
+    const char *Text() const { return _text; }
+
+    size_t TextSize() const { return _textSize; }
+
+    uint32_t Tokens() const { return _tokens; }
+
+private:
+    SourceBuffer *_file;
+    const char *_text{nullptr};
+    size_t _textSize{0};
+    uint32_t _tokens{0};
+    std::vector<TokenStr> _strs;  // the table, views of the file
+    std::vector<Symbol> _syms;  // of the names in the table, interned on the first read
+    std::vector<int> _tags;  // of the texts in the table, checked on the first read
+    const char *_code{nullptr};  // the tokens, null if the table does not read
+
+    explicit TokenCache(SourceBuffer *file) : _file(file) {}
+
+    bool Load();
+};
+
+#endif //LEOML_TOKENCACHE_H
@@ -0,0 +1,59 @@
+#ifndef LEOML_TREECACHE_H
+#define LEOML_TREECACHE_H
+
+#include "FlatTree.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// TreeCache
+// A directory of the trees the Parser lowered, parsed, resolved and typed,
+// under the hash of their source text, of the format of the files and of the
+// build of the compiler, so that an unchanged source is not compiled again. A
+// file holds a header with the key and the sum of the image, the source text,
+// then the image of FlatTree::Write; a large one is mmap-ed. The trees of a
+// variant of the passes, as those not checked, are kept apart.
+//
+// Files are written aside and renamed in place, so that the compilers sharing
+// the directory never read a partial one. A file that does not match the key,
+// the text and the sum, or does not read, is a miss.
+class TreeCache {
+public:
+    static const uint32_t kMagic = 0x52544d4c;  // "LMTR"
+    static const uint32_t kFormat = 4;  // of the files, bumped with the image of FlatTree
+    static const size_t kHeaderSize = 32;
+    static const char *const kVersion;  // of the compiler, and the hash of the sources of its passes
+
+    // The directory is made on the first store. The variant, "" for the default passes, goes in the key.
+    static TreeCache *New(const std::string &dir, const std::string &variant = "") {
+        return new TreeCache(dir, variant);
+    }
+
+    TreeCache(const TreeCache &other) = delete;
+
+    TreeCache &operator=(const TreeCache &other) = delete;
+
+    /// Key
+    // 64-bit FNV-1a of the format, the tags of the tokens the image holds, the
+    // version and the build of the compiler, the variant and the text. The text is compared on a hit, the key only names
+    // the file.
+    uint64_t Key(const char *text, size_t size) const;
+
+    /// Load
+    // The tree of the text, nullptr on a miss.
+    FlatTree *Load(const char *text, size_t size) const;
+
+    /// Store
+    // Keep the tree of the text. Errors are ignored, the next run misses.
+    void Store(const char *text, size_t size, const FlatTree &tree) const;
+
+private:
+    std::string _dir;
+    std::string _variant;
+
+    TreeCache(const std::string &dir, const std::string &variant) : _dir(dir), _variant(variant) {}
+
+    std::string Path(uint64_t key) const;
+};
+
+#endif //LEOML_TREECACHE_H
@@ -7,21 +7,24 @@
 #define LEOML_TYPE_H
 
 #include "Scope.h"
+#include "SmallVec.h"
 #include <iostream>
 #include <typeinfo>
 #include <unordered_map>
-#include <list>
 
 /// Type
-// simple type
+// A type, interned: every distinct type, primitive, function or pair, is one
+// canonical object in a global table, named by a dense 32-bit id. The nodes
+// hold the ids, and two types are equal if their ids are. The primitive types
+// have fixed ids. The objects never move nor change, so they are read without
+// the lock while another thread interns.
 class Type {
 private:
     static const std::unordered_map<int, const char *> KindMap;
 
-protected:
-    Type(int k) : kind(k) {};
-
 public:
+    using Id = uint32_t;
+
     // RTTI
     enum {
         T_Int = 1,
@@ -29,72 +32,72 @@ public:
         T_Bool,
         T_Unit,
         T_Func,
+        T_Pair,
+        T_String,
+        T_Var,  // of a type scheme, see Inference
         T_Unknown = -1,
     };
 
-    int kind;
+    // The ids of the primitive types.
+    static const Id Unknown = 0;
+    static const Id Int = 1;
+    static const Id Float = 2;
+    static const Id Bool = 3;
+    static const Id Unit = 4;
+    static const Id String = 5;
 
-    static std::string KindLookup(int k);
-
-    std::string GetName() { return KindLookup(kind); }
-
-    /// Expect
-    // expect specific type at this token
-    bool Expect(int expect, const Token *token);
-
-    /// Expect or Infer
-    // If type at this token is T_Unknown, then set it to expect, else Expect it.
-    void ExpectOrInfer(int expect, const Token *token) {
-        if (kind == T_Unknown) {
-            kind = expect;
-        } else {
-            Expect(expect, token);
-        }
-    }
-
-    /// opposite to Expect
-    static void UnExpect(int unexpect, const Token *token);
+    int kind;
+    Id id;
+    uint32_t nargs;
+    const Id *args;  // the params and the return type of a function, the elements of a pair,
+                     // the number of a variable
 
-    bool IsUnknown() const { return kind == T_Unknown; }
+    /// Function
+    // The id of the function type from the params to the return type.
+    static Id Function(const Id *params, size_t count, Id ret);
 
-    static Type *New(int k) { return new Type(k); }
+    static Id Pair(Id first, Id second);
 
-    void operator=(const Type &rhs);
+    // The n-th variable of a scheme, 'a for 0.
+    static Id Variable(uint32_t n);
 
-    bool operator==(const Type &rhs) const;
+    static const Type &Get(Id id);
 
-    bool operator!=(const Type &rhs) const;
-};
+    static int KindOf(Id id) { return Get(id).kind; }
 
-using TypeList = std::list<Type *>;
+    size_t Params() const { return kind == T_Func ? nargs - 1 : 0; }
 
-/// TFunc
-// func type IS-A compound type.
-class TFunc {
+    Id Ret() const { return kind == T_Func ? args[nargs - 1] : Unknown; }
 
-public:
-    Type *retType;
-    TypeList *paramTypeList;
+    static std::string KindLookup(int k);
 
-    TFunc() : retType(Type::New(Type::T_Unknown)), paramTypeList(new TypeList) {};
+    // KindLookup, no copy.
+    static const char *KindName(int k);
 
-    bool operator==(const TFunc &rhs) const;
+    /// Name
+    // The kind of a primitive type, "int * int -> int" for a function, "int * int" for a pair,
+    // "'a" for a variable.
+    static std::string Name(Id id);
 
-    bool operator!=(const TFunc &rhs) const;
+    /// Expect
+    // expect specific type at this token
+    static bool Expect(Id type, Id expect, const Token *token);
 
-    std::string GetName() {
-        std::string ret = "";
-        if (paramTypeList->empty()) { return ret; }
-        ret += paramTypeList->front()->GetName();
-        paramTypeList->pop_front();
-        while (!paramTypeList->empty()) {
-            ret += " * " + paramTypeList->front()->GetName();
-            paramTypeList->pop_front();
+    /// Expect or Infer
+    // If the type at this token is Unknown, then set it to expect, else Expect it.
+    static void ExpectOrInfer(Id &type, Id expect, const Token *token) {
+        if (type == Unknown) {
+            type = expect;
+        } else {
+            Expect(type, expect, token);
         }
-        ret += " -> " + retType->GetName();
-        return ret;
     }
 
+    /// opposite to Expect
+    static void UnExpect(Id unexpect, const Token *token);
+
+    // Count of interned types.
+    static size_t Count();
 };
 
 #endif //LEOML_TYPE_H
@@ -0,0 +1,462 @@
+#include "bench/Bench.h"
+#include "syntax/Document.h"
+#include "syntax/Inference.h"
+#include "syntax/Lexer.h"
+#include "syntax/Parser.h"
+#include "syntax/Source.h"
+#include "syntax/ThreadPool.h"
+#include "syntax/TokenCache.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+static const int kRounds = 5;
+
+/// Measure
+// Best wall time of kRounds runs, in seconds.
+template<typename F>
+static double Measure(F f) {
+    double best = 1e30;
+    for (int i = 0; i < kRounds; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+        if (d.count() < best) best = d.count();
+    }
+    return best;
+}
+
+static void Report(const char *what, size_t bytes, double secs) {
+    printf("  %-28s %10.3f ms %10.2f MB/s\n", what, secs * 1e3, bytes / secs / 1e6);
+}
+
+/// Count lines, so that every byte of the loaded text is read once.
+static size_t CountLines(const char *p, const char *end) {
+    size_t n = 0;
+    while ((p = (const char *) memchr(p, '\n', end - p)) != nullptr) {
+        ++n;
+        ++p;
+    }
+    return n;
+}
+
+/// The former LoadFile of the driver, kept as the baseline.
+static std::string *LoadFileFgetc(const std::string &filepath) {
+    FILE *f = fopen(filepath.c_str(), "r");
+    auto text = new std::string;
+    int c;
+    while (EOF != (c = fgetc(f)))
+        text->push_back(c);
+    fclose(f);
+    return text;
+}
+
+void BenchLoad(const std::string &source) {
+    size_t bytes = 0, lines = 0, bufferLines = 0;
+    auto fgetcTime = Measure([&] {
+        auto text = LoadFileFgetc(source);
+        bytes = text->size();
+        lines = CountLines(text->data(), text->data() + text->size());
+        delete text;
+    });
+    auto bufferTime = Measure([&] {
+        auto buffer = SourceBuffer::Open(source);
+        bufferLines = CountLines(buffer->Begin(), buffer->End());
+        delete buffer;
+    });
+    if (bufferLines != lines) fprintf(stderr, "SourceBuffer disagrees with fgetc on the lines\n");
+    printf("load %s (%zu bytes, %zu lines)\n", source.c_str(), bytes, lines);
+    Report("fgetc", bytes, fgetcTime);
+    Report("SourceBuffer", bytes, bufferTime);
+}
+
+void BenchLex(const std::string &source) {
+    auto buffer = SourceBuffer::Open(source);
+    std::string name = source;
+    size_t ntoken = 0, allocated = 0, reserved = 0, blocks = 0;
+    auto lex = [&] {
+        TokenSequence ts;
+        auto lexer = Lexer::New(buffer, &name);
+        lexer->Tokenize(ts);
+        ntoken = 0;
+        while (!ts.Empty()) {
+            ts.Next();
+            ++ntoken;
+        }
+        allocated = ts.GetArena()->Allocated();
+        reserved = ts.GetArena()->Reserved();
+        blocks = ts.GetArena()->Blocks();
+        delete lexer;
+    };
+    printf("lex %s\n", source.c_str());
+    const ScanKernel *kernels[] = {ScanKernel::Scalar(), ScanKernel::Sse2(), ScanKernel::Avx2()};
+    for (auto kernel:kernels) {
+        if (kernel == nullptr) continue;
+        ScanKernel::Use(kernel);
+        auto what = std::string("Tokenize, ") + kernel->name + " scan";
+        Report(what.c_str(), buffer->Size(), Measure(lex));
+    }
+    ScanKernel::Use(nullptr);
+    printf("  %-28s %10zu\n", "tokens", ntoken);
+    printf("  %-28s %10zu\n", "interned symbols", Symbol::Count());
+    printf("  %-28s %10zu blocks %10zu bytes used %10zu bytes reserved\n", "token arena",
+           blocks, allocated, reserved);
+    printf("  %-28s %10zu mallocs\n", "one Token::New per token", ntoken);
+    delete buffer;
+}
+
+void BenchKeyword(const std::string &source) {
+    auto buffer = SourceBuffer::Open(source);
+    std::string name = source;
+    TokenSequence ts;
+    auto lexer = Lexer::New(buffer, &name);
+    lexer->Tokenize(ts);
+    std::vector<TokenStr> words;
+    while (!ts.Empty()) {
+        auto token = ts.Next();
+        if (token->tag == Token::Var || Token::KwIs(token->str.str())) words.push_back(token->str);
+    }
+    for (auto &word:words) {
+        int tag = Token::KwIs(word.str()) ? Token::KwLookup(word.str()) : Token::Var;
+        if (tag != Token::KwClassify(word)) {
+            fprintf(stderr, "KwClassify disagrees with KwMap on \"%s\"\n", word.str().c_str());
+            break;
+        }
+    }
+    size_t bytes = 0;
+    for (auto &word:words) bytes += word.size();
+    volatile int sink = 0;
+    auto mapTime = Measure([&] {
+        for (auto &word:words) {
+            // the former Lexer::SkipIdent
+            if (Token::KwIs(word.str())) sink = Token::KwLookup(word.str());
+        }
+    });
+    auto switchTime = Measure([&] {
+        for (auto &word:words) sink = Token::KwClassify(word);
+    });
+    printf("keyword %s (%zu words)\n", source.c_str(), words.size());
+    Report("KwIs + KwLookup", bytes, mapTime);
+    Report("KwClassify", bytes, switchTime);
+    delete lexer;
+    delete buffer;
+}
+
+void BenchParse(const std::string &source) {
+    auto buffer = SourceBuffer::Open(source);
+    std::string name = source;
+    TokenSequence ts;
+    auto lexer = Lexer::New(buffer, &name);
+    lexer->Tokenize(ts);
+    size_t allocated = 0, reserved = 0, blocks = 0;
+    ParserStats stats;
+    auto parseTime = Measure([&] {
+        auto parser = Parser::New(ts);
+        parser->Parse();
+        allocated = parser->GetArena()->Allocated();
+        reserved = parser->GetArena()->Reserved();
+        blocks = parser->GetArena()->Blocks();
+        stats = parser->GetStats();
+        delete parser;
+    });
+    auto syntaxTime = Measure([&] {
+        auto parser = Parser::New(ts, true);
+        parser->Parse();
+        delete parser;
+    });
+    printf("parse %s\n", source.c_str());
+    Report("Parse", buffer->Size(), parseTime);
+    Report("Parse, syntax only", buffer->Size(), syntaxTime);
+    printf("  %-28s %10zu blocks %10zu bytes used %10zu bytes reserved\n", "AST arena",
+           blocks, allocated, reserved);
+    stats.Print(stdout);
+    auto parser = Parser::New(ts);
+    parser->Parse();
+    auto tree = parser->GetTree();
+    std::ostringstream fromProgram, fromTree;
+    auto programTime = Measure([&] {
+        fromProgram.str("");
+        parser->GetProgram()->Serialize(fromProgram);
+    });
+    auto treeTime = Measure([&] {
+        fromTree.str("");
+        tree->Serialize(fromTree);
+    });
+    Report("Serialize, Program", buffer->Size(), programTime);
+    Report("Serialize, FlatTree", buffer->Size(), treeTime);
+    printf("  %-28s %10zu nodes %10zu bytes %10s\n", "FlatTree", tree->Size(), tree->Bytes(),
+           fromProgram.str() == fromTree.str() ? "same text" : "TEXT DIFFERS");
+    auto pool = ThreadPool::New();
+    auto poolTime = Measure([&] {
+        auto chunked = Parser::New(ts);
+        chunked->Parse(pool);
+        delete chunked;
+    });
+    auto what = "Parse, " + std::to_string(pool->Size()) + " threads";
+    Report(what.c_str(), buffer->Size(), poolTime);
+    auto chunked = Parser::New(ts);
+    chunked->Parse(pool);
+    std::ostringstream fromPool;
+    chunked->GetTree()->Serialize(fromPool);
+    printf("  %-28s %10s\n", "Parse on the pool", fromPool.str() == fromTree.str() ? "same text" : "TEXT DIFFERS");
+    delete chunked;
+    delete pool;
+    delete parser;
+    delete lexer;
+    delete buffer;
+}
+
+void BenchStream(const std::string &source) {
+    auto buffer = SourceBuffer::Open(source);
+    std::string name = source;
+    size_t tokenBytes = 0, listBytes = 0;
+    std::string fromTokenized, fromStreamed;
+    auto tokenizedTime = Measure([&] {
+        TokenSequence ts;
+        auto lexer = Lexer::New(buffer, &name);
+        lexer->Tokenize(ts);
+        auto parser = Parser::New(ts);
+        parser->Parse();
+        auto list = ts.GetList();
+        tokenBytes = ts.GetArena()->Reserved();
+        listBytes = list->tokens.capacity() * sizeof(Token *) + (list->next.capacity() + list->prev.capacity()) * 4;
+        std::ostringstream os;
+        parser->Serialize(os);
+        fromTokenized = os.str();
+        delete parser;
+        delete lexer;
+    });
+    printf("stream %s\n", source.c_str());
+    Report("Tokenize, then Parse", buffer->Size(), tokenizedTime);
+    printf("  %-28s %10zu bytes tokens %10zu bytes list\n", "", tokenBytes, listBytes);
+    size_t peak = 0;
+    auto streamedTime = Measure([&] {
+        TokenSequence ts;
+        auto lexer = Lexer::New(buffer, &name);
+        lexer->Stream(ts);
+        auto parser = Parser::New(ts);
+        parser->Parse();
+        auto list = ts.GetList();
+        tokenBytes = ts.GetArena()->Reserved();
+        listBytes = list->tokens.capacity() * sizeof(Token *) + (list->next.capacity() + list->prev.capacity()) * 4;
+        peak = list->peak;
+        std::ostringstream os;
+        parser->Serialize(os);
+        fromStreamed = os.str();
+        delete parser;
+        delete lexer;
+    });
+    Report("Stream, Parse", buffer->Size(), streamedTime);
+    printf("  %-28s %10zu bytes tokens %10zu bytes list %6zu tokens at most %s\n", "", tokenBytes, listBytes,
+           peak, fromStreamed == fromTokenized ? "same text" : "TEXT DIFFERS");
+    std::string fromPiped;
+    auto pipedTime = Measure([&] {
+        TokenSequence ts;
+        auto lexer = Lexer::New(buffer, &name);
+        lexer->Pipe(ts);
+        auto parser = Parser::New(ts);
+        parser->Parse();
+        std::ostringstream os;
+        parser->Serialize(os);
+        fromPiped = os.str();
+        delete parser;
+        delete lexer;
+    });
+    Report("Pipe, Parse", buffer->Size(), pipedTime);
+    printf("  %-28s %10u hardware threads %s\n", "", std::thread::hardware_concurrency(),
+           fromPiped == fromTokenized ? "same text" : "TEXT DIFFERS");
+    delete buffer;
+}
+
+void BenchCache(const std::string &source) {
+    auto buffer = SourceBuffer::Open(source);
+    std::string name = source;
+    auto lexTime = Measure([&] {
+        TokenSequence ts;
+        auto lexer = Lexer::New(buffer, &name);
+        lexer->Tokenize(ts);
+        delete lexer;
+    });
+    TokenSequence lexed;
+    auto lexer = Lexer::New(buffer, &name);
+    lexer->Tokenize(lexed);
+    std::ostringstream image, fromLexer, fromCache;
+    TokenCache::Write(image, buffer->Begin(), buffer->Size(), lexed);
+    lexed.Serialize(fromLexer);
+    auto cache = TokenCache::New(SourceBuffer::New(image.str()));  // as the mapping of the file
+    auto readTime = Measure([&] {
+        TokenSequence ts;
+        cache->Read(ts, &name);
+    });
+    TokenSequence read;
+    cache->Read(read, &name);
+    read.Serialize(fromCache);
+    printf("cache %s\n", source.c_str());
+    Report("Tokenize", buffer->Size(), lexTime);
+    Report("Read the .tsb", buffer->Size(), readTime);
+    printf("  %-28s %10zu bytes %10zu bytes of table and tokens %s\n", "image", image.str().size(),
+           image.str().size() - buffer->Size() - TokenCache::kHeaderSize - 1,
+           fromCache.str() == fromLexer.str() ? "same tokens" : "TOKENS DIFFER");
+    auto parseTime = Measure([&] {
+        TokenSequence ts;
+        cache->Read(ts, &name);
+        auto parser = Parser::New(ts);
+        parser->Parse();
+        delete parser;
+    });
+    TokenSequence parsed;
+    cache->Read(parsed, &name);
+    auto parser = Parser::New(parsed);
+    parser->Parse();
+    std::ostringstream tree, fromParser, fromImage;
+    parser->GetTree()->Write(tree);
+    parser->Serialize(fromParser);
+    auto treeImage = tree.str();
+    FlatTree *loaded = nullptr;
+    auto loadTime = Measure([&] {
+        delete loaded;
+        loaded = FlatTree::Read(treeImage.data(), treeImage.size());
+    });
+    loaded->Serialize(fromImage);
+    Report("Read the .tsb, Parse", buffer->Size(), parseTime);
+    Report("Read the tree image", buffer->Size(), loadTime);
+    printf("  %-28s %10zu bytes %10zu nodes %s\n", "tree image", treeImage.size(), loaded->Size(),
+           fromImage.str() == fromParser.str() ? "same tree" : "TREE DIFFERS");
+    delete loaded;
+    delete parser;
+    delete cache;
+    delete lexer;
+    delete buffer;
+}
+
+void BenchInfer(const std::string &source) {
+    auto buffer = SourceBuffer::Open(source);
+    std::string name = source;
+    TokenSequence ts;
+    auto lexer = Lexer::New(buffer, &name);
+    lexer->Tokenize(ts);
+    auto parser = Parser::New(ts);
+    parser->Parse();
+    auto tree = parser->GetTree();
+    size_t terms = 0;
+    auto inferTime = Measure([&] {
+        Inference inference(*tree);
+        inference.Run();
+        terms = inference.Terms();
+    });
+    std::ostringstream types;
+    auto printTime = Measure([&] {
+        types.str("");
+        Inference inference(*tree);
+        inference.Run();
+        inference.Serialize(types);
+    });
+    printf("infer %s\n", source.c_str());
+    Report("Infer", buffer->Size(), inferTime);
+    Report("Infer, print the globals", buffer->Size(), printTime);
+    printf("  %-28s %10zu nodes %10zu terms\n", "Inference", tree->Size(), terms);
+    delete parser;
+    delete lexer;
+    delete buffer;
+}
+
+static std::string FullParse(const std::string &text, const std::string *name) {
+    auto buffer = SourceBuffer::New(text);
+    TokenSequence ts;
+    auto lexer = Lexer::New(buffer, name);
+    lexer->Tokenize(ts);
+    auto parser = Parser::New(ts);
+    parser->Parse();
+    std::ostringstream os;
+    parser->Serialize(os);
+    delete parser;
+    delete lexer;
+    delete buffer;
+    return os.str();
+}
+
+void BenchEdit(const std::string &source) {
+    auto buffer = SourceBuffer::Open(source);
+    std::string name = source;
+    std::string text(buffer->Begin(), buffer->Size());
+    delete buffer;
+    auto fullTime = Measure([&] { FullParse(text, &name); });
+    Document *doc = nullptr;
+    auto buildTime = Measure([&] {
+        delete doc;
+        doc = Document::New(text, name);
+    });
+    printf("edit %s (%zu pieces)\n", source.c_str(), doc->Pieces());
+    Report("Lex + Parse", text.size(), fullTime);
+    Report("Document::New", text.size(), buildTime);
+
+    // The offsets of the ints, spread over the text.
+    std::vector<size_t> ints;
+    {
+        auto copy = SourceBuffer::New(text);
+        TokenSequence ts;
+        auto lexer = Lexer::New(copy, &name);
+        lexer->Tokenize(ts);
+        std::vector<size_t> all;
+        for (auto token:ts.GetList()->tokens) {
+            if (token->tag == Token::Int) all.push_back(token->str.data() - copy->Begin());
+        }
+        for (size_t i = 0; i < all.size() && ints.size() < 100; i += all.size() / 100 + 1) ints.push_back(all[i]);
+        delete lexer;
+        delete copy;
+    }
+    if (ints.empty()) {
+        delete doc;
+        return;
+    }
+
+    // Flip a digit, insert and remove a space, insert and remove a newline.
+    double total = 0, worst = 0;
+    size_t edits = 0;
+    auto edit = [&](size_t offset, size_t removed, const std::string &inserted) {
+        auto start = std::chrono::steady_clock::now();
+        doc->Edit(offset, removed, inserted);
+        std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+        text.replace(offset, removed, inserted);
+        total += d.count();
+        if (d.count() > worst) worst = d.count();
+        ++edits;
+    };
+    for (auto offset:ints) {
+        edit(offset, 1, text[offset] == '1' ? "2" : "1");
+        edit(offset, 0, " ");
+        edit(offset, 1, "");
+        edit(offset, 0, "\n");
+        edit(offset, 1, "");
+    }
+    printf("  %-28s %10.3f us mean %10.3f us max %6zu edits\n", "Document::Edit", total / edits * 1e6, worst * 1e6,
+           edits);
+    doc->GetStats().Print(stdout);
+    std::ostringstream fromDoc;
+    doc->Serialize(fromDoc);
+    printf("  %-28s %10s\n", "Document after the edits",
+           fromDoc.str() == FullParse(text, &name) && doc->Text() == text ? "same text" : "TEXT DIFFERS");
+    delete doc;
+}
+
+void Benchmark(const std::list<std::string> &sources) {
+    for (auto &source:sources) {
+        auto buffer = SourceBuffer::Open(source);
+        if (buffer == nullptr) {
+            fprintf(stderr, "%s: No such file or directory\n", source.c_str());
+            continue;
+        }
+        delete buffer;
+        BenchLoad(source);
+        BenchLex(source);
+        BenchKeyword(source);
+        BenchParse(source);
+        BenchStream(source);
+        BenchCache(source);
+        BenchInfer(source);
+        BenchEdit(source);
+    }
+}
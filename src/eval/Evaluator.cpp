@@ -0,0 +1,465 @@
+#include "eval/Evaluator.h"
+#include "syntax/Error.h"
+#include "syntax/OutBuffer.h"
+#include "syntax/SmallVec.h"
+#include "syntax/Token.h"
+#include "syntax/Type.h"
+#include <algorithm>
+#include <cstring>
+#include <sys/resource.h>
+
+static bool IsNumber(int kind) { return kind == Type::T_Int || kind == Type::T_Float; }
+
+template<typename T>
+static bool Compare(int op, T l, T r) {
+    switch (op) {
+        case '<':
+            return l < r;
+        case '>':
+            return l > r;
+        case Token::Le:
+            return l <= r;
+        case Token::Ge:
+            return l >= r;
+        case Token::Eq:
+            return l == r;
+        case Token::Ne:
+            return l != r;
+        default:
+            CompilePanic("unreachable");
+            return false;
+    }
+}
+
+Evaluator::Evaluator(const FlatTree &tree) : _tree(tree), _frameSizes(tree.Size(), 0) {
+    SizeFrames(_tree.Root(), _tree.Root());
+    // Half of the stack of the thread, the rest for the walk around the calls.
+    // Threads get the size of the main stack, 2 MB if it is unlimited.
+    struct rlimit limit;
+    size_t stack = 2 << 20;
+    if (getrlimit(RLIMIT_STACK, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) stack = limit.rlim_cur;
+    _stackLimit = stack / 2;
+}
+
+Evaluator::Value Evaluator::Unit() {
+    Value value;
+    value.kind = Type::T_Unit;
+    value.i = 0;
+    return value;
+}
+
+void Evaluator::Run(std::ostream &os) {
+    if (auto out = dynamic_cast<OutBuffer *>(os.rdbuf())) {
+        Run(*out);
+        return;
+    }
+    OutBuffer out(os);
+    Run(out);
+}
+
+void Evaluator::Run(OutBuffer &out) {
+    char base;
+    _stackBase = &base;
+    auto root = _tree.Root();
+    _frame = NewFrame(_frameSizes[root], nullptr);
+    _frame->stamp = ++_stamp;
+    _frame->captured = true;  // the globals
+    for (auto p = _tree.ChildBegin(root); p != _tree.ChildEnd(root); ++p) {
+        Stmt(*p, out);
+    }
+}
+
+/// Frames
+
+void Evaluator::SizeFrames(NodeId id, NodeId owner) {
+    // with a stack of its own, a chain of binaries is as deep as it is long
+    std::vector<std::pair<NodeId, NodeId>> work{{id, owner}};
+    while (!work.empty()) {
+        id = work.back().first;
+        owner = work.back().second;
+        work.pop_back();
+        if (id == FlatTree::kNoNode) continue;
+        switch (_tree.kind[id]) {
+            case FlatTree::N_Var:
+            case FlatTree::N_Func:
+            case FlatTree::N_FuncCall:
+                // the binding sites are at depth 0, the name of a func in the frame around it
+                if (_tree.depth[id] == 0) {
+                    _frameSizes[owner] = std::max(_frameSizes[owner], (uint32_t) _tree.slot[id] + 1);
+                }
+                break;
+            default:
+                break;
+        }
+        if (_tree.kind[id] == FlatTree::N_Func) owner = id;
+        for (auto p = _tree.ChildBegin(id); p != _tree.ChildEnd(id); ++p) {
+            work.push_back({*p, owner});
+        }
+    }
+}
+
+Evaluator::Frame *Evaluator::NewFrame(uint32_t size, Frame *parent) {
+    Frame *frame;
+    if (size < _free.size() && _free[size] != nullptr) {
+        frame = _free[size];
+        _free[size] = frame->parent;
+    } else {
+        auto bytes = sizeof(Frame) + (size > 0 ? size - 1 : 0) * sizeof(Value);
+        frame = (Frame *) _arena.Alloc(bytes, alignof(Frame));
+        frame->size = size;
+    }
+    frame->parent = parent;
+    frame->captured = false;
+    frame->stamp = 0;  // until its args are in, see Apply
+    frame->seen = 0;
+    frame->closures = nullptr;
+    auto unit = Unit();
+    for (uint32_t i = 0; i < size; ++i) frame->slots[i] = unit;
+    return frame;
+}
+
+void Evaluator::Release(Frame *frame) {
+    if (frame->captured) return;
+    if (frame->size >= _free.size()) _free.resize(frame->size + 1, nullptr);
+    frame->parent = _free[frame->size];
+    _free[frame->size] = frame;
+    while (auto closure = frame->closures) {
+        frame->closures = closure->next;
+        closure->next = _freeClosures;
+        _freeClosures = closure;
+    }
+}
+
+bool Evaluator::Reaches(const Value &value, const Frame *frame) {
+    if (value.kind != Type::T_Func && value.kind != Type::T_Pair) return false;
+    ++_walk;
+    _work.clear();
+    _work.push_back(value);
+    while (!_work.empty()) {
+        auto next = _work.back();
+        _work.pop_back();
+        if (next.kind == Type::T_Pair) {
+            auto pair = next.pair;
+            if (pair->stamp < frame->stamp || pair->seen == _walk) continue;
+            pair->seen = _walk;
+            _work.push_back(pair->first);
+            _work.push_back(pair->second);
+            continue;
+        }
+        if (next.kind != Type::T_Func) continue;
+        // the env and its parents, older and older
+        for (auto env = next.func->env; env != nullptr && env->stamp >= frame->stamp && env->seen != _walk; env = env->parent) {
+            if (env == frame) return true;
+            env->seen = _walk;
+            for (uint32_t i = 0; i < env->size; ++i) {
+                auto kind = env->slots[i].kind;
+                if (kind == Type::T_Func || kind == Type::T_Pair) _work.push_back(env->slots[i]);
+            }
+        }
+    }
+    return false;
+}
+
+Evaluator::Value &Evaluator::Lookup(NodeId at) {
+    int depth = _tree.depth[at], slot = _tree.slot[at];
+    auto frame = _frame;
+    for (int i = 0; i < depth && frame != nullptr; ++i) frame = frame->parent;
+    if (depth < 0 || frame == nullptr || slot < 0 || (uint32_t) slot >= frame->size) {
+        Error(at, "undefined var here");
+    }
+    return frame->slots[slot];
+}
+
+/// Funcs
+
+Evaluator::Value Evaluator::MakeClosure(NodeId func) {
+    auto closure = _freeClosures;
+    if (closure != nullptr) {
+        _freeClosures = closure->next;
+    } else {
+        closure = _arena.New<Closure>();
+    }
+    closure->func = func;
+    closure->env = _frame;
+    closure->next = _frame->closures;
+    _frame->closures = closure;
+    Value value;
+    value.kind = Type::T_Func;
+    value.func = closure;
+    return Lookup(func) = value;
+}
+
+Evaluator::Value Evaluator::Apply(NodeId at, const Value &func, const NodeId *args, size_t count) {
+    if (func.kind != Type::T_Func) Error(at, "a func expected here");
+    auto id = func.func->func;
+    if ((size_t) _tree.tag[id] != count) Error(at, "the count of arguments is unmatched");
+    char here;
+    if ((size_t) (_stackBase - &here) > _stackLimit) Error(at, "stack overflow");
+    ++_calls;
+    // the args are evaluated in the frame of the caller, into the new one
+    auto frame = NewFrame(_frameSizes[id], func.func->env);
+    auto params = _tree.ChildBegin(id);
+    for (size_t i = 0; i < count; ++i) {
+        auto arg = Eval(args[i]);
+        frame->slots[_tree.slot[params[i]]] = arg;
+    }
+    auto caller = _frame;
+    frame->stamp = ++_stamp;  // after the args, made before it
+    _frame = frame;
+    auto ret = params[count] != FlatTree::kNoNode ? Eval(params[count]) : Unit();
+    _frame = caller;
+    if (Reaches(ret, frame)) frame->captured = true;
+    Release(frame);
+    return ret;
+}
+
+/// Walk
+
+Evaluator::Value Evaluator::Eval(NodeId id) {
+    auto child = _tree.ChildBegin(id);
+    auto count = _tree.count[id];
+    Value value;
+    switch (_tree.kind[id]) {
+        case FlatTree::N_Exp: {
+            if (child[0] == FlatTree::kNoNode) {
+                value = Unit();
+                for (uint32_t i = 1; i < count; ++i) {
+                    value = Eval(child[i]);
+                }
+                return value;
+            }
+            value = Lookup(child[0]);
+            return count == 1 ? value : Apply(id, value, child + 1, count - 1);
+        }
+        case FlatTree::N_Var:
+            return Lookup(id);
+        case FlatTree::N_Func:
+            return MakeClosure(id);
+        case FlatTree::N_FuncCall:
+            value = Lookup(id);
+            return Apply(id, value, child, count);
+        case FlatTree::N_Constant:
+            switch (_tree.tag[id]) {
+                case Token::Int:
+                    value.kind = Type::T_Int;
+                    value.i = (int32_t) _tree.aux[id];
+                    return value;
+                case Token::Float: {
+                    float fval;
+                    memcpy(&fval, &_tree.aux[id], sizeof(fval));
+                    value.kind = Type::T_Float;
+                    value.f = fval;
+                    return value;
+                }
+                case Token::Bool:
+                    value.kind = Type::T_Bool;
+                    value.b = _tree.aux[id] != 0;
+                    return value;
+                case Token::String:
+                    value.kind = Type::T_String;
+                    value.s = _tree.chars.data() + _tree.aux[id];
+                    return value;
+                default:
+                    return Unit();
+            }
+        case FlatTree::N_Binary:
+            return Binary(id);
+        case FlatTree::N_Unary:
+            value = Eval(child[0]);
+            if (value.kind == Type::T_Int) {
+                if (_tree.tag[id] == '-') value.i = (int64_t) (0 - (uint64_t) value.i);
+            } else if (value.kind == Type::T_Float) {
+                if (_tree.tag[id] == '-') value.f = -value.f;
+            } else {
+                Error(child[0], "a number expected here");
+            }
+            return value;
+        case FlatTree::N_Cons: {
+            auto pair = _arena.New<Pair>();
+            pair->first = Eval(child[0]);
+            pair->second = Eval(child[1]);
+            pair->stamp = _stamp;
+            pair->seen = 0;
+            value.kind = Type::T_Pair;
+            value.pair = pair;
+            return value;
+        }
+        case FlatTree::N_Compound:
+            Eval(child[0]);
+            return Eval(child[1]);
+        case FlatTree::N_Fst:
+            value = Eval(child[0]);
+            Eval(child[1]);
+            return value;
+        case FlatTree::N_Snd:
+            Eval(child[0]);
+            return Eval(child[1]);
+        case FlatTree::N_If:
+            if (Truth(child[0], Eval(child[0]))) return Eval(child[1]);
+            return child[2] != FlatTree::kNoNode ? Eval(child[2]) : Unit();
+        case FlatTree::N_While:
+            while (Truth(child[0], Eval(child[0]))) {
+                Eval(child[1]);
+            }
+            return Unit();
+        case FlatTree::N_Let:
+            return Let(child, count);
+        default:
+            CompilePanic("unreachable");
+            return Unit();
+    }
+}
+
+Evaluator::Value Evaluator::Let(const NodeId *child, uint32_t count) {
+    // let a = e1 and b = e2 in body: e1 and e2 do not see a and b.
+    auto pairs = (count - 1) / 2;
+    SmallVec<Value> values;
+    for (uint32_t i = 0; i < pairs; ++i) {
+        values.push_back(child[2 * i + 1] != FlatTree::kNoNode ? Eval(child[2 * i + 1]) : Unit());
+    }
+    for (uint32_t i = 0; i < pairs; ++i) {
+        auto bound = child[2 * i];
+        if (_tree.kind[bound] == FlatTree::N_Func) {
+            MakeClosure(bound);
+        } else {
+            Lookup(bound) = values[i];
+        }
+    }
+    return Eval(child[count - 1]);
+}
+
+Evaluator::Value Evaluator::Binary(NodeId id) {
+    SmallVec<NodeId> spine;
+    auto value = Eval(_tree.Spine(id, spine));
+    for (auto p = spine.end(); p != spine.begin();) {
+        value = Operate(*--p, value);
+    }
+    return value;
+}
+
+Evaluator::Value Evaluator::Operate(NodeId id, const Value &lhs) {
+    auto child = _tree.ChildBegin(id);
+    auto op = _tree.tag[id];
+    Value value;
+    if (op == Token::An || op == Token::Or) {  // short circuit
+        value.kind = Type::T_Bool;
+        value.b = Truth(child[0], lhs);
+        if (value.b == (op == Token::An)) value.b = Truth(child[1], Eval(child[1]));
+        return value;
+    }
+    Value rhs = Eval(child[1]);
+    auto ints = lhs.kind == Type::T_Int && rhs.kind == Type::T_Int;
+    auto arith = op == '+' || op == '-' || op == '*' || op == '/';
+    if (!IsNumber(lhs.kind) || !IsNumber(rhs.kind)) {
+        if (arith || lhs.kind != Type::T_Bool || rhs.kind != Type::T_Bool) {
+            Error(IsNumber(lhs.kind) || lhs.kind == Type::T_Bool ? child[1] : child[0],
+                  arith ? "a number expected here" : "a number or a bool expected here");
+        }
+    }
+    // An int with a float, which a checked tree has not, is a float.
+    double l = lhs.kind == Type::T_Float ? lhs.f : lhs.kind == Type::T_Int ? (double) lhs.i : lhs.b;
+    double r = rhs.kind == Type::T_Float ? rhs.f : rhs.kind == Type::T_Int ? (double) rhs.i : rhs.b;
+    if (!arith) {
+        value.kind = Type::T_Bool;
+        value.b = ints ? Compare(op, lhs.i, rhs.i) : Compare(op, l, r);
+        return value;
+    }
+    value.kind = ints ? Type::T_Int : Type::T_Float;
+    switch (op) {
+        case '+':
+            if (ints) value.i = (int64_t) ((uint64_t) lhs.i + (uint64_t) rhs.i);
+            else value.f = l + r;
+            break;
+        case '-':
+            if (ints) value.i = (int64_t) ((uint64_t) lhs.i - (uint64_t) rhs.i);
+            else value.f = l - r;
+            break;
+        case '*':
+            if (ints) value.i = (int64_t) ((uint64_t) lhs.i * (uint64_t) rhs.i);
+            else value.f = l * r;
+            break;
+        default:  // '/'
+            if (!ints) {
+                value.f = l / r;
+            } else if (rhs.i == 0) {
+                Error(id, "division by zero");
+            } else {
+                value.i = rhs.i == -1 ? (int64_t) (0 - (uint64_t) lhs.i) : lhs.i / rhs.i;
+            }
+            break;
+    }
+    return value;
+}
+
+bool Evaluator::Truth(NodeId at, const Value &value) {
+    if (value.kind != Type::T_Bool) Error(at, "a bool expected here");
+    return value.b;
+}
+
+/// Statements
+
+void Evaluator::Stmt(NodeId id, OutBuffer &out) {
+    auto child = _tree.ChildBegin(id);
+    switch (_tree.kind[id]) {
+        case FlatTree::N_VarStmt:  // the global named, a copy of its var or func
+            out << "- = ";
+            Print(out, Lookup(child[0]));
+            break;
+        case FlatTree::N_VarAssignStmt: {
+            auto value = Eval(child[1]);  // its let-in vars are temporaries of the global frame
+            Lookup(child[0]) = value;
+            out << "val " << _tree.name[child[0]] << " = ";
+            Print(out, value);
+            break;
+        }
+        case FlatTree::N_FuncAssignStmt:
+            out << "val " << _tree.name[child[0]] << " = ";
+            Print(out, MakeClosure(child[0]));
+            break;
+        default:
+            CompilePanic("unreachable");
+    }
+    out << '\n';
+}
+
+void Evaluator::Print(OutBuffer &out, const Value &value) {
+    switch (value.kind) {
+        case Type::T_Int:
+            out << (long long) value.i;
+            break;
+        case Type::T_Float: {
+            char text[32];
+            snprintf(text, sizeof(text), "%g", value.f);
+            out << text;
+            if (strspn(text, "-0123456789") == strlen(text)) out << '.';  // 3. as in OCaml, not the int 3
+            break;
+        }
+        case Type::T_Bool:
+            out << (value.b ? "true" : "false");
+            break;
+        case Type::T_String:
+            out << value.s;
+            break;
+        case Type::T_Func:
+            out << "<fun>";
+            break;
+        case Type::T_Pair:
+            out << '(';
+            Print(out, value.pair->first);
+            out << ", ";
+            Print(out, value.pair->second);
+            out << ')';
+            break;
+        default:
+            out << "()";
+            break;
+    }
+}
+
+void Evaluator::Error(NodeId at, const char *message) {
+    if (auto token = _tree.token[at]) CompileError(token, "%s", message);
+    SourceLocation loc;
+    if (_tree.Locate(at, loc)) CompileError(loc, "%s", message);  // of a cached tree
+    CompilePanic(message);
+    abort();
+}
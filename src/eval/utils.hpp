@@ -1,10 +0,0 @@
-//
-// Created by leo on 2022/3/29.
-//
-
-
-#ifndef LEOML_UTILS_H
-#define LEOML_UTILS_H
-
-
-#endif //LEOML_UTILS_H
@@ -1,17 +1,41 @@
-#include <iostream>
+#include <fcntl.h>
 #include <list>
+#include <ostream>
+#include <sstream>
+#include <unistd.h>
+#include <vector>
 
+#include "bench/Bench.h"
+#include "eval/Evaluator.h"
+#include "syntax/Diagnostics.h"
+#include "syntax/Error.h"
+#include "syntax/Inference.h"
 #include "syntax/Token.h"
 #include "syntax/Lexer.h"
+#include "syntax/OutBuffer.h"
 #include "syntax/Parser.h"
 #include "syntax/ParseTree.h"
 #include "syntax/Scope.h"
+#include "syntax/Symbol.h"
+#include "syntax/ThreadPool.h"
+#include "syntax/TokenCache.h"
+#include "syntax/TreeCache.h"
 #include "syntax/Type.h"
 
 static std::string source_path = "";
 static std::string output_dir = "";  // "." for example
 static std::list<std::string> source_list{};
-static Program *TheProgram;
+static bool parser_stats = false;
+static bool stream_tokens = false;  // --stream, lex on demand while parsing
+static bool pipe_tokens = false;  // --pipe, lex ahead on a thread while parsing
+static bool binary_tokens = false;  // --binary, -l writes a token cache
+static bool syntax_only = false;  // -fsyntax-only, parse without the scope and type checks
+static size_t error_limit = Diagnostics::kLimit;  // -ferror-limit=<n>, errors before a source stops
+static bool failed = false;  // a source had errors
+static ThreadPool *parse_pool = nullptr;  // -t, parse the statements concurrently
+static ThreadPool *file_pool = nullptr;  // -j, compile the sources concurrently
+static std::string tree_cache_dir = "";  // --cache
+static TreeCache *tree_cache = nullptr;  // --cache, the trees of the unchanged sources
 
 void Usage() {
     printf("Usage: leoml [-o <output>] [options] <source>\n"
@@ -19,9 +43,20 @@ void Usage() {
            "\t-h      Print this help message.\n"
            "\t-l      Tokenize the source.\n"
            "\t-p      Parse the source.\n"
-           "\t-e      Evaluate the source.\n"
+           "\t-c      Infer the types of the source, print those of the globals.\n"
+           "\t-e      Evaluate the source, print the values of the globals.\n"
+           "\t-b      Benchmark the front end on the source.\n"
            "\t-i      Interactive mode, not support yet.\n"
-           "\t-o      Specify output directory. Otherwise print to the stdout.\n");
+           "\t-o      Specify output directory. Otherwise print to the stdout.\n"
+           "\t-s      Print the parser stats to the stderr, with -p or -e.\n"
+           "\t-fsyntax-only  Parse without the scope and type checks, with -p. -c and -e do their own.\n"
+           "\t-ferror-limit=<n>  Stop a source after n errors, 20 by default, 0 for no limit.\n"
+           "\t--stream  Lex the source on demand while it is parsed, with -p or -e.\n"
+           "\t--pipe    Lex the source on a thread of its own while it is parsed, with -p or -e.\n"
+           "\t--binary  Write the tokens to a .tsb cache, with -l. A .tsb source is read without lexing.\n"
+           "\t-t <n>  Parse the statements of a source on n threads, 0 for all the cores.\n"
+           "\t-j <n>  Compile the sources on n threads, 0 for all the cores.\n"
+           "\t--cache <dir>  Keep the trees of -p, -c and -e in the directory, by the hash of the source.\n");
     exit(0);
 }
 
@@ -43,82 +78,299 @@ std::string GetName(const std::string &path) {
 }
 
 /// Laod File Content
-/// \param filepath
-/// \return content
-std::string *LoadFile(const std::string &filepath) {
-    FILE *f = fopen(filepath.c_str(), "r");
-//    if (!f) CompileError("%s: No such file or directory", filepath.c_str());
-    auto text = new std::string;
-    int c;
-    while (EOF != (c = fgetc(f)))
-        text->push_back(c);
-    fclose(f);
-    return text;
+/// \param filepath, "-" for the stdin
+/// \return content, mmap-ed when possible
+SourceBuffer *LoadFile(const std::string &filepath) {
+    auto source = SourceBuffer::Open(filepath);
+    if (!source) CompilePanic((filepath + ": No such file or directory").c_str());
+    return source;
 }
 
-// Tokenize entry
-void Tokenize() {
-    printf("tokenizing\n");
-    for (auto source:source_list) {
-        auto name = GetName(source);
-        TokenSequence *ts = new TokenSequence();
-        Lexer *lexer = Lexer::New(LoadFile(source), &name);
-        lexer->Tokenize(*ts);
+/// Unit
+// The state of compiling one source. Nothing is shared between the units but
+// the symbol table, so that they may be compiled on any threads.
+struct Unit {
+    std::string path;
+    std::string name;
+    SourceBuffer *text{nullptr};
+    TokenCache *cache{nullptr};  // of a .tsb source, instead of the text
+    Lexer *lexer{nullptr};
+    TokenSequence *ts{nullptr};
+    Parser *parser{nullptr};
+    FlatTree *tree{nullptr};  // loaded from the tree cache, instead of the parser's
+    bool hasStats{false};
+    ParserStats stats;
+    Diagnostics diags{error_limit};
+    std::ostringstream out;  // for the stdout under -j
+
+    explicit Unit(const std::string &path) : path(path), name(GetName(path)) {}
+
+    ~Unit() { Release(); }
+
+    // Drop the text and the trees, once the output is written.
+    void Release() {
+        delete tree;
+        delete parser;  // whose tokens live in ts
+        delete ts;
+        delete lexer;
+        delete text;
+        delete cache;
+        tree = nullptr;
+        parser = nullptr;
+        ts = nullptr;
+        lexer = nullptr;
+        text = nullptr;
+        cache = nullptr;
+    }
+
+    /// Emit
+    // Write the output of the unit to the file under -o, else to the stdout,
+    // which is buffered under -j to be printed in the order of the sources.
+    // The stream of the writer is an OutBuffer, written once per buffer.
+    template<typename F>
+    void Emit(const char *suffix, F write) {
         if (output_dir != "") {
-            std::string outpath = output_dir + "/" + name + ".ts.txt";
-            std::ofstream out{outpath};
-            ts->Serialize(out);
+            auto path = output_dir + "/" + name + suffix;
+            int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) CompilePanic((path + ": Can not be written").c_str());
+            Write(OutBuffer(fd), write);
+            close(fd);
+        } else if (file_pool) {
+            Write(OutBuffer(out), write);
         } else {
-            ts->Serialize(std::cout);
+            fflush(stdout);  // the banner first
+            Write(OutBuffer(STDOUT_FILENO), write);
         }
-        delete ts, lexer;
     }
+
+private:
+    template<typename F>
+    static void Write(OutBuffer &&buffer, F write) {
+        std::ostream os(&buffer);
+        write(os);
+    }
+};
+
+static bool IsTokenCache(const std::string &path) {
+    return path.size() > 4 && path.compare(path.size() - 4, 4, ".tsb") == 0;
+}
+
+static void Lex(Unit *unit, bool stream = false) {
+    if (IsTokenCache(unit->path)) {  // lexed already, not streamed
+        unit->cache = TokenCache::Open(unit->path);
+        if (!unit->cache) CompilePanic((unit->path + ": Not a token cache").c_str());
+        unit->ts = new TokenSequence();
+        if (unit->cache->Read(*unit->ts, &unit->name)) return;
+        // the tokens are corrupt, lex the text kept beside them
+        delete unit->ts;
+        unit->text = SourceBuffer::New(unit->cache->Text(), unit->cache->TextSize());
+    }
+    if (!unit->text) unit->text = LoadFile(unit->path);
+    unit->lexer = Lexer::New(unit->text, &unit->name);
+    unit->ts = new TokenSequence();
+    if (stream && pipe_tokens) {
+        unit->lexer->Pipe(*unit->ts);
+    } else if (stream) {
+        unit->lexer->Stream(*unit->ts);
+    } else {
+        unit->lexer->Tokenize(*unit->ts);
+    }
+}
+
+static void ParseUnit(Unit *unit) {
+    Lex(unit, (stream_tokens || pipe_tokens) && !parse_pool);  // the pool splits the whole sequence
+    unit->parser = Parser::New(*unit->ts, syntax_only);
+    if (parse_pool) {
+        unit->parser->Parse(parse_pool);
+    } else {
+        unit->parser->Parse();
+    }
+    unit->hasStats = parser_stats;
+    unit->stats = unit->parser->GetStats();
+}
+
+/// Compile
+// The step on the unit, its errors collected by its Diagnostics. An error no
+// pass recovered from ends the step.
+template<typename F>
+static void Compile(Unit *unit, F step) {
+    DiagnosticsGuard guard(&unit->diags);
+    try {
+        step(unit);
+    } catch (const Diagnostics::Recovery &) {
+    }
+}
+
+/// Run
+// Compile every source by the step, concurrently on the file pool under -j.
+// The buffered stdout, the errors and the stats are printed in the order of
+// the sources, so that the output is the same for any -j.
+template<typename F>
+static void Run(F step) {
+    std::vector<Unit *> units;
+    for (auto &source:source_list) units.push_back(new Unit(source));
+    auto flush = [](Unit *unit) {
+        auto text = unit->out.str();
+        fwrite(text.data(), 1, text.size(), stdout);
+        fflush(stdout);  // the banner and the output before the errors, as they were written
+        unit->diags.Print(stderr);
+        if (unit->diags.Errors() > 0) failed = true;
+        if (unit->hasStats) unit->stats.Print(stderr);
+        delete unit;
+    };
+    if (file_pool) {
+        Symbol::Shared shared;  // the lexers and the scopes intern on the workers
+        for (auto unit:units) {
+            file_pool->Submit([unit, step] {
+                Compile(unit, step);
+                unit->Release();
+            });
+        }
+        file_pool->Wait();
+        for (auto unit:units) flush(unit);
+    } else {
+        for (auto unit:units) {
+            Compile(unit, step);
+            flush(unit);
+        }
+    }
+}
+
+// Tokenize entry
+void Tokenize() {
+    if (binary_tokens) {  // no banner, the stdout may be a .tsb
+        Run([](Unit *unit) {
+            Lex(unit);
+            if (unit->diags.Errors() > 0) return;
+            unit->Emit(".tsb", [unit](std::ostream &os) {
+                if (unit->cache) {
+                    TokenCache::Write(os, unit->cache->Text(), unit->cache->TextSize(), *unit->ts);
+                } else {
+                    TokenCache::Write(os, unit->text->Begin(), unit->text->Size(), *unit->ts);
+                }
+            });
+        });
+        return;
+    }
+    printf("tokenizing\n");
+    Run([](Unit *unit) {
+        Lex(unit);
+        if (unit->diags.Errors() > 0) return;
+        unit->Emit(".ts.txt", [unit](std::ostream &os) { unit->ts->Serialize(os); });
+    });
+}
+
+/// Tree
+// The tree of the unit, from the tree cache if it has the source, else parsed.
+// nullptr if the source has errors.
+static const FlatTree *Tree(Unit *unit) {
+    auto cached = tree_cache && !IsTokenCache(unit->path);
+    if (cached) {
+        unit->text = LoadFile(unit->path);
+        unit->tree = tree_cache->Load(unit->text->Begin(), unit->text->Size());
+        if (unit->tree) unit->tree->SetSource(unit->text->Begin(), unit->text->Size(), &unit->name);
+    }
+    if (unit->tree == nullptr) {
+        ParseUnit(unit);
+        if (unit->parser->GetTree() == nullptr) return nullptr;
+        if (cached) tree_cache->Store(unit->text->Begin(), unit->text->Size(), *unit->parser->GetTree());
+    }
+    return unit->tree ? unit->tree : unit->parser->GetTree();
 }
 
 // Parse entry
 void Parse() {
     printf("parsing\n");
-    for (auto source:source_list) {
-        auto name = GetName(source);
-        TokenSequence *ts = new TokenSequence();
-        Lexer *lexer = Lexer::New(LoadFile(source), &name);
-        lexer->Tokenize(*ts);
-        Parser *parser = Parser::New(*ts);
-        parser->Parse();
-        if (output_dir != "") {
-            std::string outpath = output_dir + "/" + name + ".ts.txt";
-            std::ofstream out{outpath};
-            parser->Serialize(out);
-        } else {
-            TheProgram = parser->GetProgram();
-            parser->Serialize(std::cout);
-        }
-        delete ts, parser;
-    }
+    Run([](Unit *unit) {
+        auto tree = Tree(unit);
+        if (tree == nullptr) return;
+        unit->Emit(".ts.txt", [tree](std::ostream &os) { tree->Serialize(os); });
+    });
+}
+
+// Check entry
+void Check() {
+    printf("checking\n");
+    Run([](Unit *unit) {
+        auto tree = Tree(unit);
+        if (tree == nullptr) return;
+        Inference inference(*tree);
+        inference.Run();
+        if (unit->diags.Errors() > 0) return;
+        unit->Emit(".types.txt", [&inference](std::ostream &os) { inference.Serialize(os); });
+    });
 }
 
-void Eval(Program &program) {
-    std::cout << "Unsupported yet." << std::endl;
+// Eval entry
+void Evaluate() {
+    printf("evaluating\n");
+    Run([](Unit *unit) {
+        auto tree = Tree(unit);
+        if (tree == nullptr) return;
+        Inference(*tree).Run();  // the types, checked before any output
+        if (unit->diags.Errors() > 0) return;
+        Evaluator evaluator(*tree);
+        unit->Emit(".out.txt", [&evaluator](std::ostream &os) { evaluator.Run(os); });
+    });
 }
 
 void Repl() {
-    std::cout << "Unsupported yet." << std::endl;
+    printf("Unsupported yet.\n");
+}
+
+/// Mode
+// The short option of the mode, -h for the long ones too.
+char Mode(const std::string &arg) {
+    if (arg == "--help") return 'h';
+    if (arg == "--lexer") return 'l';
+    if (arg == "--parser") return 'p';
+    if (arg == "--check") return 'c';
+    if (arg == "--eval") return 'e';
+    if (arg == "--bench") return 'b';
+    if (arg.size() == 2) return arg[1];
+    return 0;
 }
 
 int main(int argc, char *argv[]) {
     if (argc < 2) Usage();
-    if (argc >= 5) {
-        assert('o' == argv[argc - 2][1]);
-        output_dir = argv[argc - 1];
-        for (int i = 2; i < argc - 2; ++i) {
-            source_list.push_back(argv[i]);
+    char mode = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-o") {
+            if (i + 1 == argc) Usage();
+            output_dir = argv[++i];
+        } else if (arg == "-t") {
+            if (i + 1 == argc) Usage();
+            parse_pool = ThreadPool::New((unsigned) atoi(argv[++i]));
+        } else if (arg == "-j") {
+            if (i + 1 == argc) Usage();
+            file_pool = ThreadPool::New((unsigned) atoi(argv[++i]));
+        } else if (arg == "--cache") {
+            if (i + 1 == argc) Usage();
+            tree_cache_dir = argv[++i];
+        } else if (arg == "-s" || arg == "--stats") {
+            parser_stats = true;
+        } else if (arg == "--stream") {
+            stream_tokens = true;
+        } else if (arg == "--pipe") {
+            pipe_tokens = true;
+        } else if (arg == "--binary") {
+            binary_tokens = true;
+        } else if (arg == "-fsyntax-only") {
+            syntax_only = true;
+        } else if (arg.compare(0, 14, "-ferror-limit=") == 0) {
+            error_limit = (size_t) atoi(arg.c_str() + 14);
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            mode = Mode(arg);
+            if (mode == 0) Usage();
+        } else {
+            source_list.push_back(arg);  // "-" for the stdin
         }
     }
-    for (int i = 2; i < argc; ++i) {
-        source_list.push_back(argv[i]);
-    }
+    if (mode == 'c' || mode == 'e') syntax_only = true;  // Inference checks the tree
+    if (!tree_cache_dir.empty()) tree_cache = TreeCache::New(tree_cache_dir, syntax_only ? "syntax-only" : "");
 
-    switch (argv[1][1]) {
+    switch (mode) {
         case 'h':
             Usage();
             break;
@@ -128,9 +380,14 @@ int main(int argc, char *argv[]) {
         case 'p':
             Parse();
             break;
+        case 'c':
+            Check();
+            break;
+        case 'b':
+            Benchmark(source_list);
+            break;
         case 'e':
-            Parse();
-            Eval(*TheProgram);
+            Evaluate();
             break;
         case 'i':
             Repl();
@@ -139,5 +396,5 @@ int main(int argc, char *argv[]) {
             break;
     }
 
-    return 0;
+    return failed ? 1 : 0;
 }
@@ -0,0 +1,12 @@
+# cmake -DOUT=<header> -DSOURCES=<files> -P BuildId.cmake
+# Write the SHA-1 of the sources of the passes to the header as LEOML_BUILD,
+# the header is touched only when it changes.
+set(hashes "")
+foreach (source ${SOURCES})
+    file(SHA1 ${source} hash)
+    string(APPEND hashes ${hash})
+endforeach ()
+string(SHA1 build "${hashes}")
+file(WRITE ${OUT}.tmp "#define LEOML_BUILD \"${build}\"\n")
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different ${OUT}.tmp ${OUT})
+file(REMOVE ${OUT}.tmp)
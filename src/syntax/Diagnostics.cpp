@@ -0,0 +1,32 @@
+#include "syntax/Diagnostics.h"
+#include <algorithm>
+
+const size_t Diagnostics::kLimit;
+
+void Diagnostics::Report(const SourceLocation &loc, std::string text) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_limit == 0 || _list.size() < _limit) _list.push_back({loc.line, loc.column, std::move(text)});
+    ++_errors;
+}
+
+void Diagnostics::Merge(Diagnostics &other) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto &diag:other._list) _list.push_back(std::move(diag));
+    _errors += other._errors;
+    other._list.clear();
+    other._errors = 0;
+}
+
+void Diagnostics::Print(FILE *out) {
+    if (_errors == 0) return;
+    std::stable_sort(_list.begin(), _list.end(), [](const Diagnostic &a, const Diagnostic &b) {
+        return a.line < b.line || (a.line == b.line && a.column < b.column);
+    });
+    if (_limit > 0 && _list.size() > _limit) _list.resize(_limit);
+    std::string text;
+    for (auto &diag:_list) text += diag.text;
+    if (Full()) text += "too many errors emitted, stopping now\n";
+    auto count = std::min(_errors, _limit > 0 ? _limit : _errors);
+    text += std::to_string(count) + (count == 1 ? " error generated.\n" : " errors generated.\n");
+    fwrite(text.data(), 1, text.size(), out);
+}
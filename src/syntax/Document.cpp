@@ -0,0 +1,474 @@
+#include "syntax/Document.h"
+#include "syntax/Error.h"
+#include "syntax/Resolver.h"
+#include <algorithm>
+#include <cstring>
+
+// Pieces are small, their arenas grow in small blocks.
+static const size_t kPieceBlock = 4096;
+
+
+/// Region
+// A run of pieces lexed together: their text and their tokens.
+struct Document::Region {
+    SourceBuffer *text;
+    TokenSequence ts;
+    size_t errors{0};  // of the lexer
+
+    explicit Region(const std::string &source)
+            : text(SourceBuffer::New(source)),
+              ts(std::min(std::max(source.size() * 4, kPieceBlock), (size_t) Arena::kBlockSize)) {}
+
+    ~Region() { delete text; }
+};
+
+/// Piece
+// Whole lines of the text, and the statements in them.
+struct Document::Piece {
+    std::shared_ptr<Region> region;
+    size_t begin, end;  // of the text in the region
+    unsigned lexedLine{1};  // of the first line, in the tokens
+    uint32_t first, last;  // of the tokens in the list of the region
+    TokenSequence ts;
+    std::vector<Symbol> names;  // of the vars in the tokens, sorted
+    Parser *parser{nullptr};  // the statements, in its arena
+    std::vector<std::pair<Symbol, Var *>> defs;  // the globals defined, the last one of a name
+    int slotBase{0};  // of the global frame
+    int slots{0};  // of the global frame, taken by the statements
+    FlatTree tree;
+    std::vector<FlatTree::NodeId> roots;  // of the statements in the tree
+    size_t index{0};  // in the document
+    size_t queued{0};  // stamp of the update that queued it
+    size_t errors{0};  // of the last parse
+
+    Piece(const std::shared_ptr<Region> &region, size_t begin, size_t end, uint32_t first, uint32_t last)
+            : region(region), begin(begin), end(end), first(first), last(last),
+              ts(region->ts.GetList(), first, last) {}
+
+    ~Piece() { delete parser; }
+
+    const char *Text() const { return region->text->Begin() + begin; }
+
+    size_t Size() const { return end - begin; }
+
+    Var *Def(Symbol name) const {
+        for (auto &def:defs) {
+            if (def.first == name) return def.second;
+        }
+        return nullptr;
+    }
+};
+
+static size_t CountLines(const char *p, size_t size) {
+    return std::count(p, p + size, '\n');
+}
+
+// Position of the first piece at the index or after, in a list in order.
+template<typename P>
+static typename std::vector<P *>::iterator Tail(std::vector<P *> &pieces, size_t index) {
+    return std::lower_bound(pieces.begin(), pieces.end(), index,
+                            [](const P *piece, size_t i) { return piece->index < i; });
+}
+
+template<typename P>
+static void Insert(std::vector<P *> &pieces, P *piece) {
+    pieces.insert(Tail(pieces, piece->index), piece);
+}
+
+template<typename P>
+static void Remove(std::unordered_map<Symbol, std::vector<P *>> &index, Symbol name, P *piece) {
+    auto found = index.find(name);
+    if (found == index.end()) return;
+    auto &pieces = found->second;
+    auto it = Tail(pieces, piece->index);
+    if (it != pieces.end() && *it == piece) pieces.erase(it);
+    if (pieces.empty()) index.erase(found);
+}
+
+Document *Document::New(const std::string &text, const std::string &filename) {
+    auto ret = new Document(filename);
+    ret->_diags.reset(new Diagnostics(0));
+    DiagnosticsGuard guard(ret->_diags.get());
+    ret->Build(text);
+    ret->_stats = DocumentStats();  // of the edits only
+    return ret;
+}
+
+Document::~Document() {
+    for (auto piece:_pieces) delete piece;
+    delete _tree;
+}
+
+void Document::Build(const std::string &text) {
+    bool closed;
+    auto region = Lex(text, 1, false, &closed);
+    _pieces = Cut(region, 1);
+    for (size_t i = 0; i < _pieces.size(); ++i) {
+        _pieces[i]->index = i;
+        _offsets.push_back(_pieces[i]->begin);
+        _lines.push_back(_pieces[i]->lexedLine);
+        for (auto name:_pieces[i]->names) _uses[name].push_back(_pieces[i]);
+    }
+    _size = text.size();
+    Update(0, _pieces.size(), {}, 0);
+}
+
+std::string Document::Text() const {
+    std::string ret;
+    ret.reserve(_size);
+    for (auto piece:_pieces) ret.append(piece->Text(), piece->Size());
+    return ret;
+}
+
+size_t Document::Errors() const {
+    size_t ret = 0;
+    const Region *region = nullptr;
+    for (auto piece:_pieces) {
+        ret += piece->errors;
+        if (piece->region.get() != region) ret += piece->region->errors;  // the pieces of a region are in a run
+        region = piece->region.get();
+    }
+    return ret;
+}
+
+size_t Document::Locate(size_t offset) const {
+    auto it = std::upper_bound(_offsets.begin(), _offsets.end(), offset);
+    return it == _offsets.begin() ? 0 : it - _offsets.begin() - 1;
+}
+
+std::shared_ptr<Document::Region> Document::Lex(const std::string &text, unsigned line, bool part, bool *closed) {
+    auto region = std::make_shared<Region>(text);
+    auto lexer = Lexer::New(region->text, &_filename, line);
+    auto errors = Diagnostics::Current()->Errors();
+    if (part) {
+        *closed = lexer->TokenizePart(region->ts);
+    } else {
+        lexer->Tokenize(region->ts);
+        *closed = true;
+    }
+    region->errors = Diagnostics::Current()->Errors() - errors;
+    delete lexer;
+    _stats.relexed += text.size();
+    return region;
+}
+
+/// Resynced
+// The region ends at the start of a line that is not continued, and no
+// token or comment runs over it. The last significant token before it is
+// ";;", or there is none: the region went on from a cut.
+bool Document::Resynced(const Region &region, const std::string &text) const {
+    if (text.empty()) return true;
+    if (text.back() != '\n') return false;
+    if (text.size() > 1 && text[text.size() - 2] == '\\') return false;
+    auto list = region.ts.GetList();
+    return list->last == TokenList::kNone || list->tokens[list->last]->tag == Token::Dsemi;
+}
+
+/// Widen
+// The errors of the lexer are kept by the region, until all its pieces are
+// dropped: the edit lexes again the whole region, not to keep errors fixed.
+void Document::Widen(size_t &first, size_t &last) const {
+    while (first > 0 && _pieces[first]->region->errors > 0 && _pieces[first - 1]->region == _pieces[first]->region) {
+        --first;
+    }
+    while (last + 1 < _pieces.size() && _pieces[last]->region->errors > 0 &&
+           _pieces[last + 1]->region == _pieces[last]->region) {
+        ++last;
+    }
+}
+
+/// Cut
+// After the last newline between a ";;" and the next significant token, so
+// that a piece starts with the comments before its statement.
+std::vector<Document::Piece *> Document::Cut(const std::shared_ptr<Region> &region, unsigned line) {
+    auto list = region->ts.GetList();
+    auto text = region->text->Begin();
+    std::vector<Piece *> ret;
+    uint32_t first = 0;
+    size_t begin = 0;
+    auto add = [&](uint32_t last, size_t end) {
+        auto piece = new Piece(region, begin, end, first, last);
+        piece->lexedLine = line;
+        for (auto i = first; i < last; ++i) {
+            auto token = list->tokens[i];
+            if (token->tag == Token::Var) piece->names.push_back(token->sym);
+        }
+        std::sort(piece->names.begin(), piece->names.end());
+        piece->names.erase(std::unique(piece->names.begin(), piece->names.end()), piece->names.end());
+        line += CountLines(text + begin, end - begin);
+        ret.push_back(piece);
+        first = last;
+        begin = end;
+    };
+    const Token *prior = nullptr;  // the last significant token
+    uint32_t cut = TokenList::kNone;
+    for (uint32_t i = 0; i < list->size(); ++i) {
+        auto token = list->tokens[i];
+        if (token->tag == Token::NEW_LINE) {
+            if (prior != nullptr && prior->tag == Token::Dsemi) cut = i + 1;
+            continue;
+        }
+        if (cut != TokenList::kNone) {
+            add(cut, list->tokens[cut - 1]->str.data() - text + 1);
+            cut = TokenList::kNone;
+        }
+        prior = token;
+    }
+    add(list->size(), region->text->Size());
+    return ret;
+}
+
+void Document::Edit(size_t offset, size_t removed, const std::string &inserted) {
+    assert(offset <= _size && removed <= _size - offset);
+    ++_stats.edits;
+    _diags.reset(new Diagnostics(0));
+    DiagnosticsGuard guard(_diags.get());
+    auto a = Locate(offset);
+    auto b = removed > 0 ? Locate(offset + removed - 1) : a;
+    auto n = _pieces.size();
+    std::shared_ptr<Region> region;
+    std::string text;
+    while (true) {
+        Widen(a, b);
+        text.clear();
+        for (auto i = a; i <= b; ++i) text.append(_pieces[i]->Text(), _pieces[i]->Size());
+        text.replace(offset - _offsets[a], removed, inserted);
+        bool part = b + 1 < n, closed;
+        region = Lex(text, _lines[a], part, &closed);
+        if (!part || (closed && Resynced(*region, text))) break;
+        b = std::min(n - 1, b + (b - a + 1));  // the pieces swallowed, in doubling runs
+    }
+    auto pieces = Cut(region, _lines[a]);
+
+    // Drop the old pieces
+    std::vector<Symbol> dropped;
+    int droppedSlots = 0;
+    size_t droppedBytes = 0, droppedLines = 0;
+    for (auto i = a; i <= b; ++i) {
+        auto piece = _pieces[i];
+        for (auto name:piece->names) Remove(_uses, name, piece);
+        for (auto &def:piece->defs) {
+            Remove(_defs, def.first, piece);
+            dropped.push_back(def.first);
+        }
+        droppedSlots += piece->slots;
+        droppedBytes += piece->Size();
+        droppedLines += CountLines(piece->Text(), piece->Size());
+        delete piece;
+    }
+    auto base = _offsets[a];
+    _pieces.erase(_pieces.begin() + a, _pieces.begin() + b + 1);
+    _pieces.insert(_pieces.begin() + a, pieces.begin(), pieces.end());
+    _offsets.erase(_offsets.begin() + a, _offsets.begin() + b + 1);
+    _lines.erase(_lines.begin() + a, _lines.begin() + b + 1);
+    std::vector<size_t> offsets;
+    std::vector<unsigned> lines;
+    for (auto piece:pieces) {
+        offsets.push_back(base + piece->begin);
+        lines.push_back(piece->lexedLine);
+    }
+    _offsets.insert(_offsets.begin() + a, offsets.begin(), offsets.end());
+    _lines.insert(_lines.begin() + a, lines.begin(), lines.end());
+
+    // Shift the pieces after, renumber them if the count changed
+    auto bytes = text.size() - droppedBytes;
+    auto delta = (unsigned) (CountLines(text.data(), text.size()) - droppedLines);
+    for (auto i = a + pieces.size(); i < _pieces.size(); ++i) {
+        _offsets[i] += bytes;
+        _lines[i] += delta;
+    }
+    if (pieces.size() != b - a + 1) {
+        for (auto i = a; i < _pieces.size(); ++i) _pieces[i]->index = i;
+    } else {
+        for (auto i = a; i < a + pieces.size(); ++i) _pieces[i]->index = i;
+    }
+    for (auto piece:pieces) {
+        for (auto name:piece->names) Insert(_uses[name], piece);
+    }
+    _size += inserted.size() - removed;
+    if (_unresolved > a && _unresolved != SIZE_MAX) _unresolved = a;  // renumbered
+    Update(a, pieces.size(), dropped, droppedSlots);
+}
+
+void Document::Update(size_t first, size_t count, const std::vector<Symbol> &dropped, int droppedSlots) {
+    ++_stamp;
+    std::vector<Piece *> queue;  // heap, the first piece on top
+    auto later = [](const Piece *lhs, const Piece *rhs) { return lhs->index > rhs->index; };
+    auto push = [&](Piece *piece) {
+        if (piece->queued == _stamp) return;
+        piece->queued = _stamp;
+        queue.push_back(piece);
+        std::push_heap(queue.begin(), queue.end(), later);
+    };
+    auto users = [&](Symbol name, size_t index) {
+        auto found = _uses.find(name);
+        if (found == _uses.end()) return;
+        for (auto it = Tail(found->second, index); it != found->second.end(); ++it) push(*it);
+    };
+    for (auto i = first; i < first + count; ++i) push(_pieces[i]);
+    for (auto name:dropped) users(name, first);
+
+    // Parse, in order: the users come after the pieces they depend on.
+    std::vector<Piece *> parsed;
+    while (!queue.empty()) {
+        std::pop_heap(queue.begin(), queue.end(), later);
+        auto piece = queue.back();
+        queue.pop_back();
+        auto defs = piece->defs;
+        for (auto &def:defs) Remove(_defs, def.first, piece);
+        Parse(piece);
+        for (auto &def:piece->defs) Insert(_defs[def.first], piece);
+        for (auto &def:defs) users(def.first, piece->index + 1);
+        for (auto &def:piece->defs) users(def.first, piece->index + 1);
+        parsed.push_back(piece);
+    }
+
+    // Resolve: when the global slots taken by the new pieces differ, the
+    // slots of all the later globals move, they are resolved again on demand.
+    // A piece with errors is not, nor any after it, until they are fixed.
+    if (first < _unresolved) {
+        auto base = first > 0 ? _pieces[first - 1]->slotBase + _pieces[first - 1]->slots : 0;
+        auto regionBase = base;
+        auto i = first;
+        for (; i < first + count && _pieces[i]->errors == 0; ++i) {
+            Resolve(_pieces[i], base);
+            base += _pieces[i]->slots;
+        }
+        if (i < first + count) {
+            _unresolved = i;
+        } else if (base - regionBase != droppedSlots && first + count < _pieces.size()) {
+            _unresolved = first + count;
+        }
+        for (auto piece:parsed) {
+            if (piece->errors > 0) _unresolved = std::min(_unresolved, piece->index);
+            if (piece->index >= first + count && piece->index < _unresolved) Resolve(piece, piece->slotBase);
+        }
+    }
+    Invalidate();
+}
+
+void Document::ResolveRest() {
+    if (_unresolved >= _pieces.size()) return;
+    auto base = _unresolved > 0 ? _pieces[_unresolved - 1]->slotBase + _pieces[_unresolved - 1]->slots : 0;
+    for (auto i = _unresolved; i < _pieces.size(); ++i) {
+        Resolve(_pieces[i], base);
+        base += _pieces[i]->slots;
+    }
+    _unresolved = SIZE_MAX;
+}
+
+void Document::Parse(Piece *piece) {
+    Settle(piece);
+    delete piece->parser;
+    auto parser = piece->parser = new Parser(piece->ts, nullptr, false, kPieceBlock);
+    std::vector<std::pair<Var *, const Token *>> globals;
+    {
+        ArenaGuard guard(parser->_arena);
+        parser->_program = Program::New();  // the globals visible from the piece
+        for (auto name:piece->names) {
+            if (auto var = Global(name, piece->index)) {
+                parser->_program->scope->Insert(name, var);
+                globals.emplace_back(var, var->GetRoot());
+            }
+        }
+    }
+    auto errors = Diagnostics::Current()->Errors();
+    parser->ParseChunk();
+    parser->_sema.Run(parser->_program);
+    piece->errors = Diagnostics::Current()->Errors() - errors;
+    for (auto &global:globals) {
+        global.first->SetTok(global.second);  // found here, but it stays on the tokens of its piece
+    }
+    piece->defs.clear();
+    for (auto stmt:parser->_stmts) {
+        Var *var = stmt->kind == Stmt::VarAssignStmt ? stmt->var :
+                   stmt->kind == Stmt::FuncAssignStmt ? stmt->func : nullptr;
+        if (var == nullptr) continue;
+        auto def = std::find_if(piece->defs.begin(), piece->defs.end(),
+                                [var](const std::pair<Symbol, Var *> &d) { return d.first == var->name; });
+        if (def != piece->defs.end()) {
+            def->second = var;
+        } else {
+            piece->defs.emplace_back(var->name, var);
+        }
+    }
+    ++_stats.reparsed;
+}
+
+void Document::Resolve(Piece *piece, int base) {
+    auto &stmts = piece->parser->_stmts;
+    auto index = piece->index;
+    Resolver resolver;
+    auto end = resolver.Resolve(stmts.data(), stmts.size(), base,
+                                [this, index](Symbol name) { return Global(name, index); });
+    piece->slotBase = base;
+    piece->slots = end - base;
+    piece->tree = FlatTree();
+    piece->roots.clear();
+    for (auto stmt:stmts) {
+        piece->roots.push_back(stmt->Flatten(&piece->tree));
+    }
+    ++_stats.resolved;
+}
+
+Var *Document::Global(Symbol name, size_t index) const {
+    auto found = _defs.find(name);
+    if (found == _defs.end()) return nullptr;
+    auto &pieces = const_cast<std::vector<Piece *> &>(found->second);
+    auto it = Tail(pieces, index);
+    return it == pieces.begin() ? nullptr : (*--it)->Def(name);
+}
+
+void Document::Settle(Piece *piece) {
+    auto line = _lines[piece->index];
+    auto delta = (int) line - (int) piece->lexedLine;
+    if (delta == 0) return;
+    auto list = piece->region->ts.GetList();
+    for (auto i = piece->first; i < piece->last; ++i) {
+        const_cast<Token *>(list->tokens[i])->loc.line += delta;  // the tokens are ours
+    }
+    piece->lexedLine = line;
+}
+
+void Document::Invalidate() {
+    _treeDirty = true;
+    _programDirty = true;
+}
+
+Program *Document::GetProgram() {
+    if (Errors() > 0) return nullptr;
+    if (!_programDirty) return _program;
+    ResolveRest();
+    ArenaGuard guard(&_arena);
+    if (_program == nullptr) _program = Program::New();
+    _program->stmtList->clear();
+    int slots = 0;
+    for (auto piece:_pieces) {
+        for (auto stmt:piece->parser->_stmts) _program->stmtList->push_back(stmt);
+        slots += piece->slots;
+    }
+    _program->frameSize = slots;
+    _programDirty = false;
+    return _program;
+}
+
+const FlatTree *Document::GetTree() {
+    if (!_treeDirty || Errors() > 0) return _tree;
+    ResolveRest();
+    delete _tree;
+    _tree = new FlatTree;
+    std::vector<FlatTree::NodeId> stmts;
+    for (auto piece:_pieces) {
+        Settle(piece);
+        auto base = _tree->Join(piece->tree);
+        for (auto root:piece->roots) stmts.push_back(root + base);
+    }
+    _tree->Add(FlatTree::N_Program, nullptr, Type::Unknown, stmts.data(), stmts.size());
+    _treeDirty = false;
+    return _tree;
+}
+
+void DocumentStats::Print(FILE *out) const {
+    fprintf(out, "document stats: %zu edits %zu bytes relexed %zu reparsed %zu resolved\n",
+            edits, relexed, reparsed, resolved);
+}
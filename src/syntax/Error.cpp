@@ -1,31 +1,44 @@
 #ifndef LEOML_ERROR_H
 #define LEOML_ERROR_H
 
+#include "syntax/Diagnostics.h"
 #include "syntax/Token.h"
+#include <cassert>
 #include <cstdlib>
 #include <cstdio>
 #include <cstdarg>
+#include <string>
 
 #define ANSI_COLOR_RED     "\x1b[31m"
 #define ANSI_COLOR_GREEN   "\x1b[32m"
 #define ANSI_COLOR_BLUE    "\x1b[34m"
 #define ANSI_COLOR_RESET   "\x1b[0m"
 
-// Template of CompileError
-static void TCompileError(const SourceLocation &loc,
-                          const char *format,
-                          va_list args) {
+// Format the error as it is printed: the location, the message, the line and a caret.
+static std::string TFormatError(const SourceLocation &loc,
+                                const char *format,
+                                va_list args) {
     assert(loc.filename);
-    fprintf(stderr,
-            "%s:%d:%d: "
-            ANSI_COLOR_RED
-            "error: "
-            ANSI_COLOR_RESET,
-            loc.filename->c_str(),
-            loc.line,
-            loc.column);
-    vfprintf(stderr, format, args);
-    fprintf(stderr, "\n    ");
+    char head[512];
+    snprintf(head, sizeof(head),
+             "%s:%d:%d: "
+             ANSI_COLOR_RED
+             "error: "
+             ANSI_COLOR_RESET,
+             loc.filename->c_str(),
+             loc.line,
+             loc.column);
+    std::string text = head;
+    va_list copy;
+    va_copy(copy, args);
+    auto size = vsnprintf(nullptr, 0, format, copy);
+    va_end(copy);
+    if (size > 0) {
+        std::string message(size, '\0');
+        vsnprintf(&message[0], size + 1, format, args);
+        text += message;
+    }
+    text += "\n    ";
 
     bool sawNoSpace = false;
     int nspaces = 0;
@@ -34,31 +47,53 @@ static void TCompileError(const SourceLocation &loc,
             ++nspaces;
         } else {
             sawNoSpace = true;
-            fputc(*p, stderr);
+            text += *p;
         }
     }
 
-    fprintf(stderr, "\n    ");
+    text += "\n    ";
     for (unsigned i = 1; i + nspaces < loc.column; ++i)
-        fputc(' ', stderr);
-    fprintf(stderr, ANSI_COLOR_GREEN
-                    "^\n"
-                    ANSI_COLOR_RESET);
+        text += ' ';
+    text += ANSI_COLOR_GREEN
+            "^\n"
+            ANSI_COLOR_RESET;
+    return text;
+}
+
+// Template of CompileError: report to the current Diagnostics, else print and abort.
+static void TCompileError(const SourceLocation &loc,
+                          const char *format,
+                          va_list args) {
+    auto text = TFormatError(loc, format, args);
+    if (auto diags = Diagnostics::Current()) {
+        diags->Report(loc, std::move(text));
+        return;
+    }
+    fputs(text.c_str(), stderr);
     std::abort();
 }
 
-void CompileError(const SourceLocation &loc, const char *format, ...) {
+[[noreturn]] void CompileError(const SourceLocation &loc, const char *format, ...) {
     va_list args;
     va_start(args, format);
     TCompileError(loc, format, args);
     va_end(args);
+    throw Diagnostics::Recovery{nullptr};
 }
 
-void CompileError(const Token *tok, const char *format, ...) {
+[[noreturn]] void CompileError(const Token *tok, const char *format, ...) {
     va_list args;
     va_start(args, format);
     TCompileError(tok->loc, format, args);
     va_end(args);
+    throw Diagnostics::Recovery{tok};
+}
+
+void ReportError(const SourceLocation &loc, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    TCompileError(loc, format, args);
+    va_end(args);
 }
 
 #endif // LEOML_ERROR_H
\ No newline at end of file
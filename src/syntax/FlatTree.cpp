@@ -0,0 +1,818 @@
+#include "syntax/FlatTree.h"
+#include "syntax/ParseTree.h"
+#include "syntax/OutBuffer.h"
+#include "syntax/Error.h"
+#include "syntax/ThreadPool.h"
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+
+const FlatTree::NodeId FlatTree::kNoNode;
+
+FlatTree *FlatTree::Build(Program *program) {
+    auto tree = new FlatTree;
+    program->Flatten(tree);
+    return tree;
+}
+
+FlatTree *FlatTree::Build(Program *program, ThreadPool *pool) {
+    auto &stmts = *program->stmtList;
+    size_t nparts = pool->Size() * 4;
+    if (nparts > stmts.size()) nparts = stmts.size();
+    if (nparts < 2) return Build(program);
+    std::vector<FlatTree> parts(nparts);
+    std::vector<std::vector<NodeId>> roots(nparts);
+    for (size_t p = 0; p < nparts; ++p) {
+        pool->Submit([&stmts, &parts, &roots, p, nparts] {
+            auto end = stmts.size() * (p + 1) / nparts;
+            for (auto i = stmts.size() * p / nparts; i < end; ++i) {
+                roots[p].push_back(stmts[i]->Flatten(&parts[p]));
+            }
+        });
+    }
+    pool->Wait();
+    auto tree = new FlatTree;
+    std::vector<NodeId> all;
+    all.reserve(stmts.size());
+    for (size_t p = 0; p < nparts; ++p) {
+        auto base = tree->Join(parts[p]);
+        for (auto root:roots[p]) all.push_back(root + base);
+    }
+    tree->Add(N_Program, nullptr, Type::Unknown, all.data(), all.size());
+    return tree;
+}
+
+template<typename T>
+static void Extend(std::vector<T> &column, const std::vector<T> &other) {
+    column.insert(column.end(), other.begin(), other.end());
+}
+
+FlatTree::NodeId FlatTree::Join(const FlatTree &other) {
+    auto base = (NodeId) kind.size();
+    auto childBase = (uint32_t) children.size();
+    auto charBase = (uint32_t) chars.size();
+    auto sigBase = (uint32_t) sigs.size();
+    Extend(kind, other.kind);
+    Extend(type, other.type);
+    Extend(tag, other.tag);
+    Extend(depth, other.depth);
+    Extend(slot, other.slot);
+    Extend(name, other.name);
+    Extend(count, other.count);
+    Extend(token, other.token);
+    Extend(line, other.line);
+    Extend(column, other.column);
+    for (auto offset:other.first) first.push_back(offset + childBase);
+    for (NodeId id = 0; id < other.Size(); ++id) {
+        auto value = other.aux[id];
+        if (other.kind[id] == N_Constant && other.tag[id] == Token::String) value += charBase;
+        if (other.kind[id] == N_Func) value += sigBase;
+        aux.push_back(value);
+    }
+    for (auto child:other.children) children.push_back(child == kNoNode ? child : child + base);
+    Extend(chars, other.chars);
+    Extend(sigs, other.sigs);
+    return base;
+}
+
+FlatTree::NodeId FlatTree::Add(Kind k, const Token *root, Type::Id t, const NodeId *nodes, size_t n) {
+    auto id = (NodeId) kind.size();
+    kind.push_back(k);
+    type.push_back(t);
+    tag.push_back(0);
+    depth.push_back(-1);
+    slot.push_back(-1);
+    name.push_back(Symbol());
+    first.push_back((uint32_t) children.size());
+    count.push_back((uint32_t) n);
+    aux.push_back(0);
+    token.push_back(root);
+    children.insert(children.end(), nodes, nodes + n);
+    return id;
+}
+
+uint32_t FlatTree::AddChars(const char *data, size_t size) {
+    auto offset = (uint32_t) chars.size();
+    chars.insert(chars.end(), data, data + size);
+    chars.push_back(0);
+    return offset;
+}
+
+uint32_t FlatTree::AddSig(const std::vector<int8_t> &sig) {
+    auto offset = (uint32_t) sigs.size();
+    sigs.insert(sigs.end(), sig.begin(), sig.end());
+    return offset;
+}
+
+template<typename T>
+static size_t ColumnBytes(const std::vector<T> &column) { return column.capacity() * sizeof(T); }
+
+size_t FlatTree::Bytes() const {
+    return ColumnBytes(kind) + ColumnBytes(type) + ColumnBytes(tag) + ColumnBytes(depth) +
+           ColumnBytes(slot) + ColumnBytes(name) + ColumnBytes(first) + ColumnBytes(count) +
+           ColumnBytes(aux) + ColumnBytes(token) + ColumnBytes(line) + ColumnBytes(column) +
+           ColumnBytes(children) + ColumnBytes(chars) + ColumnBytes(sigs);
+}
+
+static const uint32_t kImageMagic = 0x54464d4c;  // "LMFT"
+
+/// ImageHeader
+// Counts of the image, the columns follow in the order of the header, each
+// padded to 8 bytes. The magic read back in the wrong byte order misses.
+struct ImageHeader {
+    uint32_t magic;
+    uint32_t nodes;
+    uint32_t children;
+    uint32_t chars;
+    uint32_t sigs;
+    uint32_t names;  // in the table, after the columns, as NUL terminated texts
+    uint32_t types;  // words of the table of the types, after the pools
+};
+
+// Count of children by kind, -1 for any.
+static const int kArity[] = {-1, 1, 2, 1, -1, 0, -1, -1, 0, 2, 1, 2, 2, 2, 2, 3, 2, -1};
+
+// Whether the node has the children the Printer and the passes read: the
+// count of its kind, and kNoNode only where a child is optional.
+static bool Shaped(const FlatTree &t, FlatTree::NodeId id) {
+    auto n = t.count[id];
+    auto arity = kArity[t.kind[id]];
+    if (arity >= 0 && n != (uint32_t) arity) return false;
+    auto child = t.ChildBegin(id);
+    for (uint32_t i = 0; i < n; ++i) {
+        if (child[i] != FlatTree::kNoNode) continue;
+        bool optional = (t.kind[id] == FlatTree::N_Exp && i == 0) ||
+                        (t.kind[id] == FlatTree::N_Func && i + 1 == n) ||
+                        (t.kind[id] == FlatTree::N_If && i == 2) ||
+                        (t.kind[id] == FlatTree::N_Let && i % 2 == 1);
+        if (!optional) return false;
+    }
+    switch (t.kind[id]) {
+        case FlatTree::N_Exp:
+            return n >= 1;
+        case FlatTree::N_Func:
+            return t.tag[id] >= 0 && n == (uint32_t) t.tag[id] + 1;
+        case FlatTree::N_Let:
+            return n % 2 == 1;
+        default:
+            return true;
+    }
+}
+
+/// TypeIndex
+// The index of the type in the table of the image, its args added before it.
+// An entry is [kind, nargs, args...], the args are indices but the number of
+// a variable.
+static uint32_t TypeIndex(Type::Id id, std::unordered_map<Type::Id, uint32_t> &index, std::vector<uint32_t> &table) {
+    auto found = index.find(id);
+    if (found != index.end()) return found->second;
+    auto &type = Type::Get(id);
+    std::vector<uint32_t> args;
+    for (uint32_t i = 0; i < type.nargs; ++i)
+        args.push_back(type.kind == Type::T_Var ? type.args[i] : TypeIndex(type.args[i], index, table));
+    table.push_back((uint32_t) type.kind);
+    table.push_back(type.nargs);
+    table.insert(table.end(), args.begin(), args.end());
+    return index.emplace(id, (uint32_t) index.size()).first->second;
+}
+
+/// ReadTypes
+// Intern the types of the table, false if it is corrupt.
+static bool ReadTypes(const std::vector<uint32_t> &table, std::vector<Type::Id> &types) {
+    for (size_t i = 0; i < table.size();) {
+        if (table.size() - i < 2 || table[i + 1] > table.size() - i - 2) return false;
+        auto kind = (int) table[i];
+        auto nargs = table[i + 1];
+        auto args = table.data() + i + 2;
+        i += 2 + nargs;
+        std::vector<Type::Id> ids;
+        for (uint32_t j = 0; j < nargs && kind != Type::T_Var; ++j) {
+            if (args[j] >= types.size()) return false;
+            ids.push_back(types[args[j]]);
+        }
+        if (kind == Type::T_Func && nargs >= 1) {
+            types.push_back(Type::Function(ids.data(), nargs - 1, ids.back()));
+        } else if (kind == Type::T_Pair && nargs == 2) {
+            types.push_back(Type::Pair(ids[0], ids[1]));
+        } else if (kind == Type::T_Var && nargs == 1) {
+            types.push_back(Type::Variable(args[0]));
+        } else if (nargs == 0 && kind >= Type::T_Int && kind <= Type::T_Unit) {
+            types.push_back((Type::Id) kind);  // the ids of the primitives are their kinds
+        } else if (nargs == 0 && (kind == Type::T_String || kind == Type::T_Unknown)) {
+            types.push_back(kind == Type::T_String ? Type::String : Type::Unknown);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename T>
+static void WriteColumn(std::ostream &os, const T *data, size_t size) {
+    static const char pad[8] = {};
+    os.write((const char *) data, size * sizeof(T));
+    os.write(pad, -(size * sizeof(T)) & 7);
+}
+
+template<typename T>
+static bool ReadColumn(std::vector<T> &column, size_t size, const char *&p, const char *end) {
+    auto bytes = size * sizeof(T), padded = (bytes + 7) & ~(size_t) 7;
+    if ((size_t) (end - p) < padded) return false;
+    column.resize(size);
+    if (bytes != 0) memcpy(column.data(), p, bytes);  // data() of an empty column may be null
+    p += padded;
+    return true;
+}
+
+void FlatTree::Write(std::ostream &os) const {
+    // index 0 is the empty name, the tag bit is kept
+    std::unordered_map<uint32_t, uint32_t> index{{0, 0}};
+    std::vector<Symbol> table{Symbol()};
+    std::vector<uint32_t> names(Size());
+    for (NodeId id = 0; id < Size(); ++id) {
+        auto untagged = name[id].Untag();
+        auto found = index.find(untagged.Id());
+        if (found == index.end()) {
+            found = index.emplace(untagged.Id(), (uint32_t) table.size()).first;
+            table.push_back(untagged);
+        }
+        names[id] = found->second | (name[id].IsTag() ? Symbol::kTagBit : 0);
+    }
+    std::unordered_map<Type::Id, uint32_t> typeIndex;
+    std::vector<uint32_t> typeTable, types(Size());
+    for (NodeId id = 0; id < Size(); ++id) {
+        types[id] = TypeIndex(type[id], typeIndex, typeTable);
+    }
+    // the root tokens as their places in the source, those of a read tree kept
+    std::vector<uint32_t> lines(Size()), columns(Size());
+    for (NodeId id = 0; id < Size(); ++id) {
+        if (token[id]) {
+            lines[id] = token[id]->loc.line;
+            columns[id] = token[id]->loc.column;
+        } else if (id < line.size()) {
+            lines[id] = line[id];
+            columns[id] = column[id];
+        }
+    }
+    ImageHeader header{kImageMagic, (uint32_t) Size(), (uint32_t) children.size(), (uint32_t) chars.size(),
+                       (uint32_t) sigs.size(), (uint32_t) table.size(), (uint32_t) typeTable.size()};
+    WriteColumn(os, &header, 1);
+    WriteColumn(os, kind.data(), Size());
+    WriteColumn(os, types.data(), Size());
+    WriteColumn(os, tag.data(), Size());
+    WriteColumn(os, depth.data(), Size());
+    WriteColumn(os, slot.data(), Size());
+    WriteColumn(os, names.data(), Size());
+    WriteColumn(os, first.data(), Size());
+    WriteColumn(os, count.data(), Size());
+    WriteColumn(os, aux.data(), Size());
+    WriteColumn(os, lines.data(), Size());
+    WriteColumn(os, columns.data(), Size());
+    WriteColumn(os, children.data(), children.size());
+    WriteColumn(os, chars.data(), chars.size());
+    WriteColumn(os, sigs.data(), sigs.size());
+    WriteColumn(os, typeTable.data(), typeTable.size());
+    for (auto symbol:table) os.write(symbol.data(), symbol.size() + 1);
+}
+
+FlatTree *FlatTree::Read(const char *data, size_t size) {
+    ImageHeader header{};
+    if (size < sizeof(header)) return nullptr;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != kImageMagic || header.nodes == 0 || header.names == 0) return nullptr;
+    auto p = data + ((sizeof(header) + 7) & ~(size_t) 7), end = data + size;
+    std::unique_ptr<FlatTree> tree(new FlatTree);
+    std::vector<uint32_t> names, types, typeTable;
+    auto n = header.nodes;
+    if (!ReadColumn(tree->kind, n, p, end) || !ReadColumn(types, n, p, end) ||
+        !ReadColumn(tree->tag, n, p, end) || !ReadColumn(tree->depth, n, p, end) ||
+        !ReadColumn(tree->slot, n, p, end) || !ReadColumn(names, n, p, end) ||
+        !ReadColumn(tree->first, n, p, end) || !ReadColumn(tree->count, n, p, end) ||
+        !ReadColumn(tree->aux, n, p, end) || !ReadColumn(tree->line, n, p, end) ||
+        !ReadColumn(tree->column, n, p, end) || !ReadColumn(tree->children, header.children, p, end) ||
+        !ReadColumn(tree->chars, header.chars, p, end) || !ReadColumn(tree->sigs, header.sigs, p, end) ||
+        !ReadColumn(typeTable, header.types, p, end))
+        return nullptr;
+    if (header.names > (size_t) (end - p)) return nullptr;  // a NUL each at least
+    std::vector<Symbol> table;
+    table.reserve(header.names);
+    while (table.size() < header.names && p < end) {
+        auto len = strnlen(p, end - p);
+        if (len == (size_t) (end - p)) return nullptr;
+        table.push_back(table.empty() ? Symbol() : Symbol::Intern(p, len));
+        p += len + 1;
+    }
+    if (table.size() < header.names) return nullptr;
+    std::vector<Type::Id> typeIds;
+    if (!ReadTypes(typeTable, typeIds)) return nullptr;
+    tree->type.resize(n);
+    // Checked so that a corrupt image is a miss, not a crash of the passes.
+    tree->name.resize(n);
+    for (NodeId id = 0; id < n; ++id) {
+        auto i = names[id] & ~Symbol::kTagBit;
+        if (i >= table.size() || tree->kind[id] > N_Let) return nullptr;
+        tree->name[id] = names[id] & Symbol::kTagBit ? table[i].Tag() : table[i];
+        if (types[id] >= typeIds.size()) return nullptr;
+        tree->type[id] = typeIds[types[id]];
+        if (tree->first[id] > header.children || tree->count[id] > header.children - tree->first[id] ||
+            !Shaped(*tree, id))
+            return nullptr;
+        if ((tree->kind[id] == N_Binary || tree->kind[id] == N_Unary) && !Token::TagLookup(tree->tag[id]))
+            return nullptr;
+        for (auto child = tree->ChildBegin(id); child != tree->ChildEnd(id); ++child) {
+            if (*child != kNoNode && *child >= id) return nullptr;
+        }
+        auto aux = tree->aux[id];
+        if (tree->kind[id] == N_Constant && tree->tag[id] == Token::String &&
+            (aux >= header.chars || memchr(&tree->chars[aux], 0, header.chars - aux) == nullptr))
+            return nullptr;
+        if (tree->kind[id] == N_Func &&
+            (aux >= header.sigs || tree->sigs[aux] < 0 || (uint32_t) tree->sigs[aux] + 2 > header.sigs - aux))
+            return nullptr;
+    }
+    if (tree->kind[n - 1] != N_Program) return nullptr;
+    tree->token.assign(n, nullptr);
+    return tree.release();
+}
+
+bool FlatTree::Locate(NodeId id, SourceLocation &loc) const {
+    if (_text == nullptr || id >= line.size() || line[id] == 0 || column[id] == 0) return false;
+    auto p = _text, end = _text + _textSize;
+    for (uint32_t i = 1; i < line[id]; ++i) {
+        p = (const char *) memchr(p, '\n', end - p);
+        if (p == nullptr) return false;
+        ++p;
+    }
+    auto eol = (const char *) memchr(p, '\n', end - p);
+    if (column[id] > (size_t) ((eol ? eol : end) - p) + 1) return false;
+    loc = SourceLocation{_filename, p, line[id], column[id]};
+    return true;
+}
+
+/// Flatten
+// Lower a node after its children, so that ids come in post-order.
+
+void Program::Flatten(FlatTree *tree) {
+    std::vector<FlatTree::NodeId> stmts;
+    for (auto stmt:*stmtList) {
+        stmts.push_back(stmt->Flatten(tree));
+    }
+    tree->Add(FlatTree::N_Program, nullptr, Type::Unknown, stmts.data(), stmts.size());
+}
+
+FlatTree::NodeId Stmt::Flatten(FlatTree *tree) {
+    switch (kind) {
+        case VarStmt:
+            return tree->Add(FlatTree::N_VarStmt, nullptr, Type::Unknown, {var->Flatten(tree)});
+        case VarAssignStmt: {
+            auto lhs = var->Flatten(tree);
+            auto rhs = exp->Flatten(tree);
+            return tree->Add(FlatTree::N_VarAssignStmt, nullptr, Type::Unknown, {lhs, rhs});
+        }
+        case FuncAssignStmt:
+            return tree->Add(FlatTree::N_FuncAssignStmt, nullptr, Type::Unknown, {func->Flatten(tree)});
+        default:
+            CompilePanic("unreachable");
+            return FlatTree::kNoNode;
+    }
+}
+
+FlatTree::NodeId Exp::Flatten(FlatTree *tree) {
+    std::vector<FlatTree::NodeId> nodes;
+    nodes.push_back(var != nullptr ? var->Flatten(tree) : FlatTree::kNoNode);
+    for (auto expb:*expbList) {
+        nodes.push_back(expb->Flatten(tree));
+    }
+    return tree->Add(FlatTree::N_Exp, _root, _type, nodes.data(), nodes.size());
+}
+
+FlatTree::NodeId Var::Flatten(FlatTree *tree) {
+    auto id = tree->Add(FlatTree::N_Var, _root, _type, {});
+    tree->name[id] = name;
+    tree->depth[id] = depth;
+    tree->slot[id] = slot;
+    return id;
+}
+
+FlatTree::NodeId Func::Flatten(FlatTree *tree) {
+    std::vector<FlatTree::NodeId> nodes;
+    for (auto param:*paramList) {
+        nodes.push_back(param->Flatten(tree));
+    }
+    nodes.push_back(body != nullptr ? body->Flatten(tree) : FlatTree::kNoNode);
+    auto &type = Type::Get(Signature());
+    std::vector<int8_t> sig{(int8_t) type.Params()};
+    for (size_t i = 0; i < type.Params(); ++i) {
+        sig.push_back((int8_t) Type::KindOf(type.args[i]));
+    }
+    sig.push_back((int8_t) Type::KindOf(*ret));
+    auto id = tree->Add(FlatTree::N_Func, _root, _type, nodes.data(), nodes.size());
+    tree->tag[id] = (int16_t) paramList->size();
+    tree->name[id] = name;
+    tree->depth[id] = depth;
+    tree->slot[id] = slot;
+    tree->aux[id] = tree->AddSig(sig);
+    return id;
+}
+
+FlatTree::NodeId FuncCall::Flatten(FlatTree *tree) {
+    std::vector<FlatTree::NodeId> nodes;
+    for (auto arg:*argList) {
+        nodes.push_back(arg->Flatten(tree));
+    }
+    auto id = tree->Add(FlatTree::N_FuncCall, _root, _type, nodes.data(), nodes.size());
+    tree->name[id] = name;
+    tree->depth[id] = depth;
+    tree->slot[id] = slot;
+    return id;
+}
+
+FlatTree::NodeId ExpaConstant::Flatten(FlatTree *tree) {
+    auto id = tree->Add(FlatTree::N_Constant, _root, _type, {});
+    tree->tag[id] = (int16_t) _root->tag;
+    switch (_root->tag) {
+        case Token::Int:
+            tree->aux[id] = (uint32_t) _ival;
+            break;
+        case Token::Float:
+            memcpy(&tree->aux[id], &_fval, sizeof(_fval));
+            break;
+        case Token::Bool:
+            tree->aux[id] = _bval;
+            break;
+        case Token::String:
+            tree->aux[id] = tree->AddChars(_sval.data(), _sval.size());
+            break;
+        default:
+            break;
+    }
+    return id;
+}
+
+FlatTree::NodeId ExpbBinary::Flatten(FlatTree *tree) {
+    SmallVec<ExpbBinary *> spine;
+    auto id = Spine(spine)->Flatten(tree);
+    for (auto p = spine.end(); p != spine.begin();) {
+        auto binary = *--p;
+        auto rhs = binary->_rhs->Flatten(tree);
+        id = tree->Add(FlatTree::N_Binary, binary->_root, binary->_type, {id, rhs});
+        tree->tag[id] = (int16_t) binary->_op;
+    }
+    return id;
+}
+
+FlatTree::NodeId ExpbUnary::Flatten(FlatTree *tree) {
+    auto id = tree->Add(FlatTree::N_Unary, _root, _type, {_oprand->Flatten(tree)});
+    tree->tag[id] = (int16_t) _op;
+    return id;
+}
+
+FlatTree::NodeId ExpbCons::Flatten(FlatTree *tree) {
+    auto first = _first->Flatten(tree);
+    auto second = _second->Flatten(tree);
+    return tree->Add(FlatTree::N_Cons, _root, _type, {first, second});
+}
+
+FlatTree::NodeId ExpbCompound::Flatten(FlatTree *tree) {
+    auto first = _first->Flatten(tree);
+    auto second = _second->Flatten(tree);
+    return tree->Add(FlatTree::N_Compound, _root, _type, {first, second});
+}
+
+FlatTree::NodeId ExpbFst::Flatten(FlatTree *tree) {
+    auto first = _first->Flatten(tree);
+    auto second = _second->Flatten(tree);
+    return tree->Add(FlatTree::N_Fst, _root, _type, {first, second});
+}
+
+FlatTree::NodeId ExpbSnd::Flatten(FlatTree *tree) {
+    auto first = _first->Flatten(tree);
+    auto second = _second->Flatten(tree);
+    return tree->Add(FlatTree::N_Snd, _root, _type, {first, second});
+}
+
+FlatTree::NodeId ExpaIf::Flatten(FlatTree *tree) {
+    auto cond = _cond->Flatten(tree);
+    auto then = _then->Flatten(tree);
+    auto els = _els != nullptr ? _els->Flatten(tree) : FlatTree::kNoNode;
+    return tree->Add(FlatTree::N_If, _root, _type, {cond, then, els});
+}
+
+FlatTree::NodeId ExpaWhile::Flatten(FlatTree *tree) {
+    auto cond = _cond->Flatten(tree);
+    auto body = _body->Flatten(tree);
+    return tree->Add(FlatTree::N_While, _root, _type, {cond, body});
+}
+
+FlatTree::NodeId ExpaLet::Flatten(FlatTree *tree) {
+    std::vector<FlatTree::NodeId> nodes;
+    for (auto &item:*expPairList) {
+        nodes.push_back(item.first->Flatten(tree));
+        nodes.push_back(item.second != nullptr ? item.second->Flatten(tree) : FlatTree::kNoNode);
+    }
+    nodes.push_back(body->Flatten(tree));
+    return tree->Add(FlatTree::N_Let, _root, _type, nodes.data(), nodes.size());
+}
+
+/// Printer
+// Program::Serialize of the flat tree.
+class FlatTree::Printer : public TreeWriter {
+public:
+    Printer(const FlatTree &tree, OutBuffer &out) : TreeWriter(out), _tree(tree) {}
+
+    void Print(NodeId id);
+
+private:
+    const FlatTree &_tree;
+
+    NodeId Child(NodeId id, size_t i) const { return _tree.ChildBegin(id)[i]; }
+
+    void PrintPair(NodeId id, const char *what, const char *first, const char *second) {
+        _out << what;
+        ILT();
+        _out << first;
+        ILT();
+        Print(Child(id, 0));
+        DEC();
+        LT();
+        _out << second;
+        ILT();
+        Print(Child(id, 1));
+        DEC();
+        DEC();
+    }
+
+    void PrintExp(NodeId id);
+
+    void PrintBinary(NodeId id);
+
+    void PrintFunc(NodeId id);
+
+    void PrintConstant(NodeId id);
+};
+
+void FlatTree::Printer::Print(NodeId id) {
+    auto &t = _tree;
+    switch (t.kind[id]) {
+        case N_Program:
+            _out << "+ program";
+            INC();
+            for (auto p = t.ChildBegin(id); p != t.ChildEnd(id); ++p) {
+                LT();
+                Print(*p);
+            }
+            DEC();
+            break;
+        case N_VarStmt:
+            _out << "+ var single";
+            ILT();
+            Print(Child(id, 0));
+            DEC();
+            break;
+        case N_VarAssignStmt:
+            _out << "+ var define";
+            ILT();
+            _out << "+ left value";
+            ILT();
+            Print(Child(id, 0));
+            DEC();
+            LT();
+            _out << "+ right value";
+            ILT();
+            Print(Child(id, 1));
+            DEC();
+            DEC();
+            break;
+        case N_FuncAssignStmt:
+            Print(Child(id, 0));
+            break;
+        case N_Exp:
+            PrintExp(id);
+            break;
+        case N_Var:
+            _out << "| var";
+            _out << "  name: " << t.name[id];
+            _out << "  type: " << Type::KindName(Type::KindOf(t.type[id]));
+            break;
+        case N_Func:
+            PrintFunc(id);
+            break;
+        case N_FuncCall:
+            _out << "+ func call";
+            _out << "  name:  " << t.name[id];
+            ILT();
+            _out << "+ arg list";
+            INC();
+            for (auto p = t.ChildBegin(id); p != t.ChildEnd(id); ++p) {
+                LT();
+                Print(*p);
+            }
+            DEC();
+            DEC();
+            break;
+        case N_Constant:
+            PrintConstant(id);
+            break;
+        case N_Binary:
+            PrintBinary(id);
+            break;
+        case N_Unary:
+            _out << "+ expbUnary";
+            ILT();
+            _out << "| op  " << Token::TagLookup(t.tag[id]);
+            LT();
+            _out << "+ oprand";
+            ILT();
+            Print(Child(id, 0));
+            DEC();
+            DEC();
+            break;
+        case N_Cons:
+            PrintPair(id, "+ expbCons", "+ first element", "+ second element");
+            break;
+        case N_Compound:
+            PrintPair(id, "+ expbCompound", "+ first clause", "+ second clause");
+            break;
+        case N_Fst:
+            PrintPair(id, "+ expbFst", "+ first element", "+ second element");
+            break;
+        case N_Snd:
+            PrintPair(id, "+ expbSnd", "+ first element", "+ second element");
+            break;
+        case N_If:
+            _out << "+ expaIf";
+            ILT();
+            _out << "+ condition expr";
+            LT();
+            Print(Child(id, 0));
+            LT();
+            _out << "+ then expr";
+            LT();
+            Print(Child(id, 1));
+            if (Child(id, 2) != kNoNode) {
+                LT();
+                _out << "+ else expr";
+                LT();
+                Print(Child(id, 2));
+            }
+            DEC();
+            break;
+        case N_While:
+            _out << "+ expaWhile";
+            ILT();
+            _out << "+ condition expr";
+            LT();
+            Print(Child(id, 0));
+            LT();
+            _out << "+ body";
+            LT();
+            Print(Child(id, 1));
+            DEC();
+            break;
+        case N_Let: {
+            _out << "+ expaLet";
+            ILT();
+            _out << "+ exp pairs";
+            INC();
+            auto p = t.ChildBegin(id);
+            for (; p + 1 != t.ChildEnd(id); p += 2) {
+                LT();
+                Print(p[0]);
+                if (p[1] != kNoNode) {
+                    LT();
+                    Print(p[1]);
+                }
+            }
+            DEC();
+            LT();
+            _out << "+ body";
+            ILT();
+            Print(*p);
+            DEC();
+            DEC();
+            break;
+        }
+        default:
+            CompilePanic("unreachable");
+    }
+}
+
+void FlatTree::Printer::PrintExp(NodeId id) {
+    auto &t = _tree;
+    auto p = t.ChildBegin(id);
+    if (*p != kNoNode) {
+        Print(*p);
+    }
+    auto nexpb = t.count[id] - 1;
+    if (nexpb == 0) {}
+    else if (nexpb == 1) {
+        Print(p[1]);
+    } else {
+        LT();
+        _out << "+ expb list";
+        INC();
+        for (++p; p != t.ChildEnd(id); ++p) {
+            LT();
+            Print(*p);
+        }
+        DEC();
+    }
+}
+
+void FlatTree::Printer::PrintBinary(NodeId id) {
+    auto &t = _tree;
+    SmallVec<NodeId> spine;
+    auto first = t.Spine(id, spine);
+    for (auto binary:spine) {
+        _out << "+ expbBinary";
+        _out << "  type: " << Type::KindName(Type::KindOf(t.type[binary]));
+        ILT();
+        _out << "| op  " << Token::TagLookup(t.tag[binary]);
+        LT();
+        _out << "+ lhs";
+        ILT();
+    }
+    Print(first);
+    for (auto p = spine.end(); p != spine.begin();) {
+        auto binary = *--p;
+        DEC();
+        LT();
+        _out << "+ rhs";
+        ILT();
+        Print(Child(binary, 1));
+        DEC();
+        DEC();
+    }
+}
+
+void FlatTree::Printer::PrintFunc(NodeId id) {
+    auto &t = _tree;
+    _out << "+ func define";
+    _out << "  name:  " << t.name[id];
+    _out << "  type: ";
+    auto sig = t.sigs.data() + t.aux[id];
+    if (sig[0] > 0) {
+        for (int i = 1; i <= sig[0]; ++i) {
+            if (i > 1) _out << " * ";
+            _out << Type::KindName(sig[i]);
+        }
+        _out << " -> " << Type::KindName(sig[sig[0] + 1]);
+    }
+    ILT();
+    _out << "+ param list";
+    INC();
+    auto p = t.ChildBegin(id);
+    for (int i = 0; i < t.tag[id]; ++i, ++p) {
+        LT();
+        Print(*p);
+    }
+    DEC();
+    LT();
+    _out << "+ body";
+    if (*p != kNoNode) {
+        ILT();
+        Print(*p);
+        DEC();
+    }
+    DEC();
+}
+
+void FlatTree::Printer::PrintConstant(NodeId id) {
+    auto &t = _tree;
+    _out << "| expaConstant  type: " << Type::KindName(Type::KindOf(t.type[id])) << "  value:  ";
+    switch (t.tag[id]) {
+        case Token::Int:
+            _out << (int) t.aux[id];
+            break;
+        case Token::Float: {
+            float fval;
+            memcpy(&fval, &t.aux[id], sizeof(fval));
+            _out << (double) fval;
+            break;
+        }
+        case Token::Bool:
+            _out << (bool) t.aux[id];
+            break;
+        case Token::String:
+            _out << t.chars.data() + t.aux[id];
+            break;
+        case Token::Unit:
+            _out << "()";
+            break;
+        default:
+            CompilePanic("unreachable expaConstant operator<<");
+    }
+}
+
+void FlatTree::Serialize(std::ostream &os) const {
+    if (auto out = dynamic_cast<OutBuffer *>(os.rdbuf())) {
+        Serialize(*out);
+        return;
+    }
+    OutBuffer out(os);
+    Serialize(out);
+}
+
+void FlatTree::Serialize(OutBuffer &out) const {
+    Printer(*this, out).Print(Root());
+}
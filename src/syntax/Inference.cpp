@@ -0,0 +1,466 @@
+#include "syntax/Inference.h"
+#include "syntax/Diagnostics.h"
+#include "syntax/Error.h"
+#include "syntax/SmallVec.h"
+#include <algorithm>
+
+const uint32_t Inference::kNone;
+const int Inference::kGeneric;
+const uint16_t Inference::kNumeric;
+const uint16_t Inference::kComparable;
+
+Inference::Inference(const FlatTree &tree) : _tree(tree), _types(tree.Size(), kNone) {
+    _terms.reserve(tree.Size() * 2);
+    for (auto id = Type::Int; id <= Type::String; ++id) {
+        NewTerm(Type::KindOf(id), nullptr, 0);
+    }
+}
+
+void Inference::Run() {
+    EnterFrame();
+    Visit(_tree.Root());
+    LeaveFrame();
+}
+
+Type::Id Inference::TypeOf(NodeId id) {
+    if (_types[id] == kNone) return Type::Unknown;
+    std::vector<uint32_t> vars;
+    return Export(_types[id], vars);
+}
+
+void Inference::Serialize(std::ostream &os) {
+    auto root = _tree.Root();
+    for (auto p = _tree.ChildBegin(root); p != _tree.ChildEnd(root); ++p) {
+        auto stmt = *p, bound = *_tree.ChildBegin(stmt);
+        switch (_tree.kind[stmt]) {
+            case FlatTree::N_VarStmt:
+                os << "- : " << Type::Name(TypeOf(bound)) << '\n';
+                break;
+            case FlatTree::N_VarAssignStmt:
+            case FlatTree::N_FuncAssignStmt:
+                os << "val " << _tree.name[bound] << " : " << Type::Name(TypeOf(bound)) << '\n';
+                break;
+            default:
+                CompilePanic("unreachable");
+        }
+    }
+}
+
+/// Terms
+
+uint32_t Inference::NewTerm(int kind, const uint32_t *args, size_t nargs) {
+    auto id = (uint32_t) _terms.size();
+    _terms.push_back({kind, id, (uint32_t) _args.size(), (uint16_t) nargs, 0, 0, _level});
+    _args.insert(_args.end(), args, args + nargs);
+    return id;
+}
+
+uint32_t Inference::NewVar(uint16_t allowed) {
+    auto id = NewTerm(Type::T_Var, nullptr, 0);
+    _terms[id].allowed = allowed;
+    return id;
+}
+
+uint32_t Inference::Find(uint32_t term) {
+    while (_terms[term].parent != term) {
+        auto &link = _terms[term].parent;
+        link = _terms[link].parent;  // halve the path
+        term = link;
+    }
+    return term;
+}
+
+/// Unification
+
+void Inference::Unify(NodeId at, uint32_t actual, uint32_t expected) {
+    auto failure = Unite(actual, expected);
+    if (failure == F_None) return;
+    std::vector<uint32_t> vars;
+    auto expect = Type::Name(Export(expected, vars));
+    auto got = Type::Name(Export(actual, vars));
+    if (failure == F_Recursive) {
+        Error(at, "Recursive type: `" + expect + "` expected, but got `" + got + "`, which contains it");
+    } else {
+        Error(at, "Type `" + expect + "` expected, but got `" + got + "`");
+    }
+}
+
+Inference::Failure Inference::Unite(uint32_t a, uint32_t b) {
+    a = Find(a);
+    b = Find(b);
+    if (a == b) return F_None;
+    auto &ta = _terms[a], &tb = _terms[b];
+    if (ta.kind == Type::T_Var && tb.kind == Type::T_Var) {
+        auto allowed = (uint16_t) (ta.allowed & tb.allowed);
+        if (ta.allowed == 0 || tb.allowed == 0) {
+            allowed = ta.allowed | tb.allowed;
+        } else if (allowed == 0) {
+            return F_Mismatch;
+        }
+        auto &root = ta.rank < tb.rank ? tb : ta, &child = ta.rank < tb.rank ? ta : tb;
+        child.parent = ta.rank < tb.rank ? b : a;
+        if (ta.rank == tb.rank) ++root.rank;
+        root.level = std::min(ta.level, tb.level);
+        root.allowed = allowed;
+        return F_None;
+    }
+    if (ta.kind == Type::T_Var) return Bind(a, b);
+    if (tb.kind == Type::T_Var) return Bind(b, a);
+    if (ta.kind != tb.kind || ta.nargs != tb.nargs) return F_Mismatch;
+    for (size_t i = 0; i < ta.nargs; ++i) {
+        auto failure = Unite(Arg(ta, i), Arg(tb, i));
+        if (failure != F_None) return failure;
+    }
+    return F_None;
+}
+
+Inference::Failure Inference::Bind(uint32_t var, uint32_t term) {
+    auto allowed = _terms[var].allowed;
+    auto kind = _terms[term].kind;
+    if (allowed != 0 && (kind < 0 || kind >= 16 || (allowed & 1 << kind) == 0)) return F_Mismatch;
+    if (Occurs(var, term)) return F_Recursive;
+    _terms[var].parent = term;
+    return F_None;
+}
+
+bool Inference::Occurs(uint32_t var, uint32_t term) {
+    term = Find(term);
+    if (term == var) return true;
+    auto &t = _terms[term];
+    if (t.kind == Type::T_Var) {
+        t.level = std::min(t.level, _terms[var].level);
+        return false;
+    }
+    for (size_t i = 0; i < t.nargs; ++i) {
+        if (Occurs(var, Arg(t, i))) return true;
+    }
+    return false;
+}
+
+/// Schemes
+
+bool Inference::Generalize(uint32_t term) {
+    auto &t = _terms[Find(term)];
+    if (t.kind == Type::T_Var) {
+        if (t.level != kGeneric && t.level > _level) {
+            t.level = t.allowed != 0 ? _level : kGeneric;  // a number stays of the level
+        }
+        return t.level == kGeneric;
+    }
+    bool generic = false;
+    for (size_t i = 0; i < t.nargs; ++i) {
+        generic |= Generalize(Arg(t, i));
+    }
+    return generic;
+}
+
+uint32_t Inference::Instantiate(uint32_t term, std::vector<std::pair<uint32_t, uint32_t>> &fresh) {
+    term = Find(term);
+    auto t = _terms[term];  // a copy, the terms grow
+    if (t.kind == Type::T_Var) {
+        if (t.level != kGeneric) return term;
+        for (auto &pair:fresh) {
+            if (pair.first == term) return pair.second;
+        }
+        auto var = NewVar(t.allowed);
+        fresh.emplace_back(term, var);
+        return var;
+    }
+    if (t.nargs == 0) return term;
+    SmallVec<uint32_t> args;
+    bool copied = false;
+    for (size_t i = 0; i < t.nargs; ++i) {
+        auto arg = Find(Arg(t, i));
+        args.push_back(Instantiate(arg, fresh));
+        copied |= args[i] != arg;
+    }
+    return copied ? NewTerm(t.kind, &args[0], args.size()) : term;
+}
+
+Type::Id Inference::Export(uint32_t term, std::vector<uint32_t> &vars) {
+    term = Find(term);
+    auto t = _terms[term];
+    switch (t.kind) {
+        case Type::T_Var: {
+            if (t.allowed != 0) return Type::Int;
+            auto found = std::find(vars.begin(), vars.end(), term);
+            if (found == vars.end()) found = vars.insert(vars.end(), term);
+            return Type::Variable((uint32_t) (found - vars.begin()));
+        }
+        case Type::T_Func: {
+            SmallVec<Type::Id> params;
+            for (size_t i = 0; i + 1 < t.nargs; ++i) {
+                params.push_back(Export(Arg(t, i), vars));
+            }
+            auto ret = Export(Arg(t, t.nargs - 1), vars);
+            return Type::Function(params.empty() ? nullptr : &params[0], params.size(), ret);
+        }
+        case Type::T_Pair: {
+            auto first = Export(Arg(t, 0), vars);
+            return Type::Pair(first, Export(Arg(t, 1), vars));
+        }
+        default:
+            return term + Type::Int;  // a primitive, see Prim
+    }
+}
+
+/// Frames
+
+void Inference::EnterFrame() {
+    _frames.push_back(_bindings.size());
+}
+
+void Inference::LeaveFrame() {
+    _bindings.resize(_frames.back());
+    _frames.pop_back();
+}
+
+void Inference::Define(int slot, uint32_t term, bool generic) {
+    auto index = _frames.back() + slot;
+    if (index >= _bindings.size()) _bindings.resize(index + 1, {kNone, false});
+    _bindings[index] = {term, generic};
+}
+
+uint32_t Inference::Lookup(NodeId at) {
+    int depth = _tree.depth[at], slot = _tree.slot[at];
+    if (depth < 0 || (size_t) depth >= _frames.size() || slot < 0) Error(at, "undefined var here");
+    auto frame = _frames.size() - 1 - depth;
+    auto index = _frames[frame] + slot;
+    auto end = frame + 1 < _frames.size() ? _frames[frame + 1] : _bindings.size();
+    if (index >= end || _bindings[index].term == kNone) Error(at, "undefined var here");
+    auto &binding = _bindings[index];
+    if (!binding.generic) return binding.term;
+    std::vector<std::pair<uint32_t, uint32_t>> fresh;
+    return Instantiate(binding.term, fresh);
+}
+
+/// Walk
+
+std::pair<uint32_t, bool> Inference::Let(NodeId value) {
+    ++_level;
+    auto term = Visit(value);
+    --_level;
+    return {term, Generalize(term)};
+}
+
+void Inference::VisitStmt(NodeId id) {
+    try {
+        Visit(id);
+    } catch (const Diagnostics::Recovery &) {
+        // out of the frames and the lets of the statement
+        while (_frames.size() > 1) LeaveFrame();
+        _level = 0;
+        if (_tree.kind[id] == FlatTree::N_VarStmt) return;
+        auto any = NewVar();  // the name is of any type for the uses after
+        _terms[any].level = kGeneric;
+        Define(_tree.slot[*_tree.ChildBegin(id)], any, true);
+    }
+}
+
+uint32_t Inference::Func(NodeId id) {
+    // A rec func sees itself in its body, of the one type. The slot is taken
+    // by no other binding, so it is bound early whether rec or not.
+    ++_level;
+    auto self = NewVar();
+    Define(_tree.slot[id], self, false);
+    EnterFrame();
+    SmallVec<uint32_t> args;
+    auto p = _tree.ChildBegin(id);
+    for (int i = 0; i < _tree.tag[id]; ++i, ++p) {
+        auto param = NewVar();
+        Define(_tree.slot[*p], param, false);
+        _types[*p] = param;
+        args.push_back(param);
+    }
+    args.push_back(*p != FlatTree::kNoNode ? Visit(*p) : NewVar());
+    LeaveFrame();
+    auto func = NewTerm(Type::T_Func, &args[0], args.size());
+    Unify(id, self, func);
+    --_level;
+    Define(_tree.slot[id], func, Generalize(func));
+    return func;
+}
+
+uint32_t Inference::Apply(NodeId at, uint32_t func, const NodeId *args, size_t count) {
+    SmallVec<uint32_t> terms;
+    for (size_t i = 0; i < count; ++i) {
+        terms.push_back(Visit(args[i]));
+    }
+    auto &f = _terms[Find(func)];
+    if (f.kind == Type::T_Func) {  // the error at the arg
+        if (f.nargs != count + 1) Error(at, "the count of arguments is unmatched");
+        auto first = f.first;
+        for (size_t i = 0; i < count; ++i) {
+            Unify(args[i], terms[i], _args[first + i]);
+        }
+        return _args[first + count];
+    }
+    auto ret = NewVar();
+    terms.push_back(ret);
+    Unify(at, func, NewTerm(Type::T_Func, &terms[0], terms.size()));
+    return ret;
+}
+
+uint32_t Inference::Visit(NodeId id) {
+    auto term = VisitNode(id);
+    _types[id] = term;
+    return term;
+}
+
+uint32_t Inference::VisitNode(NodeId id) {
+    auto child = _tree.ChildBegin(id);
+    auto count = _tree.count[id];
+    switch (_tree.kind[id]) {
+        case FlatTree::N_Program:
+            for (uint32_t i = 0; i < count && !Diagnostics::Stopped(); ++i) {
+                VisitStmt(child[i]);
+            }
+            return Prim(Type::Unit);
+        case FlatTree::N_VarStmt:  // the global named, a copy of its var or func
+            return _types[child[0]] = Lookup(child[0]);
+        case FlatTree::N_VarAssignStmt: {
+            auto let = Let(child[1]);
+            Define(_tree.slot[child[0]], let.first, let.second);
+            return _types[child[0]] = let.first;
+        }
+        case FlatTree::N_FuncAssignStmt:
+            return Visit(child[0]);
+        case FlatTree::N_Exp: {
+            if (child[0] == FlatTree::kNoNode) {
+                auto term = Prim(Type::Unit);
+                for (uint32_t i = 1; i < count; ++i) {
+                    term = Visit(child[i]);
+                }
+                return term;
+            }
+            auto var = Visit(child[0]);
+            return count == 1 ? var : Apply(id, var, child + 1, count - 1);
+        }
+        case FlatTree::N_Var:  // a use, the binding sites are defined by their parents
+            return Lookup(id);
+        case FlatTree::N_Func:
+            return Func(id);
+        case FlatTree::N_FuncCall:
+            return Apply(id, Lookup(id), child, count);
+        case FlatTree::N_Constant:
+            switch (_tree.tag[id]) {
+                case Token::Int:
+                    return Prim(Type::Int);
+                case Token::Float:
+                    return Prim(Type::Float);
+                case Token::Bool:
+                    return Prim(Type::Bool);
+                case Token::String:
+                    return Prim(Type::String);
+                default:
+                    return Prim(Type::Unit);
+            }
+        case FlatTree::N_Binary: {
+            SmallVec<NodeId> spine;
+            auto term = Visit(_tree.Spine(id, spine));
+            for (auto p = spine.end(); p != spine.begin();) {
+                auto binary = *--p;
+                term = Binary(binary, term, Visit(_tree.ChildBegin(binary)[1]));
+                _types[binary] = term;
+            }
+            return term;
+        }
+        case FlatTree::N_Unary: {
+            auto number = NewVar(kNumeric);
+            Unify(child[0], Visit(child[0]), number);
+            return number;
+        }
+        case FlatTree::N_Cons: {
+            uint32_t pair[2] = {Visit(child[0]), Visit(child[1])};
+            return NewTerm(Type::T_Pair, pair, 2);
+        }
+        case FlatTree::N_Compound:
+            Unify(child[0], Visit(child[0]), Prim(Type::Unit));
+            return Visit(child[1]);
+        case FlatTree::N_Fst: {
+            auto first = Visit(child[0]);
+            Visit(child[1]);
+            return first;
+        }
+        case FlatTree::N_Snd:
+            Visit(child[0]);
+            return Visit(child[1]);
+        case FlatTree::N_If: {
+            Unify(child[0], Visit(child[0]), Prim(Type::Bool));
+            auto then = Visit(child[1]);
+            if (child[2] == FlatTree::kNoNode) {  // no else: () when false, so the then is () too
+                Unify(child[1], then, Prim(Type::Unit));
+                return Prim(Type::Unit);
+            }
+            Unify(child[2], Visit(child[2]), then);
+            return then;
+        }
+        case FlatTree::N_While:
+            Unify(child[0], Visit(child[0]), Prim(Type::Bool));
+            Unify(child[1], Visit(child[1]), Prim(Type::Unit));
+            return Prim(Type::Unit);
+        case FlatTree::N_Let: {
+            // let a = e1 and b = e2 in body: e1 and e2 do not see a and b.
+            auto pairs = (count - 1) / 2;
+            std::vector<std::pair<uint32_t, bool>> values(pairs, {kNone, false});
+            for (uint32_t i = 0; i < pairs; ++i) {
+                if (child[2 * i + 1] != FlatTree::kNoNode) values[i] = Let(child[2 * i + 1]);
+            }
+            for (uint32_t i = 0; i < pairs; ++i) {
+                auto bound = child[2 * i];
+                if (_tree.kind[bound] == FlatTree::N_Func) {
+                    Visit(bound);
+                } else {
+                    if (values[i].first == kNone) values[i].first = NewVar();
+                    Define(_tree.slot[bound], values[i].first, values[i].second);
+                    _types[bound] = values[i].first;
+                }
+            }
+            return Visit(child[count - 1]);
+        }
+        default:
+            CompilePanic("unreachable");
+            return kNone;
+    }
+}
+
+uint32_t Inference::Binary(NodeId id, uint32_t lhs, uint32_t rhs) {
+    auto child = _tree.ChildBegin(id);
+    switch (_tree.tag[id]) {
+        case '+':
+        case '-':
+        case '*':
+        case '/': {
+            auto number = NewVar(kNumeric);
+            Unify(child[0], lhs, number);
+            Unify(child[1], rhs, number);
+            return number;
+        }
+        case '<':
+        case '>':
+        case Token::Ge:
+        case Token::Le:
+        case Token::Eq:
+        case Token::Ne: {
+            auto comparable = NewVar(kComparable);
+            Unify(child[0], lhs, comparable);
+            Unify(child[1], rhs, comparable);
+            return Prim(Type::Bool);
+        }
+        case Token::An:
+        case Token::Or:
+            Unify(child[0], lhs, Prim(Type::Bool));
+            Unify(child[1], rhs, Prim(Type::Bool));
+            return Prim(Type::Bool);
+        default:
+            CompilePanic("unreachable");
+            return kNone;
+    }
+}
+
+void Inference::Error(NodeId at, const std::string &message) {
+    if (auto token = _tree.token[at]) CompileError(token, "%s", message.c_str());
+    SourceLocation loc;
+    if (_tree.Locate(at, loc)) CompileError(loc, "%s", message.c_str());  // of a cached tree
+    CompilePanic(message.c_str());
+}
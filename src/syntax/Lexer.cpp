@@ -5,22 +5,34 @@
 
 #include "syntax/Lexer.h"
 #include "syntax/Error.h"
+#include "syntax/Pipeline.h"
+
+Lexer::~Lexer() {
+    delete _pipe;
+}
 
 Token *Lexer::MakeToken(int tag) {
     _token.tag = tag;
-    auto &str = _token.str;
-    str.resize(0);
-    const char *p = _token.loc.lineBegin + _token.loc.column - 1;
-    for (; p < _p; ++p) {
-        if (p[0] == '\n' && p[-1] == '\\') { str.pop_back(); } else { str.push_back(p[0]); }
+    const char *begin = _token.loc.lineBegin + _token.loc.column - 1;
+    size_t size = _p - begin;
+    if (memchr(begin, '\n', size) == nullptr) {
+        _token.str = {begin, size};  // view of the source
+    } else {
+        // rare: a '\\' newline inside, copy the text without it
+        std::string str;
+        for (const char *p = begin; p < _p; ++p) {
+            if (p[0] == '\n' && p[-1] == '\\') { str.pop_back(); } else { str.push_back(p[0]); }
+        }
+        _token.str = {_arena->CopyStr(str.data(), str.size()), str.size()};
     }
-    return Token::New(_token);
+    return Token::New(_arena, _token);
 }
 
 Token *Lexer::MakeNewLine() {
     _token.tag = '\n';
-    _token.str = std::string(_p, _p + 1);
-    return Token::New(_token);
+    _token.str = {_p, 1};
+    if (_stream) return &_token;  // dropped by Pull
+    return Token::New(_arena, _token);
 }
 
 Token *Lexer::Scan() {
@@ -84,7 +96,8 @@ Token *Lexer::Scan() {
             return SkipIdent();
         case '\0':
             return MakeToken(Token::END);
-        default:
+        default:  // the parser takes it for the end of an expression, it must not get through
+            ReportError(_token.loc, "unexpected character");
             return MakeToken(Token::INVALID);
     }
 }
@@ -92,8 +105,9 @@ Token *Lexer::Scan() {
 Token *Lexer::ScanKw() {
     std::string word;
     while (!Empty())word.push_back(Next());
-    if (Token::KwIs(word)) {
-        return MakeToken(Token::KwLookup(word));
+    int tag = Token::KwClassify(word.data(), word.size());
+    if (tag != Token::Var) {
+        return MakeToken(tag);
     }
     return nullptr;// not match keyword
 }
@@ -114,32 +128,34 @@ Token *Lexer::ScanString(std::string &word) {
 }
 
 Token *Lexer::SkipIdent() {
-    PutBack();
-    auto c = Next();
-    while (isalpha(c) || isdigit(c) || c == '_') {
-        c = Next();
+    while (true) {
+        Advance(_scan->skipIdent(_p, _limit));
+        auto c = Peek();  // may skip a '\\' newline
+        if (!(isalpha(c) || isdigit(c) || c == '_')) break;
+        Next();
     }
-    PutBack();
     Token *ret = MakeToken(Token::Var);
     // kw IS-A ident
-    if (Token::KwIs(ret->str)) ret->tag = Token::KwLookup(ret->str);
+    ret->tag = Token::KwClassify(ret->str);
+    if (ret->tag == Token::Var) ret->sym = Symbol::Intern(ret->str.data(), ret->str.size());
     return ret;
 }
 
 Token *Lexer::SkipNumber() {
-    PutBack();
     int tag = Token::Int;
     int dotted = 0;
-    auto c = Next();
-    while (c == '.' || c == '_' || isdigit(c)) {
+    while (true) {
+        Advance(_scan->skipDigit(_p, _limit));
+        auto c = Peek();
         if (c == '.') {
             tag = Token::Float;
             dotted++;
             if (dotted > 1) { break; }
+        } else if (!(c == '_' || isdigit(c))) {
+            break;
         }
-        c = Next();
+        Next();
     }
-    PutBack();
     return MakeToken(tag);
 
 }
@@ -147,18 +163,30 @@ Token *Lexer::SkipNumber() {
 Token *Lexer::SkipString() {
     auto c = Next();
     int len_limit = 128;
-    while (c != '\"' && len_limit) {
+    while (c != '\"' && c != 0 && len_limit) {
         c = Next();
         len_limit--;
     }
-    if (len_limit <= 0) {
-        CompileError(_loc, "unterminated string literal, more than 128 char");
+    if (c == 0) {
+        PutBack();  // the sentinel is left for the END
+        if (_partial) {
+            _open = true;
+        } else {
+            ReportError(_token.loc, "unterminated string literal");
+        }
+    } else if (len_limit <= 0) {
+        ReportError(_loc, "unterminated string literal, more than 128 char");
+        while (c != '\"' && c != '\n' && c != 0) c = Next();  // go on after it
+        if (c == 0) PutBack();
     }
     return MakeToken(Token::String);
 }
 
 void Lexer::SkipWhiteSpace() {
-    while (isspace(Peek()) && Peek() != '\n') {
+    while (true) {
+        Advance(_scan->skipSpace(_p, _limit));
+        auto c = Peek();  // may skip a '\\' newline
+        if (!isspace(c) || c == '\n') break;
         Next();
     }
 }
@@ -172,23 +200,36 @@ void Lexer::SkipComment() {
         return;
     } else if (Try('*')) {
         while (!Empty()) {
+            // jump to the next '*', the lines passed by are counted in bulk
+            unsigned lines = 0;
+            auto p = _scan->skipComment(_p, _limit, &lines, &_loc.lineBegin);
+            _loc.line += lines;
+            _p = p;
+            _loc.column = _p - _loc.lineBegin + 1;
+            if (Empty()) break;
             auto c = Next();
             if (c == '*' && Peek() == ')') {
                 Next();
                 return;
             }
         }
-        CompileError(_loc, "unterminated block comment");
+        if (_partial) {
+            _open = true;
+            return;
+        }
+        ReportError(_loc, "unterminated block comment");
+        return;
     }
     CompilePanic("unreachable");
 }
 
 void Lexer::Tokenize(TokenSequence &ts) {
+    _arena = ts.GetArena();
     while (true) {
         auto token = Scan();
         if (token->tag == Token::END) {
             if (ts.Empty() || (ts.Back()->tag != Token::NEW_LINE)) {
-                auto tmptoken = Token::New(*token);
+                auto tmptoken = Token::New(_arena, *token);
                 tmptoken->tag = Token::NEW_LINE;
                 tmptoken->str = "\n";
                 ts.InsertBack(tmptoken);
@@ -200,6 +241,43 @@ void Lexer::Tokenize(TokenSequence &ts) {
     }
 }
 
+bool Lexer::TokenizePart(TokenSequence &ts) {
+    _partial = true;
+    _open = false;
+    Tokenize(ts);
+    _partial = false;
+    return !_open;
+}
+
+void Lexer::Open(TokenSequence &ts, TokenSource *source) {
+    assert(ts._owner && ts.tokenList->size() == 0);
+    ts.tokenList->source = source;
+    ts.tokenList->streamed = true;
+    ts._end = TokenSequence::kOpen;
+    ts._begin = ts.Normalize(0);
+}
+
+void Lexer::Stream(TokenSequence &ts) {
+    _arena = ts.GetArena();
+    _stream = true;
+    Open(ts, this);
+}
+
+void Lexer::Pipe(TokenSequence &ts) {
+    assert(_pipe == nullptr);
+    _arena = ts.GetArena();
+    _stream = true;
+    _pipe = Pipeline::New(this);
+    Open(ts, _pipe);
+}
+
+const Token *Lexer::Pull() {
+    while (true) {
+        auto token = Scan();
+        if (token->tag != Token::NEW_LINE) return token;
+    }
+}
+
 /// Aux
 int Lexer::Next() {
     int c = Peek();
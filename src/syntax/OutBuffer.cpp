@@ -0,0 +1,104 @@
+#include "syntax/OutBuffer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <unistd.h>
+
+const size_t OutBuffer::kSize;
+
+// The memory of the last buffer of the thread, for the next one.
+static char *&Spare() {
+    static thread_local struct Slot {
+        char *data{nullptr};
+
+        ~Slot() { free(data); }
+    } slot;
+    return slot.data;
+}
+
+OutBuffer::OutBuffer(int fd, std::ostream *os) : _fd(fd), _os(os) {
+    _data = Spare();
+    Spare() = nullptr;
+    if (_data == nullptr) _data = (char *) malloc(kSize);
+    if (_data == nullptr) throw std::bad_alloc();
+    setp(_data, _data + kSize);
+}
+
+OutBuffer::~OutBuffer() {
+    Flush();
+    free(Spare());
+    Spare() = _data;
+}
+
+void OutBuffer::Fill(char c, size_t n) {
+    while (n > 0) {
+        if (pptr() == epptr()) Flush();
+        auto run = std::min(n, (size_t) (epptr() - pptr()));
+        memset(pptr(), c, run);
+        pbump((int) run);
+        n -= run;
+    }
+}
+
+bool OutBuffer::Flush() {
+    auto size = (size_t) (pptr() - pbase());
+    if (size > 0 && !Sink(pbase(), size)) _failed = true;
+    setp(_data, _data + kSize);
+    return !_failed;
+}
+
+bool OutBuffer::Sink(const char *data, size_t size) {
+    ++_flushes;
+    if (_os) return (bool) _os->write(data, size);
+    while (size > 0) {
+        auto n = write(_fd, data, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+void OutBuffer::Spill(const char *data, size_t size) {
+    Flush();
+    if (size >= kSize) {
+        if (!Sink(data, size)) _failed = true;
+        return;
+    }
+    memcpy(pptr(), data, size);
+    pbump((int) size);
+}
+
+OutBuffer &OutBuffer::operator<<(long long value) {
+    char digits[24];
+    auto end = digits + sizeof(digits), p = end;
+    auto magnitude = value < 0 ? 0ull - (unsigned long long) value : (unsigned long long) value;
+    do {
+        *--p = (char) ('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0) *--p = '-';
+    Write(p, end - p);
+    return *this;
+}
+
+OutBuffer &OutBuffer::operator<<(double value) {
+    char text[32];
+    auto n = snprintf(text, sizeof(text), "%g", value);
+    Write(text, n);
+    return *this;
+}
+
+OutBuffer::int_type OutBuffer::overflow(int_type c) {
+    if (!Flush()) return traits_type::eof();
+    if (c != traits_type::eof()) Put((char) c);
+    return traits_type::not_eof(c);
+}
+
+std::streamsize OutBuffer::xsputn(const char *s, std::streamsize n) {
+    Write(s, n);
+    return _failed ? 0 : n;
+}
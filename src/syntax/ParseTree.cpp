@@ -7,244 +7,251 @@
 
 #include "syntax/ParseTree.h"
 #include "syntax/Error.h"
+#include "syntax/OutBuffer.h"
 
-static int ntab = 0;
-
-static inline void INC() { ntab++; }
-
-static inline void DEC() { ntab--; }
-
-static inline void TAB(std::ostream &os) { for (int i = 0; i < ntab; ++i) { os << "  "; }}
-
-static inline void ILT(std::ostream &os) {
-    ntab++;
-    os << '\n';
-    TAB(os);
-}
-
-static inline void LT(std::ostream &os) {
-    os << '\n';
-    TAB(os);
+void Program::Serialize(std::ostream &os) {
+    if (auto out = dynamic_cast<OutBuffer *>(os.rdbuf())) {
+        TreeWriter w(*out);
+        Serialize(w);
+        return;
+    }
+    OutBuffer out(os);
+    TreeWriter w(out);
+    Serialize(w);
 }
 
-void Program::Serialize(std::ostream &os) {
-    os << "+ program";
-    INC();
+void Program::Serialize(TreeWriter &w) {
+    w << "+ program";
+    w.INC();
     for (auto stmt:*stmtList) {
-        LT(os);
-        stmt->Serialize(os);
+        w.LT();
+        stmt->Serialize(w);
     }
-    DEC();
+    w.DEC();
 }
 
-void Stmt::Serialize(std::ostream &os) {
+void Stmt::Serialize(TreeWriter &w) {
     switch (kind) {
         case FuncAssignStmt:
-            func->Serialize(os);
+            func->Serialize(w);
             break;
         case VarStmt:
-            os << "+ var single";
-            ILT(os);
-            var->Serialize(os);
-            DEC();
+            w << "+ var single";
+            w.ILT();
+            var->Serialize(w);
+            w.DEC();
             break;
         case VarAssignStmt:
-            os << "+ var define";
-            ILT(os);
-            os << "+ left value";
-            ILT(os);
-            var->Serialize(os);
-            DEC();
-            LT(os);
-            os << "+ right value";
-            ILT(os);
-            exp->Serialize(os);
-            DEC();
-            DEC();
+            w << "+ var define";
+            w.ILT();
+            w << "+ left value";
+            w.ILT();
+            var->Serialize(w);
+            w.DEC();
+            w.LT();
+            w << "+ right value";
+            w.ILT();
+            exp->Serialize(w);
+            w.DEC();
+            w.DEC();
             break;
         default:
             CompilePanic("unreachable");
     }
 }
 
-Stmt::~Stmt() {
-    delete var, func, exp, scope;
-}
-
-void Exp::Serialize(std::ostream &os) {
+void Exp::Serialize(TreeWriter &w) {
     if (var != nullptr) {
-        var->Serialize(os);
+        var->Serialize(w);
     }
     if (expbList == nullptr || expbList->empty()) {}
     else if (expbList->size() == 1) {
-        expbList->front()->Serialize(os);
+        expbList->front()->Serialize(w);
     } else {
-        LT(os);
-        os << "+ expb list";
-        INC();
+        w.LT();
+        w << "+ expb list";
+        w.INC();
         for (auto expb:*expbList) {
-            LT(os);
-            expb->Serialize(os);
+            w.LT();
+            expb->Serialize(w);
         }
-        DEC();
+        w.DEC();
     }
 }
 
 void Exp::ScopeCheck() {
-    scope->Insert(var);
+    if (var != nullptr) scope->Insert(var);
     for (auto expb:*expbList) {
-        scope->Append(scope);
+        scope->Append(expb->scope);
     }
 }
 
-void Func::Serialize(std::ostream &os) {
-    os << "+ func define";
-    os << "  name:  " << name;
-    os << "  type: " << fun->GetName();
-    ILT(os);
-    os << "+ param list";
-    INC();
+void Func::Serialize(TreeWriter &w) {
+    w << "+ func define";
+    w << "  name:  " << name;
+    w << "  type: ";
+    auto signature = Signature();
+    if (Type::Get(signature).Params() > 0) w << Type::Name(signature);
+    w.ILT();
+    w << "+ param list";
+    w.INC();
     for (auto var:*paramList) {
-        LT(os);
-        var->Serialize(os);
+        w.LT();
+        var->Serialize(w);
     }
-    DEC();
-    LT(os);
-    os << "+ body";
+    w.DEC();
+    w.LT();
+    w << "+ body";
     if (body != nullptr) {
-        ILT(os);
-        body->Serialize(os);
-        DEC();
+        w.ILT();
+        body->Serialize(w);
+        w.DEC();
     }
-    DEC();
+    w.DEC();
 }
 
 void Func::TypeCheck() {
-    _type->kind = Type::T_Func;
-    fun->retType->kind = body->GetType()->kind;
+    retType = body->GetType();
+    SmallVec<Type::Id> params;
     for (auto param:*paramList) {
         if (Var *found = body->scope->Find(param->GetRoot())) {
-            fun->paramTypeList->push_back(Type::New(found->GetType()->kind));
-            param->SetType(found->GetType()->kind);
+            params.push_back(found->GetType());
+            param->SetType(found->GetType());
         } else {
-            fun->paramTypeList->push_back(Type::New(Type::T_Unknown));
+            params.push_back(Type::Unknown);
         }
     }
+    sig = Type::Function(params.empty() ? nullptr : &params[0], params.size(), retType);
+    _type = sig;
+}
+
+Type::Id Func::Signature() const {
+    if (sig == Type::Unknown) return Type::Unknown;
+    auto &type = Type::Get(sig);
+    return Type::Function(type.args, type.Params(), *ret);
 }
 
-void FuncCall::Serialize(std::ostream &os) {
-    os << "+ func call";
-    os << "  name:  " << name;
-    ILT(os);
+void FuncCall::Serialize(TreeWriter &w) {
+    w << "+ func call";
+    w << "  name:  " << name;
+    w.ILT();
     if (argList != nullptr) {
-        os << "+ arg list";
-        INC();
+        w << "+ arg list";
+        w.INC();
         for (auto expb:*argList) {
-            LT(os);
-            expb->Serialize(os);
+            w.LT();
+            expb->Serialize(w);
         }
-        DEC();
+        w.DEC();
     }
     if (body != nullptr) {
-        os << "+ body";
-        body->Serialize(os);
+        w << "+ body";
+        body->Serialize(w);
     }
     if (retValue != nullptr) {
-        os << "+ retValue";
-        retValue->Serialize(os);
+        w << "+ retValue";
+        retValue->Serialize(w);
     }
-    DEC();
+    w.DEC();
 }
 
 void FuncCall::TypeCheck() {
-    fun->retType->ExpectOrInfer(proto->GetType()->kind, _root);
+    Type::ExpectOrInfer(retType, proto->GetType(), _root);
     if (argList->size() != proto->paramList->size()) { CompileError(_root, "the count of arguments is unmatched"); }
     auto ap = argList->begin();
     auto pp = proto->paramList->begin();
     while (ap != argList->end() && pp != proto->paramList->end()) {
-        (*ap)->GetType()->Expect((*pp)->GetType()->kind, (*ap)->GetRoot());
+        Type::Expect((*ap)->GetType(), (*pp)->GetType(), (*ap)->GetRoot());
         ap++;
         pp++;
     }
     // after validation, then assign
-    fun = proto->fun;
-}
-
-void ExpbBinary::Serialize(std::ostream &os) {
-    os << "+ expbBinary";
-    os << "  type: " << Type::KindLookup(_type->kind);
-    ILT(os);
-    os << "| op  " << Token::TagLookup(_op);
-    LT(os);
-    os << "+ lhs";
-    ILT(os);
-    _lhs->Serialize(os);
-    DEC();
-    LT(os);
-    os << "+ rhs";
-    ILT(os);
-    _rhs->Serialize(os);
-    DEC();
-    DEC();
+    ret = proto->ret;
 }
 
-ExpbBinary::~ExpbBinary() {
-    delete _lhs, _rhs;
+Expb *ExpbBinary::Spine(SmallVec<ExpbBinary *> &spine) {
+    Expb *lhs = this;
+    while (auto binary = dynamic_cast<ExpbBinary *>(lhs)) {
+        spine.push_back(binary);
+        lhs = binary->_lhs;
+    }
+    return lhs;
+}
+
+void ExpbBinary::Serialize(TreeWriter &w) {
+    SmallVec<ExpbBinary *> spine;
+    auto first = Spine(spine);
+    for (auto binary:spine) {
+        w << "+ expbBinary";
+        w << "  type: " << Type::KindName(Type::KindOf(binary->_type));
+        w.ILT();
+        w << "| op  " << Token::TagLookup(binary->_op);
+        w.LT();
+        w << "+ lhs";
+        w.ILT();
+    }
+    first->Serialize(w);
+    for (auto p = spine.end(); p != spine.begin();) {
+        auto binary = *--p;
+        w.DEC();
+        w.LT();
+        w << "+ rhs";
+        w.ILT();
+        binary->_rhs->Serialize(w);
+        w.DEC();
+        w.DEC();
+    }
 }
 
 void ExpbBinary::AdditiveOpTypeCheck() {
     auto ltype = _lhs->GetType();
-    auto rtype = _rhs->GetType();
-    switch (ltype->kind) {
-        case Type::T_Unknown:
-            ltype->ExpectOrInfer(Type::T_Int, _lhs->GetRoot());
-            rtype->ExpectOrInfer(Type::T_Int, _rhs->GetRoot());
-            _type->kind = Type::T_Int;
+    switch (ltype) {
+        case Type::Unknown:
+            _lhs->ExpectOrInfer(Type::Int);
+            _rhs->ExpectOrInfer(Type::Int);
+            _type = Type::Int;
             break;
-        case Type::T_Int:
-            rtype->ExpectOrInfer(Type::T_Int, _rhs->GetRoot());
-            _type->kind = Type::T_Int;
+        case Type::Int:
+            _rhs->ExpectOrInfer(Type::Int);
+            _type = Type::Int;
             break;
-        case Type::T_Float:
-            rtype->ExpectOrInfer(Type::T_Float, _rhs->GetRoot());
-            _type->kind = Type::T_Float;
+        case Type::Float:
+            _rhs->ExpectOrInfer(Type::Float);
+            _type = Type::Float;
             break;
         default:
-            Type::UnExpect(ltype->kind, _lhs->GetRoot());
+            Type::UnExpect(ltype, _lhs->GetRoot());
             break;
     }
 }
 
 void ExpbBinary::EqualityOpTypeCheck() {
     auto ltype = _lhs->GetType();
-    auto rtype = _rhs->GetType();
-    _type->kind = Type::T_Bool;
-    switch (ltype->kind) {
-        case Type::T_Unknown:
-            ltype->ExpectOrInfer(Type::T_Int, _lhs->GetRoot());
-            rtype->ExpectOrInfer(Type::T_Int, _rhs->GetRoot());
+    _type = Type::Bool;
+    switch (ltype) {
+        case Type::Unknown:
+            _lhs->ExpectOrInfer(Type::Int);
+            _rhs->ExpectOrInfer(Type::Int);
             break;
-        case Type::T_Int:
-            rtype->ExpectOrInfer(Type::T_Int, _rhs->GetRoot());
+        case Type::Int:
+            _rhs->ExpectOrInfer(Type::Int);
             break;
-        case Type::T_Float:
-            rtype->ExpectOrInfer(Type::T_Float, _rhs->GetRoot());
+        case Type::Float:
+            _rhs->ExpectOrInfer(Type::Float);
             break;
-        case Type::T_Bool:
-            rtype->ExpectOrInfer(Type::T_Bool, _rhs->GetRoot());
+        case Type::Bool:
+            _rhs->ExpectOrInfer(Type::Bool);
             break;
         default:
-            Type::UnExpect(ltype->kind, _lhs->GetRoot());
+            Type::UnExpect(ltype, _lhs->GetRoot());
             break;
     }
 }
 
 void ExpbBinary::BooleanOpTypeCheck() {
-    auto ltype = _lhs->GetType();
-    auto rtype = _rhs->GetType();
-    _type->kind = Type::T_Bool;
-    ltype->ExpectOrInfer(Type::T_Bool, _lhs->GetRoot());
-    rtype->ExpectOrInfer(Type::T_Bool, _rhs->GetRoot());
+    _type = Type::Bool;
+    _lhs->ExpectOrInfer(Type::Bool);
+    _rhs->ExpectOrInfer(Type::Bool);
 }
 
 void ExpbBinary::TypeCheck() {
@@ -278,31 +285,31 @@ void ExpbBinary::ScopeCheck() {
     scope->Append(_rhs->scope);
 }
 
-void ExpbUnary::Serialize(std::ostream &os) {
-    os << "+ expbUnary";
-    ILT(os);
-    os << "| op  " << Token::TagLookup(_op);
-    LT(os);
-    os << "+ oprand";
-    ILT(os);
-    _oprand->Serialize(os);
-    DEC();
-    DEC();
+void ExpbUnary::Serialize(TreeWriter &w) {
+    w << "+ expbUnary";
+    w.ILT();
+    w << "| op  " << Token::TagLookup(_op);
+    w.LT();
+    w << "+ oprand";
+    w.ILT();
+    _oprand->Serialize(w);
+    w.DEC();
+    w.DEC();
 }
 
 void ExpbUnary::TypeCheck() {
     switch (_op) {
         case '+':
         case '-':
-            switch (_oprand->GetType()->kind) {
-                case Type::T_Int:
-                    _type->kind = Type::T_Int;
+            switch (_oprand->GetType()) {
+                case Type::Int:
+                    _type = Type::Int;
                     break;
-                case Type::T_Float:
-                    _type->kind = Type::T_Float;
+                case Type::Float:
+                    _type = Type::Float;
                     break;
                 default:
-                    Type::UnExpect(_oprand->GetType()->kind, _oprand->GetRoot());
+                    Type::UnExpect(_oprand->GetType(), _oprand->GetRoot());
                     break;
             }
             break;
@@ -312,179 +319,170 @@ void ExpbUnary::TypeCheck() {
     }
 }
 
-void ExpbCons::Serialize(std::ostream &os) {
-    os << "+ expbCons";
-    ILT(os);
-    os << "+ first element";
-    ILT(os);
-    _first->Serialize(os);
-    DEC();
-    LT(os);
-    os << "+ second element";
-    ILT(os);
-    _second->Serialize(os);
-    DEC();
-    DEC();
-}
-
-ExpbCons::~ExpbCons() { delete _first, _second; }
-
-void ExpbCompound::Serialize(std::ostream &os) {
-    os << "+ expbCompound";
-    ILT(os);
-    os << "+ first clause";
-    ILT(os);
-    _first->Serialize(os);
-    DEC();
-    LT(os);
-    os << "+ second clause";
-    ILT(os);
-    _second->Serialize(os);
-    DEC();
-    DEC();
-}
-
-ExpbCompound::~ExpbCompound() { delete _first, _second; }
+void ExpbCons::Serialize(TreeWriter &w) {
+    w << "+ expbCons";
+    w.ILT();
+    w << "+ first element";
+    w.ILT();
+    _first->Serialize(w);
+    w.DEC();
+    w.LT();
+    w << "+ second element";
+    w.ILT();
+    _second->Serialize(w);
+    w.DEC();
+    w.DEC();
+}
+
+void ExpbCompound::Serialize(TreeWriter &w) {
+    w << "+ expbCompound";
+    w.ILT();
+    w << "+ first clause";
+    w.ILT();
+    _first->Serialize(w);
+    w.DEC();
+    w.LT();
+    w << "+ second clause";
+    w.ILT();
+    _second->Serialize(w);
+    w.DEC();
+    w.DEC();
+}
 
 void ExpbCompound::TypeCheck() {
-    _first->GetType()->ExpectOrInfer(Type::T_Unit, _first->GetRoot());
+    _first->ExpectOrInfer(Type::Unit);
     SetType(_second->GetType());
 }
 
-void ExpbFst::Serialize(std::ostream &os) {
-    os << "+ expbFst";
-    ILT(os);
-    os << "+ first element";
-    ILT(os);
-    _first->Serialize(os);
-    DEC();
-    LT(os);
-    os << "+ second element";
-    ILT(os);
-    _second->Serialize(os);
-    DEC();
-    DEC();
-}
-
-ExpbFst::~ExpbFst() { delete _first, _second; }
-
-void ExpbSnd::Serialize(std::ostream &os) {
-    os << "+ expbSnd";
-    ILT(os);
-    os << "+ first element";
-    ILT(os);
-    _first->Serialize(os);
-    DEC();
-    LT(os);
-    os << "+ second element";
-    ILT(os);
-    _second->Serialize(os);
-    DEC();
-    DEC();
-}
-
-ExpbSnd::~ExpbSnd() { delete _first, _second; }
-
-void Var::Serialize(std::ostream &os) {
-    os << "| var";
-    os << "  name: " << name;
-    os << "  type: " << _type->GetName();
-}
-
-void ExpaConstant::Serialize(std::ostream &os) {
-    os << "| expaConstant  type: " << _type->GetName() << "  value:  ";
+void ExpbFst::Serialize(TreeWriter &w) {
+    w << "+ expbFst";
+    w.ILT();
+    w << "+ first element";
+    w.ILT();
+    _first->Serialize(w);
+    w.DEC();
+    w.LT();
+    w << "+ second element";
+    w.ILT();
+    _second->Serialize(w);
+    w.DEC();
+    w.DEC();
+}
+
+void ExpbSnd::Serialize(TreeWriter &w) {
+    w << "+ expbSnd";
+    w.ILT();
+    w << "+ first element";
+    w.ILT();
+    _first->Serialize(w);
+    w.DEC();
+    w.LT();
+    w << "+ second element";
+    w.ILT();
+    _second->Serialize(w);
+    w.DEC();
+    w.DEC();
+}
+
+void Var::Serialize(TreeWriter &w) {
+    w << "| var";
+    w << "  name: " << name;
+    w << "  type: " << Type::KindName(Type::KindOf(_type));
+}
+
+void ExpaConstant::Serialize(TreeWriter &w) {
+    w << "| expaConstant  type: " << Type::KindName(Type::KindOf(_type)) << "  value:  ";
     switch (_root->tag) {
         case Token::Int:
-            os << _ival;
+            w << _ival;
             break;
         case Token::Float:
-            os << _fval;
+            w << _fval;
             break;
         case Token::Bool:
-            os << _bval ? "true" : "false";
+            w << _bval;  // as it printed, 0 or 1
             break;
         case Token::String:
-            os << _sval;
+            w.Write(_sval.data(), _sval.size());
             break;
         case Token::Unit:
-            os << "()";
+            w << "()";
             break;
         default:
             CompilePanic("unreachable expaConstant operator<<");
     }
 }
 
-void ExpaIf::Serialize(std::ostream &os) {
-    os << "+ expaIf";
-    ILT(os);
-    os << "+ condition expr";
-    LT(os);
-    _cond->Serialize(os);
-    LT(os);
-    os << "+ then expr";
-    LT(os);
-    _then->Serialize(os);
+void ExpaIf::Serialize(TreeWriter &w) {
+    w << "+ expaIf";
+    w.ILT();
+    w << "+ condition expr";
+    w.LT();
+    _cond->Serialize(w);
+    w.LT();
+    w << "+ then expr";
+    w.LT();
+    _then->Serialize(w);
 
     if (_els != nullptr) {
-        LT(os);
-        os << "+ else expr";
-        LT(os);
-        _els->Serialize(os);
+        w.LT();
+        w << "+ else expr";
+        w.LT();
+        _els->Serialize(w);
     }
-    DEC();
+    w.DEC();
 }
 
 void ExpaIf::TypeCheck() {
-    _cond->GetType()->ExpectOrInfer(Type::T_Bool, _cond->GetRoot());
+    _cond->ExpectOrInfer(Type::Bool);
     if (_els == nullptr) {
-        switch (_then->GetType()->kind) {
-            case Type::T_Unknown:
-                _then->GetType()->ExpectOrInfer(Type::T_Unit, _then->GetRoot());
-                _type->kind = Type::T_Unit;
+        switch (_then->GetType()) {
+            case Type::Unknown:
+                _then->ExpectOrInfer(Type::Unit);
+                _type = Type::Unit;
                 break;
-            case Type::T_Int:
-                _type->kind = Type::T_Int;
+            case Type::Int:
+                _type = Type::Int;
                 break;
-            case Type::T_Float:
-                _type->kind = Type::T_Float;
+            case Type::Float:
+                _type = Type::Float;
                 break;
-            case Type::T_Bool:
-                _type->kind = Type::T_Bool;
+            case Type::Bool:
+                _type = Type::Bool;
                 break;
-            case Type::T_Unit:
-                _type->kind = Type::T_Unit;
+            case Type::Unit:
+                _type = Type::Unit;
                 break;
             default:
-                Type::UnExpect(_then->GetType()->kind, _then->GetRoot());
+                Type::UnExpect(_then->GetType(), _then->GetRoot());
                 break;
         }
     } else {
         auto ttype = _then->GetType();
-        auto etype = _els->GetType();
-        switch (ttype->kind) {
-            case Type::T_Unknown:
-                ttype->ExpectOrInfer(Type::T_Unit, _then->GetRoot());
-                etype->ExpectOrInfer(Type::T_Unit, _els->GetRoot());
-                _type->kind = Type::T_Unit;
+        switch (ttype) {
+            case Type::Unknown:
+                _then->ExpectOrInfer(Type::Unit);
+                _els->ExpectOrInfer(Type::Unit);
+                _type = Type::Unit;
                 break;
-            case Type::T_Int:
-                etype->ExpectOrInfer(Type::T_Int, _els->GetRoot());
-                _type->kind = Type::T_Int;
+            case Type::Int:
+                _els->ExpectOrInfer(Type::Int);
+                _type = Type::Int;
                 break;
-            case Type::T_Float:
-                etype->ExpectOrInfer(Type::T_Float, _els->GetRoot());
-                _type->kind = Type::T_Float;
+            case Type::Float:
+                _els->ExpectOrInfer(Type::Float);
+                _type = Type::Float;
                 break;
-            case Type::T_Bool:
-                etype->ExpectOrInfer(Type::T_Bool, _els->GetRoot());
-                _type->kind = Type::T_Bool;
+            case Type::Bool:
+                _els->ExpectOrInfer(Type::Bool);
+                _type = Type::Bool;
                 break;
-            case Type::T_Unit:
-                etype->ExpectOrInfer(Type::T_Unit, _els->GetRoot());
-                _type->kind = Type::T_Unit;
+            case Type::Unit:
+                _els->ExpectOrInfer(Type::Unit);
+                _type = Type::Unit;
                 break;
             default:
-                Type::UnExpect(_then->GetType()->kind, _then->GetRoot());
+                Type::UnExpect(_then->GetType(), _then->GetRoot());
                 break;
         }
     }
@@ -493,82 +491,82 @@ void ExpaIf::TypeCheck() {
 void ExpaIf::ScopeCheck() {
     // todo: Here exists a Bug. Typecheck didn't influent the inner scope.
     // naive solution: only for "if a then b else c" this case.
-    _cond->scope->Find(_cond->GetRoot())->SetType(_cond->GetType());
+    if (auto found = _cond->scope->Find(_cond->GetRoot())) found->SetType(_cond->GetType());
     scope->Append(_cond->scope);
-    _then->scope->Find(_then->GetRoot())->SetType(_then->GetType());
+    if (auto found = _then->scope->Find(_then->GetRoot())) found->SetType(_then->GetType());
     scope->Append(_then->scope);
     if (_els != nullptr) {
-        _els->scope->Find(_els->GetRoot())->SetType(_els->GetType());
+        if (auto found = _els->scope->Find(_els->GetRoot())) found->SetType(_els->GetType());
         scope->Append(_els->scope);
     }
 }
 
-void ExpaWhile::Serialize(std::ostream &os) {
-    os << "+ expaWhile";
-    ILT(os);
-    os << "+ condition expr";
-    LT(os);
-    _cond->Serialize(os);
-    LT(os);
-    os << "+ body";
-    LT(os);
-    _body->Serialize(os);
-    DEC();
+void ExpaWhile::Serialize(TreeWriter &w) {
+    w << "+ expaWhile";
+    w.ILT();
+    w << "+ condition expr";
+    w.LT();
+    _cond->Serialize(w);
+    w.LT();
+    w << "+ body";
+    w.LT();
+    _body->Serialize(w);
+    w.DEC();
 }
 
 void ExpaWhile::TypeCheck() {
-    _cond->GetType()->ExpectOrInfer(Type::T_Bool, _cond->GetRoot());
-    switch (_body->GetType()->kind) {
-        case Type::T_Unknown:
-            _body->GetType()->ExpectOrInfer(Type::T_Unit, _body->GetRoot());
-            _type->kind = Type::T_Unit;
+    _cond->ExpectOrInfer(Type::Bool);
+    switch (_body->GetType()) {
+        case Type::Unknown:
+            _body->ExpectOrInfer(Type::Unit);
+            _type = Type::Unit;
             break;
-        case Type::T_Int:
-            _type->kind = Type::T_Int;
+        case Type::Int:
+            _type = Type::Int;
             break;
-        case Type::T_Float:
-            _type->kind = Type::T_Float;
+        case Type::Float:
+            _type = Type::Float;
             break;
-        case Type::T_Bool:
-            _type->kind = Type::T_Bool;
+        case Type::Bool:
+            _type = Type::Bool;
             break;
-        case Type::T_Unit:
-            _type->kind = Type::T_Unit;
+        case Type::Unit:
+            _type = Type::Unit;
             break;
         default:
-            Type::UnExpect(_body->GetType()->kind, _body->GetRoot());
+            Type::UnExpect(_body->GetType(), _body->GetRoot());
             break;
     }
 }
 
 void ExpaWhile::ScopeCheck() {
     // naive solution: only for "while a do b done" this case.
-    _cond->scope->Find(_cond->GetRoot())->SetType(_cond->GetType());
+    if (auto found = _cond->scope->Find(_cond->GetRoot())) found->SetType(_cond->GetType());
     scope->Append(_cond->scope);
-    _body->scope->Find(_body->GetRoot())->SetType(_body->GetType());
+    if (auto found = _body->scope->Find(_body->GetRoot())) found->SetType(_body->GetType());
     scope->Append(_body->scope);
 }
 
-void ExpaLet::Serialize(std::ostream &os) {
-    os << "+ expaLet";
-    ILT(os);
-    os << "+ exp pairs";
-    INC();
+void ExpaLet::Serialize(TreeWriter &w) {
+    w << "+ expaLet";
+    w.ILT();
+    w << "+ exp pairs";
+    w.INC();
     for (auto item:*expPairList) {
-        LT(os);
-        item.first->Serialize(os);
+        w.LT();
+        item.first->Serialize(w);
         if (item.second != nullptr) {
-            LT(os);
-            item.second->Serialize(os);
+            w.LT();
+            item.second->Serialize(w);
         }
     }
-    DEC();
-    LT(os);
-    os << "+ body";
-    ILT(os);
-    body->Serialize(os);
-    DEC();
-    DEC();
+    w.DEC();
+    w.LT();
+    w << "+ body";
+    w.ILT();
+    body->Serialize(w);
+    w.DEC();
+    w.DEC();
 }
 
 void ExpaLet::TypeCheck() {
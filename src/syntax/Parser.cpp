@@ -5,11 +5,12 @@
 
 #include "syntax/Parser.h"
 #include "syntax/Error.h"
+#include "syntax/Resolver.h"
 
 /// Parse Float
 // ParseConstant aux
 ExpaConstant *ParseFloat(const Token *token) {
-    const std::string &str = token->str;
+    const std::string str = token->str.str();
     float val = 0.0;
     try {
         val = stof(str);
@@ -22,7 +23,7 @@ ExpaConstant *ParseFloat(const Token *token) {
 /// Parse Int
 // ParseConstant aux
 ExpaConstant *ParseInt(const Token *token) {
-    const std::string &str = token->str;
+    const std::string str = token->str.str();
     int val = 0;
     try {
         val = stoi(str);
@@ -52,7 +53,7 @@ ExpaConstant *Parser::ParseConstant(const Token *token) {
 
 Var *Parser::ParseVar(const Token *token) {
     auto ret = Var::New(token);
-    ret->scope->Insert(ret);
+    Check(Sema::C_Var, ret);
     return ret;
 }
 
@@ -65,24 +66,44 @@ ExpaIf *Parser::ParseExpaIf(const Token *token) {
         els = ParseExp();
     }  // "else" optional
     auto ret = ExpaIf::New(token, cond, then, els);
-    ret->TypeCheck();
-    ret->ScopeCheck();
+    Check(Sema::C_TypeScope, ret);
     return ret;
 }
 
 ExpaWhile *Parser::ParseExpaWhile(const Token *token) {
-    auto cond = ParseExp();
-    _ts.Expect(Token::Do);  // "do" required
-    auto body = ParseExp();
+    Exp *cond = nullptr, *body = nullptr;
+    try {
+        cond = ParseExp();
+        _ts.Expect(Token::Do);  // "do" required
+        body = ParseExp();
+    } catch (const Diagnostics::Recovery &recovery) {
+        if (!Sync(recovery.token, Token::Done)) throw;
+        _ts.Next();
+        throw Diagnostics::Recovery{nullptr};  // dropped with the statement, from after the "done"
+    }
     _ts.Expect(Token::Done);  // "done" required
     auto ret = ExpaWhile::New(token, cond, body);
-    ret->TypeCheck();
-    ret->ScopeCheck();
+    Check(Sema::C_TypeScope, ret);
     return ret;
 }
 
 ExpaLet *Parser::ParseExpaLet(const Token *token) {
     auto ret = ExpaLet::New(token);
+    bool failed = false;
+    try {
+        ParseExpaLetBindings(ret);
+    } catch (const Diagnostics::Recovery &recovery) {
+        if (!Sync(recovery.token, Token::In)) throw;
+        failed = true;  // go on with the body, for its errors
+    }
+    _ts.Expect(Token::In);  // "in" required
+    ret->body = ParseExp();
+    if (failed) throw Diagnostics::Recovery{nullptr};  // dropped with the statement
+    Check(Sema::C_TypeScope, ret);
+    return ret;
+}
+
+void Parser::ParseExpaLetBindings(ExpaLet *ret) {
     do {
         auto assign = ParseAssignStmt(_ts.Peek());  // todo!!!: impl Scope for ExpaLet
         switch (assign->kind) {
@@ -96,11 +117,6 @@ ExpaLet *Parser::ParseExpaLet(const Token *token) {
                 CompilePanic("unreachable in ParseExpaLet");
         }
     } while (_ts.Try(Token::And));  // "and" optional, repeated
-    _ts.Expect(Token::In);  // "in" required
-    ret->body = ParseExp();
-    ret->TypeCheck();
-    ret->ScopeCheck();
-    return ret;
 }
 
 Expb *Parser::ParseExpaParen(const Token *token) {
@@ -136,47 +152,45 @@ Expb *Parser::ParseExpa() {
         case Token::LP:  // return expb
             return ParseExpaParen(peek);
         default:
+            _ts.PutBack();  // not an operand, e.g. the ;; of an unfinished statement
             return nullptr;
     }
     CompileError(peek, "unreachable");
     return nullptr;
 }
 
-ExpbBinary *Parser::ParseExpbBinary(const Token *token) {
-    auto lhs = ParseExpa();  // pop lhs
-    auto rhs = ParseExpbBinaryRHS(0, lhs);  // parse rhs
-    auto ret = dynamic_cast<ExpbBinary *>(rhs);  // casting
-    ret->TypeCheck();
-    ret->ScopeCheck();
+Expb *Parser::ParseExpbBinary(Expb *lhs) {
+    auto ret = ParseExpbBinaryRHS(0, lhs);
+    if (ret == lhs) return ret;  // no infix operator after all, e.g. fst
+    Check(Sema::C_TypeScope, ret);
     return ret;
 }
 
 Expb *Parser::ParseExpbBinaryRHS(int prec, Expb *lhs) {
     while (true) {
         auto curToken = _ts.Peek();
-        int curPrec = Token::PrecLookup(curToken->tag);
-        if (curPrec < prec)
+        auto cur = Token::InfixLookup(curToken->tag);
+        if (cur.prec < prec)
             return lhs;
         auto oper = _ts.Next();  // pop operator
-        if (oper->IsEOF()) CompileError(oper, "premature end of input");
         if (!oper->IsBinary()) CompileError(oper, "unexpected binary operator");
         Expb *rhs = ParseExpa();
-        if (rhs == nullptr) return nullptr;
-        auto nextToken = _ts.Peek();
-        int nextPrec = Token::PrecLookup(nextToken->tag);
-        if (curPrec < nextPrec) {
-            rhs = ParseExpbBinaryRHS(curPrec + 1, rhs);
-            if (rhs == nullptr) return nullptr;
-            rhs->TypeCheck();
+        if (rhs == nullptr) CompileError(_ts.Peek(), "operand expected");
+        auto next = Token::InfixLookup(_ts.Peek()->tag);
+        if (cur.prec < next.prec || (cur.prec == next.prec && next.rightAssoc)) {
+            ++_stats.climbs;
+            rhs = ParseExpbBinaryRHS(next.rightAssoc ? cur.prec : cur.prec + 1, rhs);
+            Check(Sema::C_Type, rhs);
         }
         lhs = ExpbBinary::New(curToken, lhs, rhs);
+        ++_stats.operators;
     }
 }
 
 ExpbUnary *Parser::ParseExpbUnary(const Token *token) {
     auto oprand = ParseExpb();  // pop oprand
     auto ret = ExpbUnary::New(token, oprand);
-    ret->TypeCheck();
+    Check(Sema::C_Type, ret);
     return ret;
 }
 
@@ -220,13 +234,13 @@ Expb *Parser::ParseExpb() {
     if (peek->IsEOF()) CompileError(peek, "premature end of input");
         // Second(expbBinary)
         // LeftRecur, but we can use the peek2 :)
-    else if (peek2->IsBinary() || peek2->tag == '(') {
+    else if ((peek2->IsBinary() || peek2->tag == '(') && peek->tag != Token::Fst && peek->tag != Token::Snd) {
         _ts.PutBack();
-        auto before_expa = _ts.Mark();
-        auto expa_possible = ParseExpa();
-        if (!_ts.Peek()->IsBinary()) { return expa_possible; }
-        _ts.ResetTo(before_expa);
-        return ParseExpbBinary(peek);
+        auto expa = ParseExpa();  // ahead, then the lhs: not parsed again
+        ++_stats.lookaheads;
+        if (!_ts.Peek()->IsBinary()) { return expa; }
+        ++_stats.reused;
+        return ParseExpbBinary(expa);
     }
         // Second(expbCompound)
     else if (peek2->tag == Token::Semi) {
@@ -270,7 +284,7 @@ Exp *Parser::ParseExp() {
             expb = ParseExpb();
         }
         _ts.PutBack();
-        ret->ScopeCheck();
+        Check(Sema::C_Scope, ret);
         return ret;
     }
         // exp ::= expb
@@ -279,8 +293,7 @@ Exp *Parser::ParseExp() {
         auto expb = ParseExpb();
         if (expb != nullptr) {
             ret->expbList->push_back(expb);
-            ret->SetType(expb->GetType()); // type check
-            ret->scope->Append(expb->scope); // scope check
+            Check(Sema::C_Expb, ret, expb);
         }
         return ret;
     }
@@ -300,7 +313,7 @@ Func *Parser::ParseFunc(const Token *token) {
     }
     // todo: complete the scope check.
     // Currently, every func's parent link to _program.
-    if (ret->isRec) { _program->scope->Insert(ret); }
+    if (ret->isRec) { Check(Sema::C_RecFunc, ret); }
     return ret;
 }
 
@@ -310,18 +323,16 @@ FuncCall *Parser::ParseFuncCall(const Token *token) {
     if (_ts.Test('(')) {
         _ts.Next();
         do {
-            ret->argList->push_back(ParseExpb());
+            auto arg = ParseExpb();
+            if (arg == nullptr) CompileError(_ts.PeekPrior(), "argument expected");  // read by ParseExpb
+            ret->argList->push_back(arg);
         } while (_ts.Try(Token::Comma));
         _ts.Expect(')');
     }
     ret->paramList = nullptr;
     ret->retValue = nullptr; // Unknown retValue before evaluating.
     // scope check
-    auto fund = dynamic_cast<Func *>(_program->scope->Find(token));
-    if (fund == nullptr) { CompileError(token, "undefined func here"); }
-    ret->proto = fund;
-    ret->scope->Insert(ret);
-    ret->TypeCheck();
+    Check(Sema::C_FuncCall, ret);
     return ret;
 }
 
@@ -334,9 +345,7 @@ Stmt *Parser::ParseAssignStmt(const Token *token) {
         ret->var = ParseVar(_ts.Next());
         _ts.Expect('=');
         ret->exp = ParseExp();
-        ret->scope->Parent()->Insert(ret->var);
-        ret->var->scope->SetParent(ret->scope);
-        ret->var->SetType(ret->exp->GetType());  // only infer
+        Check(Sema::C_VarAssign, ret);
         return ret;
     } // func assign kind
     else {
@@ -347,9 +356,7 @@ Stmt *Parser::ParseAssignStmt(const Token *token) {
         if (funcStmt->body == nullptr) { CompileError(token, "empty body for this function"); }
         ret->func = funcStmt;
         // scope check
-        ret->scope->Parent()->Insert(ret->func);
-        ret->func->scope->SetParent(ret->scope);
-        ret->func->TypeCheck();
+        Check(Sema::C_FuncAssign, ret);
         return ret;
     }
 }
@@ -366,12 +373,10 @@ Stmt *Parser::ParseStmt() {
     else if (peek->tag == Token::Var) {
         auto ret = Stmt::New(_program);
         ret->kind = Stmt::VarStmt;
-        auto var = ParseVar(peek);
+        auto var = ret->var = ParseVar(peek);  // the global found, once checked
         _ts.Expect(Token::Dsemi);
         // scope check
-        auto varFound = _program->scope->Find(var->GetRoot());
-        if (!varFound) { CompileError(var->GetRoot(), "undefined var here"); }
-        ret->var = varFound;
+        Check(Sema::C_VarStmt, ret, var);
         return ret;
     } else {
         CompileError(peek, "unexpected stmt start");
@@ -382,17 +387,98 @@ Stmt *Parser::ParseStmt() {
 }
 
 Program *Parser::ParseProgram() {
-    auto ret = Program::New();
-    while (!_ts.Peek()->IsEOF()) {
-        ret->stmtList->push_back(ParseStmt());
+    auto ret = _program = Program::New();  // stmts link to its scope
+    while (!_ts.Peek()->IsEOF() && !Diagnostics::Stopped()) {
+        if (auto stmt = TryParseStmt()) ret->stmtList->push_back(stmt);
     }
     return ret;
 }
 
+Stmt *Parser::TryParseStmt() {
+    try {
+        auto stmt = ParseStmt();
+        _sema.EndStmt();
+        return stmt;
+    } catch (const Diagnostics::Recovery &recovery) {
+        _sema.DropStmt();
+        if (Sync(recovery.token, Token::Dsemi)) _ts.Next();
+        return nullptr;
+    }
+}
+
+bool Parser::Sync(const Token *error, int tag) {
+    if (Diagnostics::Stopped()) return false;
+    if (error && error->tag == Token::Dsemi && _ts.Peek() != error) return false;  // read, the statement is over
+    auto open = tag == Token::In ? Token::Let : tag == Token::Done ? Token::While : 0;
+    int depth = 0;
+    for (auto token = _ts.Peek(); !token->IsEOF(); token = _ts.Peek()) {
+        if (token->tag == tag && depth == 0) return true;
+        if (token->tag == Token::Dsemi) return false;
+        if (open != 0 && token->tag == open) ++depth;
+        if (token->tag == tag) --depth;
+        _ts.Next();
+    }
+    return false;
+}
+
+void ParserStats::Print(FILE *out) const {
+    fprintf(out, "parser stats: %zu lookaheads %zu reused %6.2f%% %zu operators %zu climbs\n", lookaheads, reused,
+            lookaheads ? 100.0 * reused / lookaheads : 0.0, operators, climbs);
+}
+
 void Parser::Parse() {
-    _program = ParseProgram();
+    ArenaGuard guard(_arena);
+    ParseProgram();
+    _sema.Run(_program);
+    if (!Diagnostics::HasErrors()) Finish();
+}
+
+void Parser::Parse(ThreadPool *pool) {
+    ArenaGuard guard(_arena);
+    _program = Program::New();
+    for (auto &chunk:_ts.Split(Token::Dsemi, pool->Size() * 4)) {
+        _chunks.push_back(new Parser(chunk, _program, _syntaxOnly));
+        if (auto diags = Diagnostics::Current()) _chunks.back()->_diags = new Diagnostics(diags->Limit());
+    }
+    {
+        Symbol::Shared shared;  // the roots of the checks are interned lazily
+        for (auto chunk:_chunks) {
+            pool->Submit([chunk] {
+                DiagnosticsGuard guard(chunk->_diags);
+                chunk->ParseChunk();
+                chunk->_sema.RunLocal();
+            });
+        }
+        pool->Wait();
+    }
+    // link, in source order
+    for (auto chunk:_chunks) {
+        for (auto stmt:chunk->_stmts) {
+            _program->stmtList->push_back(stmt);
+        }
+        if (chunk->_diags) Diagnostics::Current()->Merge(*chunk->_diags);
+        chunk->_sema.RunGlobal(_program);
+        _stats.lookaheads += chunk->_stats.lookaheads;
+        _stats.reused += chunk->_stats.reused;
+        _stats.operators += chunk->_stats.operators;
+        _stats.climbs += chunk->_stats.climbs;
+    }
+    if (!Diagnostics::HasErrors()) Finish(pool);
+}
+
+void Parser::ParseChunk() {
+    ArenaGuard guard(_arena);
+    while (!_ts.Peek()->IsEOF() && !Diagnostics::Stopped()) {
+        if (auto stmt = TryParseStmt()) _stmts.push_back(stmt);
+    }
+}
+
+void Parser::Finish(ThreadPool *pool) {
+    currentScope = _program->scope;
+    Resolver().Resolve(_program);
+    _tree = pool ? FlatTree::Build(_program, pool) : FlatTree::Build(_program);
 }
 
 void Parser::Serialize(std::ostream &os) {
-    _program->Serialize(os);
+    _tree->Serialize(os);
 }
@@ -0,0 +1,45 @@
+#include "syntax/Pipeline.h"
+#include "syntax/Lexer.h"
+
+static const int kSpins = 64;  // before a yield
+
+const uint32_t Pipeline::kBatch;
+const size_t Pipeline::kSlots;
+
+Pipeline::Pipeline(Lexer *lexer) : _diags(Diagnostics::Current()), _thread(&Pipeline::Produce, this, lexer) {}
+
+Pipeline::~Pipeline() {
+    _stop.store(true, std::memory_order_relaxed);
+    _thread.join();
+}
+
+void Pipeline::Produce(Lexer *lexer) {
+    DiagnosticsGuard guard(_diags);
+    bool end = false;
+    while (!end) {
+        Batch *batch;
+        for (int spins = 0; (batch = _ring.Back()) == nullptr; ++spins) {
+            if (_stop.load(std::memory_order_relaxed)) return;
+            if (spins >= kSpins) std::this_thread::yield();
+        }
+        uint32_t size = 0;
+        while (size < kBatch && !end) {
+            auto token = lexer->Pull();
+            batch->tokens[size++] = token;
+            end = token->tag == Token::END;
+        }
+        batch->size = size;
+        _ring.Push();
+    }
+}
+
+const Token *Pipeline::Pull() {
+    if (_batch == nullptr || _read == _batch->size) {
+        if (_batch != nullptr) _ring.Pop();
+        for (int spins = 0; (_batch = _ring.Front()) == nullptr; ++spins) {
+            if (spins >= kSpins) std::this_thread::yield();
+        }
+        _read = 0;
+    }
+    return _batch->tokens[_read++];
+}
@@ -0,0 +1,196 @@
+#include "syntax/Resolver.h"
+#include "syntax/ParseTree.h"
+#include "syntax/Error.h"
+
+const uint32_t Resolver::kNone;
+
+void Resolver::Resolve(Program *program) {
+    EnterFrame();
+    EnterBlock();
+    for (auto stmt:*program->stmtList) {
+        stmt->Resolve(this);
+    }
+    LeaveBlock();
+    program->frameSize = LeaveFrame();
+}
+
+int Resolver::Resolve(Stmt *const *stmts, size_t count, int base, std::function<Var *(Symbol)> globals) {
+    _globals = std::move(globals);
+    EnterFrame();
+    _frames.back() = base;
+    EnterBlock();
+    for (size_t i = 0; i < count; ++i) {
+        stmts[i]->Resolve(this);
+    }
+    LeaveBlock();
+    _globals = nullptr;
+    return LeaveFrame();
+}
+
+void Resolver::Bind(Var *var) {
+    auto found = _innermost.find(var->name);
+    auto shadowed = found == _innermost.end() ? kNone : found->second;
+    auto frame = (int) _frames.size() - 1;
+    var->depth = 0;
+    var->slot = _frames.back()++;
+    _innermost[var->name] = (uint32_t) _bindings.size();
+    _bindings.push_back({var->name, frame, var->slot, shadowed});
+}
+
+void Resolver::Lookup(Var *var) const {
+    auto found = _innermost.find(var->name);
+    if (found == _innermost.end()) {
+        if (auto global = _globals ? _globals(var->name) : nullptr) {
+            var->depth = (int) _frames.size() - 1;
+            var->slot = global->slot;
+            return;
+        }
+        var->depth = -1;
+        var->slot = -1;
+        return;
+    }
+    auto &binding = _bindings[found->second];
+    var->depth = (int) _frames.size() - 1 - binding.frame;
+    var->slot = binding.slot;
+}
+
+void Resolver::EnterFrame() {
+    _frames.push_back(0);
+}
+
+int Resolver::LeaveFrame() {
+    auto size = _frames.back();
+    _frames.pop_back();
+    return size;
+}
+
+void Resolver::EnterBlock() {
+    _blocks.push_back(_bindings.size());
+}
+
+void Resolver::LeaveBlock() {
+    auto mark = _blocks.back();
+    _blocks.pop_back();
+    while (_bindings.size() > mark) {
+        auto &binding = _bindings.back();
+        if (binding.shadowed == kNone) {
+            _innermost.erase(binding.name);
+        } else {
+            _innermost[binding.name] = binding.shadowed;
+        }
+        _bindings.pop_back();
+    }
+}
+
+/// Node resolution
+
+void Stmt::Resolve(Resolver *resolver) {
+    switch (kind) {
+        case VarStmt:
+            resolver->Lookup(var);
+            break;
+        case VarAssignStmt:
+            // let-in vars of the right value are temporaries of the global frame.
+            resolver->EnterBlock();
+            exp->Resolve(resolver);
+            resolver->LeaveBlock();
+            resolver->Bind(var);
+            break;
+        case FuncAssignStmt:
+            func->Resolve(resolver);
+            break;
+        default:
+            CompilePanic("unreachable");
+    }
+}
+
+void Exp::Resolve(Resolver *resolver) {
+    if (var != nullptr) resolver->Lookup(var);
+    for (auto expb:*expbList) {
+        expb->Resolve(resolver);
+    }
+}
+
+void Var::Resolve(Resolver *resolver) {
+    resolver->Lookup(this);
+}
+
+void Func::Resolve(Resolver *resolver) {
+    if (isRec) resolver->Bind(this);
+    resolver->EnterFrame();
+    resolver->EnterBlock();
+    for (auto param:*paramList) {
+        resolver->Bind(param);
+    }
+    if (body != nullptr) body->Resolve(resolver);
+    resolver->LeaveBlock();
+    frameSize = resolver->LeaveFrame();
+    if (!isRec) resolver->Bind(this);
+}
+
+void FuncCall::Resolve(Resolver *resolver) {
+    resolver->Lookup(this);
+    for (auto arg:*argList) {
+        arg->Resolve(resolver);
+    }
+}
+
+void ExpbBinary::Resolve(Resolver *resolver) {
+    SmallVec<ExpbBinary *> spine;
+    Spine(spine)->Resolve(resolver);
+    for (auto p = spine.end(); p != spine.begin();) {
+        (*--p)->_rhs->Resolve(resolver);
+    }
+}
+
+void ExpbUnary::Resolve(Resolver *resolver) {
+    _oprand->Resolve(resolver);
+}
+
+void ExpbCons::Resolve(Resolver *resolver) {
+    _first->Resolve(resolver);
+    _second->Resolve(resolver);
+}
+
+void ExpbCompound::Resolve(Resolver *resolver) {
+    _first->Resolve(resolver);
+    _second->Resolve(resolver);
+}
+
+void ExpbFst::Resolve(Resolver *resolver) {
+    _first->Resolve(resolver);
+    _second->Resolve(resolver);
+}
+
+void ExpbSnd::Resolve(Resolver *resolver) {
+    _first->Resolve(resolver);
+    _second->Resolve(resolver);
+}
+
+void ExpaIf::Resolve(Resolver *resolver) {
+    _cond->Resolve(resolver);
+    _then->Resolve(resolver);
+    if (_els != nullptr) _els->Resolve(resolver);
+}
+
+void ExpaWhile::Resolve(Resolver *resolver) {
+    _cond->Resolve(resolver);
+    _body->Resolve(resolver);
+}
+
+void ExpaLet::Resolve(Resolver *resolver) {
+    // let a = e1 and b = e2 in body: e1 and e2 do not see a and b.
+    for (auto &item:*expPairList) {
+        if (item.second != nullptr) item.second->Resolve(resolver);
+    }
+    resolver->EnterBlock();
+    for (auto &item:*expPairList) {
+        if (auto func = dynamic_cast<Func *>(item.first)) {
+            func->Resolve(resolver);
+        } else {
+            resolver->Bind(dynamic_cast<Var *>(item.first));
+        }
+    }
+    body->Resolve(resolver);
+    resolver->LeaveBlock();
+}
@@ -0,0 +1,155 @@
+#include "syntax/Scan.h"
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LEOML_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+/// Scalar
+// Table driven, also the tail of the vector kernels.
+enum {
+    C_SPACE = 1,
+    C_IDENT = 2,
+    C_DIGIT = 4,
+    C_STOP = 8,  // '*' and NUL, stop of the comment
+};
+
+struct ClassTable {
+    uint8_t c[256];
+
+    ClassTable() : c() {
+        for (const char *p = " \t\r\v\f"; *p; ++p) c[(uint8_t) *p] |= C_SPACE;
+        for (int i = 'a'; i <= 'z'; ++i) c[i] |= C_IDENT;
+        for (int i = 'A'; i <= 'Z'; ++i) c[i] |= C_IDENT;
+        for (int i = '0'; i <= '9'; ++i) c[i] |= C_IDENT | C_DIGIT;
+        c['_'] |= C_IDENT | C_DIGIT;
+        c['*'] |= C_STOP;
+        c[0] |= C_STOP;
+    }
+};
+
+static const ClassTable Table;
+
+static inline const char *ScalarSkip(const char *p, uint8_t cls) {
+    while (Table.c[(uint8_t) *p] & cls) ++p;
+    return p;
+}
+
+static inline const char *ScalarSkipComment(const char *p, unsigned *lines, const char **lineBegin) {
+    while (!(Table.c[(uint8_t) *p] & C_STOP)) {
+        if (*p == '\n') {
+            ++*lines;
+            *lineBegin = p + 1;
+        }
+        ++p;
+    }
+    return p;
+}
+
+static const char *ScalarSpace(const char *p, const char *) { return ScalarSkip(p, C_SPACE); }
+
+static const char *ScalarIdent(const char *p, const char *) { return ScalarSkip(p, C_IDENT); }
+
+static const char *ScalarDigit(const char *p, const char *) { return ScalarSkip(p, C_DIGIT); }
+
+static const char *ScalarComment(const char *p, const char *, unsigned *lines, const char **lineBegin) {
+    return ScalarSkipComment(p, lines, lineBegin);
+}
+
+static const ScanKernel ScalarKernel{"scalar", ScalarSpace, ScalarIdent, ScalarDigit, ScalarComment};
+
+#ifdef LEOML_SCAN_X86
+
+/// Vector kernels
+// V: vector type, W: width in bytes, B: width in bits, P: intrinsic prefix, M: mask type.
+// In(x, lo, hi) is the unsigned range test: min(x - lo, hi - lo) == x - lo.
+#define LEOML_SCAN_KERNELS(NAME, TARGET, V, W, B, P, M)                                      \
+TARGET static inline V NAME##Load(const char *p) { return P##_loadu_si##B((const V *) p); }  \
+TARGET static inline V NAME##Or(V x, V y) { return P##_or_si##B(x, y); }                     \
+TARGET static inline V NAME##Eq(V x, char c) { return P##_cmpeq_epi8(x, P##_set1_epi8(c)); } \
+TARGET static inline V NAME##In(V x, char lo, char hi) {                                     \
+    V d = P##_sub_epi8(x, P##_set1_epi8(lo));                                                \
+    return P##_cmpeq_epi8(P##_min_epu8(d, P##_set1_epi8((char) (hi - lo))), d);              \
+}                                                                                            \
+TARGET static inline M NAME##Mask(V x) { return (M) P##_movemask_epi8(x); }                  \
+TARGET static const char *NAME##Space(const char *p, const char *limit) {                    \
+    for (; p + W <= limit; p += W) {                                                         \
+        V x = NAME##Load(p);                                                                 \
+        V in = NAME##Or(NAME##Or(NAME##Eq(x, ' '), NAME##Eq(x, '\t')), NAME##In(x, '\v', '\r')); \
+        M out = ~NAME##Mask(in);                                                             \
+        if (out) return p + __builtin_ctz(out);                                              \
+    }                                                                                        \
+    return ScalarSkip(p, C_SPACE);                                                           \
+}                                                                                            \
+TARGET static const char *NAME##Ident(const char *p, const char *limit) {                    \
+    for (; p + W <= limit; p += W) {                                                         \
+        V x = NAME##Load(p);                                                                 \
+        V alpha = NAME##In(NAME##Or(x, P##_set1_epi8(0x20)), 'a', 'z');                      \
+        V in = NAME##Or(NAME##Or(alpha, NAME##In(x, '0', '9')), NAME##Eq(x, '_'));           \
+        M out = ~NAME##Mask(in);                                                             \
+        if (out) return p + __builtin_ctz(out);                                              \
+    }                                                                                        \
+    return ScalarSkip(p, C_IDENT);                                                           \
+}                                                                                            \
+TARGET static const char *NAME##Digit(const char *p, const char *limit) {                    \
+    for (; p + W <= limit; p += W) {                                                         \
+        V x = NAME##Load(p);                                                                 \
+        V in = NAME##Or(NAME##In(x, '0', '9'), NAME##Eq(x, '_'));                            \
+        M out = ~NAME##Mask(in);                                                             \
+        if (out) return p + __builtin_ctz(out);                                              \
+    }                                                                                        \
+    return ScalarSkip(p, C_DIGIT);                                                           \
+}                                                                                            \
+TARGET static const char *NAME##Comment(const char *p, const char *limit,                    \
+                                        unsigned *lines, const char **lineBegin) {           \
+    for (; p + W <= limit; p += W) {                                                         \
+        V x = NAME##Load(p);                                                                 \
+        M stop = NAME##Mask(NAME##Or(NAME##Eq(x, '*'), NAME##Eq(x, 0)));                     \
+        M nl = NAME##Mask(NAME##Eq(x, '\n'));                                                \
+        if (stop) nl &= (stop & -stop) - 1; /* newlines before the stop */                   \
+        if (nl) {                                                                            \
+            *lines += __builtin_popcount(nl);                                                \
+            *lineBegin = p + (31 - __builtin_clz(nl)) + 1;                                   \
+        }                                                                                    \
+        if (stop) return p + __builtin_ctz(stop);                                            \
+    }                                                                                        \
+    return ScalarSkipComment(p, lines, lineBegin);                                           \
+}                                                                                            \
+static const ScanKernel NAME##Kernel{#NAME, NAME##Space, NAME##Ident, NAME##Digit, NAME##Comment};
+
+LEOML_SCAN_KERNELS(Sse2, __attribute__((target("sse2"))), __m128i, 16, 128, _mm, uint16_t)
+
+LEOML_SCAN_KERNELS(Avx2, __attribute__((target("avx2,popcnt"))), __m256i, 32, 256, _mm256, uint32_t)
+
+#endif
+
+const ScanKernel *ScanKernel::Scalar() { return &ScalarKernel; }
+
+const ScanKernel *ScanKernel::Sse2() {
+#ifdef LEOML_SCAN_X86
+    __builtin_cpu_init();  // may run before main
+    if (__builtin_cpu_supports("sse2")) return &Sse2Kernel;
+#endif
+    return nullptr;
+}
+
+const ScanKernel *ScanKernel::Avx2() {
+#ifdef LEOML_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) return &Avx2Kernel;
+#endif
+    return nullptr;
+}
+
+static const ScanKernel *Best() {
+    if (auto kernel = ScanKernel::Avx2()) return kernel;
+    if (auto kernel = ScanKernel::Sse2()) return kernel;
+    return ScanKernel::Scalar();
+}
+
+static const ScanKernel *InUse = Best();
+
+const ScanKernel *ScanKernel::Current() { return InUse; }
+
+void ScanKernel::Use(const ScanKernel *kernel) { InUse = kernel ? kernel : Best(); }
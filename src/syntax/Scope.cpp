@@ -5,27 +5,36 @@
 
 #include "syntax/Scope.h"
 #include "syntax/ParseTree.h"
+#include <atomic>
+
+uint64_t &Scope::Generation() {
+    static std::atomic<uint64_t> threads{0};
+    static thread_local uint64_t generation = ++threads << 40;
+    return generation;
+}
+
+static const Symbol kNoName(UINT32_MAX);
 
 Var *Scope::Find(const Token *token) {
-    auto ret = Find(token->str);
+    auto ret = Find(token->Sym());
     if (ret) ret->SetTok(token);
     return ret;
 }
 
 Var *Scope::FindInCurScope(const Token *token) {
-    auto ret = FindInCurScope(token->str);
+    auto ret = FindInCurScope(token->Sym());
     if (ret) ret->SetTok(token);
     return ret;
 }
 
 Var *Scope::FindTag(const Token *token) {
-    auto ret = FindTag(token->str);
+    auto ret = FindTag(token->Sym());
     if (ret) ret->SetTok(token);
     return ret;
 }
 
 Var *Scope::FindTagInCurScope(const Token *token) {
-    auto ret = FindTagInCurScope(token->str);
+    auto ret = FindTagInCurScope(token->Sym());
     if (ret) ret->SetTok(token);
     return ret;
 }
@@ -35,68 +44,124 @@ void Scope::Insert(Var *var) {
 }
 
 void Scope::InsertTag(Var *var) {
-    Insert(TagName(var->name), var);
+    Insert(var->name.Tag(), var);
 }
 
 void Scope::Append(Scope *other) {
-    for (auto &item:other->_map) {
-        _map.insert(item);
+    if (other == nullptr || other == this) return;
+    for (auto linked:_linked) {
+        if (linked == other) return;
+    }
+    _linked.push_back(other);
+    ++Generation();
+}
+
+Var *Scope::FindOwn(Symbol name) const {
+    if (_size == 0) return nullptr;
+    auto mask = _slots - 1;
+    for (auto i = std::hash<Symbol>()(name) & mask;; i = (i + 1) & mask) {
+        auto &binding = _table[i];
+        if (binding.name == name) return binding.var;
+        if (binding.name == kNoName) return nullptr;
     }
 }
 
-Var *Scope::Find(const std::string &name) {
-    auto var = _map.find(name);
-    if (var != _map.end())
-        return var->second;
+Var *Scope::Find(Symbol name) {
+    if (auto var = FindInCurScope(name))
+        return var;
     if (_kind == S_FILE || _parent == nullptr)
         return nullptr;
-    return _parent->Find(name);
+    auto &memo = _memo[name.Id() % kMemoSlots];
+    auto generation = Generation();
+    if (memo.generation == generation && memo.name == name)
+        return memo.var;
+    // Walk the chain without recursion, deep let-in nests are common.
+    Var *var = nullptr;
+    for (auto scope = _parent; scope != nullptr; scope = scope->_parent) {
+        if ((var = scope->FindInCurScope(name)) || scope->_kind == S_FILE)
+            break;
+    }
+    memo = {name, var, generation};
+    return var;
 }
 
-Var *Scope::FindInCurScope(const std::string &name) {
-    auto var = _map.find(name);
-    if (var == _map.end())
+Var *Scope::FindInCurScope(Symbol name) {
+    if (auto var = FindOwn(name))
+        return var;
+    if (_linked.empty() || _visiting)
         return nullptr;
-    return var->second;
+    _visiting = true;
+    Var *var = nullptr;
+    for (auto linked:_linked) {
+        if ((var = linked->FindInCurScope(name)))
+            break;
+    }
+    _visiting = false;
+    return var;
 }
 
-void Scope::Insert(const std::string &name, Var *var) {
+void Scope::Insert(Symbol name, Var *var) {
     assert(var != nullptr);
-    _map[name] = var;
+    assert(name != kNoName);
+    if ((_size + 1) * 2 > _slots)
+        Grow();
+    auto mask = _slots - 1;
+    auto i = std::hash<Symbol>()(name) & mask;
+    while (_table[i].name != kNoName && _table[i].name != name)
+        i = (i + 1) & mask;
+    if (_table[i].name == kNoName)
+        ++_size;
+    _table[i] = {name, var};
+    ++Generation();
+}
+
+void Scope::Grow() {
+    auto nslots = _slots < kMinSlots ? kMinSlots : _slots * 2;
+    auto table = _table;
+    auto old = _slots;
+    _table = (Binding *) _arena->Alloc(nslots * sizeof(Binding), alignof(Binding));
+    _slots = nslots;
+    for (size_t i = 0; i < nslots; ++i) _table[i] = {kNoName, nullptr};
+    auto mask = _slots - 1;
+    for (size_t j = 0; j < old; ++j) {
+        auto &binding = table[j];
+        if (binding.name == kNoName) continue;
+        auto i = std::hash<Symbol>()(binding.name) & mask;
+        while (_table[i].name != kNoName) i = (i + 1) & mask;
+        _table[i] = binding;
+    }
 }
 
-Var *Scope::FindTag(const std::string &name) {
-    auto ret = Find(TagName(name));
+Var *Scope::FindTag(Symbol name) {
+    auto ret = Find(name.Tag());
     return ret;
 }
 
-Var *Scope::FindTagInCurScope(const std::string &name) {
-    auto ret = FindInCurScope(TagName(name));
+Var *Scope::FindTagInCurScope(Symbol name) {
+    auto ret = FindInCurScope(name.Tag());
     return ret;
 }
 
 Scope::TagList Scope::AllTagsInCurScope() const {
     TagList ret;
-    for (auto &kv: _map) {
-        if (IsTagName(kv.first))
-            ret.push_back(kv.second);
+    for (size_t i = 0; i < _slots; ++i) {
+        auto &binding = _table[i];
+        if (binding.name != kNoName && binding.name.IsTag())
+            ret.push_back(binding.var);
     }
     return ret;
 }
 
 void Scope::Serialize(std::ostream &os) {
     os << "scope: " << this << std::endl;
-    auto iter = _map.begin();
-    for (; iter != _map.end(); ++iter) {
-        auto name = iter->first;
-        auto var = iter->second;
-        if (var != nullptr) {
-            os << name << "\t[type:\t"
-               << var->GetType()->GetName() << "]" << std::endl;
-        } else {
-            os << name << "\t[object:\t"
-               << var->GetType()->GetName() << "]" << std::endl;
-        }
+    for (size_t i = 0; i < _slots; ++i) {
+        auto &binding = _table[i];
+        if (binding.name == kNoName) continue;
+        os << binding.name << "\t[type:\t"
+           << Type::Name(binding.var->GetType()) << "]" << std::endl;
+    }
+    for (auto linked:_linked) {
+        os << "linked: " << linked << std::endl;
     }
-    std::cout << std::endl;
+    os << std::endl;
 }
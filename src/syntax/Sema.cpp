@@ -0,0 +1,156 @@
+#include "syntax/Sema.h"
+#include "syntax/Diagnostics.h"
+#include "syntax/Error.h"
+
+const uint32_t Sema::kNone;
+
+void Sema::Add(Kind kind, ParseTreeNode *node, ParseTreeNode *other) {
+    if (kind >= C_RecFunc && _global == kNone) _global = (uint32_t) _checks.size();
+    _checks.push_back({kind, node, other});
+}
+
+void Sema::EndStmt() {
+    auto end = (uint32_t) _checks.size();
+    _spans.push_back({_begin, _global == kNone ? end : _global, end, false});
+    _begin = end;
+    _global = kNone;
+}
+
+void Sema::DropStmt() {
+    _checks.resize(_begin);
+    _global = kNone;
+}
+
+void Sema::Run(Program *program) {
+    ArenaGuard guard(_arena);
+    for (auto &span:_spans) {
+        if (Diagnostics::Stopped()) break;
+        Run(span, span.begin, span.end, program);
+    }
+    Clear();
+}
+
+void Sema::RunLocal() {
+    ArenaGuard guard(_arena);
+    for (auto &span:_spans) {
+        if (Diagnostics::Stopped()) break;
+        Run(span, span.begin, span.global, nullptr);
+    }
+}
+
+void Sema::RunGlobal(Program *program) {
+    ArenaGuard guard(_arena);
+    for (auto &span:_spans) {
+        if (Diagnostics::Stopped()) break;
+        Run(span, span.global, span.end, program);
+    }
+    Clear();
+}
+
+void Sema::Run(Span &span, uint32_t begin, uint32_t end, Program *program) {
+    auto i = begin;
+    while (i < end && !span.failed) {
+        try {
+            for (; i < end; ++i) Do(_checks[i], program);
+        } catch (const Diagnostics::Recovery &) {
+            span.failed = true;
+        }
+    }
+    for (; i < end; ++i) Define(_checks[i], program);  // the failed one too
+}
+
+void Sema::Clear() {
+    std::vector<Check>().swap(_checks);
+    std::vector<Span>().swap(_spans);
+    _begin = 0;
+    _global = kNone;
+}
+
+void Sema::Do(const Check &check, Program *program) {
+    switch (check.kind) {
+        case C_Var: {
+            auto var = static_cast<Var *>(check.node);
+            var->scope->Insert(var);
+            break;
+        }
+        case C_Scope:
+            static_cast<Exp *>(check.node)->ScopeCheck();
+            break;
+        case C_Expb: {
+            auto exp = static_cast<Exp *>(check.node);
+            auto expb = static_cast<Expb *>(check.other);
+            exp->SetType(expb->GetType());
+            exp->scope->Append(expb->scope);
+            break;
+        }
+        case C_Type:
+            static_cast<Exp *>(check.node)->TypeCheck();
+            break;
+        case C_TypeScope: {
+            auto exp = static_cast<Exp *>(check.node);
+            exp->TypeCheck();
+            exp->ScopeCheck();
+            break;
+        }
+        case C_RecFunc:
+            program->scope->Insert(static_cast<Func *>(check.node));
+            break;
+        case C_FuncCall: {
+            auto call = static_cast<FuncCall *>(check.node);
+            auto fund = dynamic_cast<Func *>(program->scope->Find(call->GetRoot()));
+            if (fund == nullptr) { CompileError(call->GetRoot(), "undefined func here"); }
+            if (fund->failed) throw Diagnostics::Recovery{nullptr};  // reported at the func
+            call->proto = fund;
+            call->scope->Insert(call);
+            call->TypeCheck();
+            break;
+        }
+        case C_VarAssign: {
+            auto stmt = static_cast<Stmt *>(check.node);
+            stmt->scope->Parent()->Insert(stmt->var);
+            stmt->var->scope->SetParent(stmt->scope);
+            stmt->var->SetType(stmt->exp->GetType());  // only infer
+            break;
+        }
+        case C_FuncAssign: {
+            auto stmt = static_cast<Stmt *>(check.node);
+            stmt->scope->Parent()->Insert(stmt->func);
+            stmt->func->scope->SetParent(stmt->scope);
+            stmt->func->TypeCheck();
+            break;
+        }
+        case C_VarStmt: {
+            auto stmt = static_cast<Stmt *>(check.node);
+            auto var = static_cast<Var *>(check.other);
+            auto varFound = program->scope->Find(var->GetRoot());
+            if (!varFound) { CompileError(var->GetRoot(), "undefined var here"); }
+            stmt->var = varFound;
+            break;
+        }
+        default:
+            CompilePanic("unreachable");
+    }
+}
+
+void Sema::Define(const Check &check, Program *program) {
+    switch (check.kind) {
+        case C_RecFunc:
+            program->scope->Insert(static_cast<Func *>(check.node));
+            break;
+        case C_VarAssign: {
+            auto stmt = static_cast<Stmt *>(check.node);
+            stmt->scope->Parent()->Insert(stmt->var);
+            stmt->var->scope->SetParent(stmt->scope);
+            break;
+        }
+        case C_FuncAssign: {
+            auto stmt = static_cast<Stmt *>(check.node);
+            stmt->scope->Parent()->Insert(stmt->func);
+            stmt->func->scope->SetParent(stmt->scope);
+            stmt->func->failed = true;
+            break;
+        }
+        default:
+            break;
+    }
+}
@@ -0,0 +1,94 @@
+#include "syntax/Source.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Small files are cheaper to read than to map.
+static const size_t kMapThreshold = 16 * 1024;
+
+static size_t RoundUp(size_t n, size_t align) {
+    return (n + align - 1) / align * align;
+}
+
+SourceBuffer::~SourceBuffer() {
+    if (_mapped) {
+        munmap(_data, _capacity);
+    } else {
+        free(_data);
+    }
+}
+
+SourceBuffer *SourceBuffer::Open(const std::string &path) {
+    if (path == "-")
+        return Read(STDIN_FILENO, 0);
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat st{};
+    SourceBuffer *ret = nullptr;
+    if (fstat(fd, &st) == 0) {
+        if (S_ISREG(st.st_mode) && (size_t) st.st_size >= kMapThreshold) {
+            ret = Map(fd, st.st_size);
+        }
+        if (ret == nullptr) {
+            ret = Read(fd, S_ISREG(st.st_mode) ? st.st_size : 0);
+        }
+    }
+    close(fd);
+    return ret;
+}
+
+SourceBuffer *SourceBuffer::New(const char *text, size_t size) {
+    auto data = (char *) malloc(size + kPadding);
+    memcpy(data, text, size);
+    memset(data + size, 0, kPadding);
+    return new SourceBuffer(data, size, size + kPadding, false);
+}
+
+/// Map
+// Reserve zeroed anonymous pages first, then map the file over the head of them.
+// The tail of the last file page is zero-filled by the kernel, the rest is anonymous.
+SourceBuffer *SourceBuffer::Map(int fd, size_t size) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t capacity = RoundUp(size + kPadding, page);
+    void *base = mmap(nullptr, capacity, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return nullptr;
+    void *file = mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    if (file == MAP_FAILED) {
+        munmap(base, capacity);
+        return nullptr;
+    }
+    madvise(base, size, MADV_SEQUENTIAL);
+    return new SourceBuffer((char *) base, size, capacity, true);
+}
+
+/// Read
+// Streaming fallback, for pipes, stdin and small files.
+SourceBuffer *SourceBuffer::Read(int fd, size_t hint) {
+    size_t capacity = RoundUp((hint ? hint : 64 * 1024) + kPadding, 4096);
+    auto data = (char *) malloc(capacity);
+    size_t size = 0;
+    while (true) {
+        if (capacity - size < kPadding + 1) {
+            capacity *= 2;
+            data = (char *) realloc(data, capacity);
+        }
+        ssize_t n = read(fd, data + size, capacity - size - kPadding);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            free(data);
+            return nullptr;
+        }
+        if (n == 0)
+            break;
+        size += n;
+    }
+    memset(data + size, 0, kPadding);
+    return new SourceBuffer(data, size, capacity, false);
+}
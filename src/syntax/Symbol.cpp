@@ -0,0 +1,151 @@
+#include "syntax/Symbol.h"
+#include "syntax/Arena.h"
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+/// SymbolTable
+// Open addressing over the ids, linear probing. The names are copied
+// into an arena once and never move, nor do the entries, which are kept in
+// chunks doubling in size, so that a name is read without the lock while
+// another thread interns.
+class SymbolTable {
+public:
+    std::mutex lock;
+    std::atomic<int> sharers{0};  // count of the Shared guards alive
+
+    SymbolTable() : _slots(kInitSlots, kEmpty) {
+        Intern("", 0);
+    }
+
+    ~SymbolTable() {
+        for (auto chunk:_chunks) delete[] chunk;
+    }
+
+    uint32_t Intern(const char *name, size_t size) { return Intern(name, size, Hash(name, size)); }
+
+    uint32_t Intern(const char *name, size_t size, uint32_t hash) {
+        auto mask = _slots.size() - 1;
+        for (auto i = hash & mask;; i = (i + 1) & mask) {
+            auto id = _slots[i];
+            if (id == kEmpty) break;
+            auto &entry = At(id);
+            if (entry.hash == hash && entry.size == size && memcmp(entry.name, name, size) == 0)
+                return id;
+        }
+        auto id = _count;
+        auto chunk = Chunk(id);
+        if (_chunks[chunk] == nullptr) _chunks[chunk] = new Entry[kChunkSize << chunk];
+        At(id) = {_names.CopyStr(name, size), (uint32_t) size, hash};
+        ++_count;
+        if ((size_t) _count * 2 > _slots.size()) {
+            Rehash(_slots.size() * 2);
+        } else {
+            Place(id);
+        }
+        return id;
+    }
+
+    const char *Name(uint32_t id) const { return At(id).name; }
+
+    size_t Size(uint32_t id) const { return At(id).size; }
+
+    size_t Count() const { return _count; }
+
+    // FNV-1a
+    static uint32_t Hash(const char *name, size_t size) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= (uint8_t) name[i];
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+private:
+    static const size_t kInitSlots = 1024;
+    static const uint32_t kEmpty = UINT32_MAX;
+    static const uint32_t kChunkSize = 1024;  // of the first chunk
+    static const int kChunks = 22;  // up to kChunkSize << 22 names
+
+    struct Entry {
+        const char *name;
+        uint32_t size;
+        uint32_t hash;
+    };
+
+    Entry *_chunks[kChunks]{};
+    uint32_t _count{0};
+    std::vector<uint32_t> _slots;
+    Arena _names;
+
+    // Chunk k holds the ids from kChunkSize * (2^k - 1) on.
+    static int Chunk(uint32_t id) { return 31 - __builtin_clz(id / kChunkSize + 1); }
+
+    Entry &At(uint32_t id) const {
+        auto chunk = Chunk(id);
+        return _chunks[chunk][id - kChunkSize * ((1u << chunk) - 1)];
+    }
+
+    void Place(uint32_t id) {
+        auto mask = _slots.size() - 1;
+        auto i = At(id).hash & mask;
+        while (_slots[i] != kEmpty) i = (i + 1) & mask;
+        _slots[i] = id;
+    }
+
+    void Rehash(size_t nslots) {
+        _slots.assign(nslots, kEmpty);
+        for (uint32_t id = 0; id < _count; ++id) Place(id);
+    }
+};
+
+const uint32_t SymbolTable::kEmpty;
+
+// Built on the first use, so that it is ready for static initializers.
+static SymbolTable &Table() {
+    static SymbolTable table;
+    return table;
+}
+
+/// InternCache
+// Direct mapped, per thread, in front of the locked table, so that the threads
+// sharing it seldom meet on the lock. The names cached are the copies in the
+// table, which never move, and an id never changes, so an entry stays valid.
+struct InternCache {
+    static const size_t kSlots = 4096;
+
+    struct Entry {
+        const char *name;
+        uint32_t size;
+        uint32_t id;
+    };
+
+    Entry entries[kSlots];
+};
+
+Symbol Symbol::Intern(const char *name, size_t size) {
+    auto &table = Table();
+    if (table.sharers.load(std::memory_order_relaxed) == 0)
+        return Symbol(table.Intern(name, size));
+    static thread_local InternCache cache{};
+    auto hash = SymbolTable::Hash(name, size);
+    auto &entry = cache.entries[hash & (InternCache::kSlots - 1)];
+    if (entry.name && entry.size == size && memcmp(entry.name, name, size) == 0)
+        return Symbol(entry.id);
+    std::lock_guard<std::mutex> guard(table.lock);
+    auto id = table.Intern(name, size, hash);
+    entry = {table.Name(id), (uint32_t) size, id};
+    return Symbol(id);
+}
+
+Symbol::Shared::Shared() { ++Table().sharers; }
+
+Symbol::Shared::~Shared() { --Table().sharers; }
+
+size_t Symbol::Count() { return Table().Count(); }
+
+const char *Symbol::data() const { return Table().Name(Untag()._id); }
+
+size_t Symbol::size() const { return Table().Size(Untag()._id); }
@@ -0,0 +1,90 @@
+#include "syntax/ThreadPool.h"
+#include <cassert>
+
+// The pool and the index of the worker running on this thread, if any.
+static thread_local ThreadPool *CurrentPool = nullptr;
+static thread_local unsigned CurrentWorker = 0;
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    for (unsigned i = 0; i < threads; ++i) {
+        _queues.emplace_back(new Queue);
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        _workers.emplace_back(&ThreadPool::Work, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _stop = true;
+    }
+    _ready.notify_all();
+    for (auto &worker:_workers) worker.join();
+}
+
+void ThreadPool::Submit(Task task) {
+    ++_pending;
+    auto self = CurrentPool == this ? CurrentWorker : _next++ % Size();
+    {
+        auto &queue = *_queues[self];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> guard(_lock);  // no lost wakeup
+        ++_queued;
+    }
+    _ready.notify_one();
+}
+
+void ThreadPool::Wait() {
+    assert(CurrentPool != this && "Wait from a task of the pool");
+    std::unique_lock<std::mutex> guard(_lock);
+    _idle.wait(guard, [this] { return _pending == 0; });
+}
+
+/// Take
+// The newest task of our own deque, which is the warmest in the cache,
+// or else the oldest one of the others.
+bool ThreadPool::Take(unsigned self, Task &task) {
+    auto n = Size();
+    for (unsigned i = 0; i < n; ++i) {
+        auto &queue = *_queues[(self + i) % n];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.tasks.empty()) continue;
+        if (i == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            ++_steals;
+        }
+        --_queued;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::Work(unsigned self) {
+    CurrentPool = this;
+    CurrentWorker = self;
+    while (true) {
+        Task task;
+        if (Take(self, task)) {
+            task();
+            task = nullptr;  // release the captures before the waiters go on
+            if (--_pending == 0) {
+                std::lock_guard<std::mutex> guard(_lock);
+                _idle.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(_lock);
+        _ready.wait(guard, [this] { return _stop || _queued > 0; });
+        if (_stop && _queued == 0) return;
+    }
+}
@@ -5,6 +5,7 @@
 
 #include "syntax/Token.h"
 #include "syntax/Error.h"
+#include "syntax/Lexer.h"
 
 const std::unordered_map<int, const char *> Token::TagMap{
         {'(',           ")"},
@@ -65,6 +66,61 @@ const std::unordered_map<std::string, int> Token::KwMap{
         {"snd",   Token::Snd},
 };
 
+static inline bool KwEq(const char *word, const char *kw, size_t size) {
+    return memcmp(word, kw, size) == 0;
+}
+
+int Token::KwClassify(const char *word, size_t size) {
+#define KW(str, tag) if (KwEq(word, str, size)) return tag; break
+    switch (size) {
+        case 2:
+            switch (word[0]) {
+                case 'i':
+                    if (word[1] == 'n') return Token::In;
+                    if (word[1] == 'f') return Token::If;
+                    break;
+                case 'd':
+                    KW("do", Token::Do);
+            }
+            break;
+        case 3:
+            switch (word[0]) {
+                case 'l':
+                    KW("let", Token::Let);
+                case 'r':
+                    KW("rec", Token::Rec);
+                case 'a':
+                    KW("and", Token::And);
+                case 'f':
+                    KW("fst", Token::Fst);
+                case 's':
+                    KW("snd", Token::Snd);
+            }
+            break;
+        case 4:
+            switch (word[0]) {
+                case 't':
+                    if (KwEq(word, "then", 4)) return Token::Then;
+                    KW("true", Token::Bool);
+                case 'e':
+                    KW("else", Token::Else);
+                case 'd':
+                    KW("done", Token::Done);
+            }
+            break;
+        case 5:
+            switch (word[0]) {
+                case 'w':
+                    KW("while", Token::While);
+                case 'f':
+                    KW("false", Token::Bool);
+            }
+            break;
+    }
+#undef KW
+    return Token::Var;
+}
+
 const std::unordered_map<int, int> Token::PrecMap{
         {Token::Semi,  1},  // lowest
 
@@ -92,6 +148,21 @@ const std::unordered_map<int, int> Token::PrecMap{
         {Token::LP,    8},
 };
 
+struct InfixTable {
+    Token::Infix infix[Token::kTagCount + 1];  // the last one for the tags out of range
+
+    InfixTable() {
+        for (auto &item:infix) item = Token::Infix{-1, false};
+        for (auto item:Token::PrecMap) infix[item.first] = Token::Infix{(int8_t) item.second, false};
+    }
+};
+
+static const InfixTable Infixes;
+
+const Token::Infix &Token::InfixLookup(int tag) {
+    return Infixes.infix[tag >= 0 && tag < kTagCount ? tag : kTagCount];
+}
+
 std::ostream &operator<<(std::ostream &os, const Token &token) {
     os << "tag: " << token.tag <<
        "\tstr: " << token.str <<
@@ -99,53 +170,90 @@ std::ostream &operator<<(std::ostream &os, const Token &token) {
     return os;
 }
 
+const uint32_t TokenList::kNone;
+
+void TokenList::Fill(uint32_t i) {
+    while (size() <= i) {
+        auto token = source->Pull();
+        if (token->tag == Token::END) {
+            eof = *token;
+            eof.str = "\n";  // as the newline Tokenize ends with
+            source = nullptr;
+            return;
+        }
+        PushBack(token);
+    }
+    if (tokens.size() > peak) peak = tokens.size();
+}
+
+void TokenList::Release(uint32_t i) {
+    auto keep = Prior(i);
+    if (keep == kNone || keep <= base) return;
+    auto n = keep - base;
+    if (n < 64 || n < tokens.size() / 2) return;  // amortized, the window moves by halves
+    tokens.erase(tokens.begin(), tokens.begin() + n);
+    next.erase(next.begin(), next.begin() + n);
+    prev.erase(prev.begin(), prev.begin() + n);
+    base = keep;
+}
+
+const uint32_t TokenSequence::kOpen;
+
 TokenSequence TokenSequence::GetLine() {
     auto begin = _begin;
-    while (_begin != _end && (*_begin)->tag != Token::NEW_LINE)
-        ++_begin;
     auto end = _begin;
-    return {tokenList, begin, end};
+    while (end < _end && tokenList->At(end)->tag != Token::NEW_LINE)
+        ++end;
+    _begin = Normalize(end);
+    TokenSequence ret{tokenList, begin, end};
+    ret.arena = arena;
+    return ret;
 }
 
 bool TokenSequence::IsBeginOfLine() const {
-    if (_begin == tokenList->begin())
+    if (_begin == 0)
         return true;
-    auto pre = _begin;
-    --pre;
-    return ((*pre)->tag == Token::NEW_LINE ||
-            (*pre)->loc.filename != (*_begin)->loc.filename);
+    auto list = tokenList;
+    return (list->At(_begin - 1)->tag == Token::NEW_LINE ||
+            (_begin < _end && list->At(_begin - 1)->loc.filename != list->At(_begin)->loc.filename));
 }
 
-
-const Token *TokenSequence::Peek() const {
-    static auto eof = Token::New(Token::END);
-    if (_begin != _end && (*_begin)->tag == Token::NEW_LINE) {
-        ++_begin;
-        return Peek();
-    } else if (_begin == _end) {
-        if (_end != tokenList->begin())
-            *eof = *Back();
-        eof->tag = Token::END;
-        return eof;
-    } else if (_parser && (*_begin)->tag == Token::Var) {
-        auto filename = Token::New(*(*_begin));
-        filename->tag = Token::String;
-        *_begin = filename;
+// The END token lies at the location of the last token.
+std::vector<TokenSequence> TokenSequence::Split(int tag, unsigned n) const {
+    assert(!tokenList->streamed);
+    std::vector<TokenSequence> ret;
+    Position minTokens = (_end - _begin) / (n ? n : 1);
+    auto begin = _begin;
+    for (auto i = _begin; i < _end; ++i) {
+        if (tokenList->At(i)->tag == tag && i + 1 - begin >= minTokens) {
+            ret.emplace_back(tokenList, begin, i + 1);
+            begin = i + 1;
+        }
     }
-    return *_begin;
+    if (begin < _end) ret.emplace_back(tokenList, begin, _end);
+    return ret;
+}
+
+const Token *TokenSequence::Eof() const {
+    if (tokenList->streamed)
+        _eof = tokenList->eof;
+    else if (_end > 0)
+        _eof = *Back();
+    _eof.tag = Token::END;
+    return &_eof;
 }
 
 const Token *TokenSequence::Expect(int expect) {
     auto token = Peek();
     if (!Try(expect)) {
         CompileError(token, "Token `%s` expected, but got `%s`",
-                     Token::TagLookup(expect), token->str.c_str());
+                     Token::TagLookup(expect), token->str.str().c_str());
     }
     return token;
 }
 
 void TokenSequence::Serialize(std::ostream &os) {
     while (!Empty()) {
-        os << *(Next()) << std::endl;
+        os << *(Next()) << '\n';
     };
 }
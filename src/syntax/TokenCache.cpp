@@ -0,0 +1,222 @@
+#include "syntax/TokenCache.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <unordered_map>
+
+const uint32_t TokenCache::kMagic;
+const uint32_t TokenCache::kFormat;
+const size_t TokenCache::kHeaderSize;
+
+// Little endian, whatever the host.
+static void PutFixed(std::string &out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) out.push_back((char) (value >> (8 * i)));
+}
+
+static uint64_t GetFixed(const char *p, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) value |= (uint64_t) (uint8_t) p[i] << (8 * i);
+    return value;
+}
+
+static void PutVarint(std::string &out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((char) (value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char) value);
+}
+
+/// GetVarint
+// The file is followed by the zero padding of the SourceBuffer, so a varint
+// cut at the end stops there, and the reader only checks the bounds per token.
+static uint64_t GetVarint(const char *&p) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        auto byte = (uint8_t) *p++;
+        value |= (uint64_t) (byte & 0x7f) << shift;
+        if (byte < 0x80) break;
+    }
+    return value;
+}
+
+/// Lexed
+// The tags the Lexer makes, with their texts if fixed, but INVALID: a source
+// with errors is not written. In the order of the enum, their values make the
+// Version.
+static const struct {
+    int tag;
+    const char *text;
+} kLexed[] = {
+        {Token::NEW_LINE, "\n"}, {'(', "("}, {')', ")"}, {'*', "*"}, {'+', "+"}, {',', ","}, {'-', "-"},
+        {'/', "/"}, {';', ";"}, {'<', "<"}, {'=', "="}, {'>', ">"},
+        {Token::Dsemi, ";;"}, {Token::Le, "<="}, {Token::Ge, ">="}, {Token::Eq, "=="}, {Token::Ne, "<>"},
+        {Token::An, "&&"}, {Token::Or, "||"},
+        {Token::Let, "let"}, {Token::And, "and"}, {Token::In, "in"}, {Token::If, "if"}, {Token::Then, "then"},
+        {Token::Else, "else"}, {Token::While, "while"}, {Token::Do, "do"}, {Token::Done, "done"},
+        {Token::Fst, "fst"}, {Token::Snd, "snd"}, {Token::Rec, "rec"},
+        {Token::Var, nullptr}, {Token::Unit, "()"}, {Token::Bool, nullptr}, {Token::Int, nullptr},
+        {Token::Float, nullptr}, {Token::String, nullptr},
+};
+
+uint32_t TokenCache::Version() {
+    auto hash = 0x811c9dc5u ^ kFormat;  // FNV-1a of the tags
+    for (auto &lexed:kLexed) {
+        hash ^= (uint32_t) lexed.tag;
+        hash *= 0x01000193u;
+    }
+    return hash;
+}
+
+static bool IsIdent(char c) { return isalnum((unsigned char) c) || c == '_'; }
+
+/// Lexes
+// Whether the Lexer makes a token of the tag from the text. The parser takes
+// the literals apart again, as numbers or names, and trusts their shape.
+static bool Lexes(int tag, const TokenStr &str) {
+    auto s = str.data();
+    auto n = str.size();
+    for (auto &lexed:kLexed) {
+        if (lexed.tag != tag) continue;
+        if (lexed.text) return str == TokenStr(lexed.text);
+        switch (tag) {
+            case Token::Var:
+                return n > 0 && !isdigit((unsigned char) s[0]) && std::all_of(s, s + n, IsIdent) &&
+                       Token::KwClassify(s, n) == Token::Var;
+            case Token::Bool:
+                return str == TokenStr("true") || str == TokenStr("false");
+            case Token::Int:
+            case Token::Float: {  // a digit, then digits, '_' and as many dots as the tag says
+                auto dots = std::count(s, s + n, '.');
+                return n > 0 && isdigit((unsigned char) s[0]) && dots == (tag == Token::Float ? 1 : 0) &&
+                       std::all_of(s, s + n, [](char c) { return c == '.' || c == '_' || isdigit((unsigned char) c); });
+            }
+            default:  // String
+                return n > 0 && s[0] == '"';
+        }
+    }
+    return false;
+}
+
+// The deltas of the offsets and the lines, of either sign.
+static uint64_t ZigZag(int64_t value) { return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63); }
+
+static int64_t UnZigZag(uint64_t value) { return (int64_t) (value >> 1) ^ -(int64_t) (value & 1); }
+
+void TokenCache::Write(std::ostream &os, const char *text, size_t size, const TokenSequence &ts) {
+    auto list = ts.GetList();
+    assert(!list->streamed);
+    std::unordered_map<std::string, uint32_t> interned;
+    std::string strs, code;
+    int64_t offset = 0, line = 0;
+    for (auto token:list->tokens) {
+        auto str = token->str.str();
+        auto found = interned.find(str);
+        if (found == interned.end()) {
+            found = interned.emplace(str, (uint32_t) interned.size()).first;
+            PutVarint(strs, str.size());
+            strs.append(str);
+        }
+        auto begin = token->loc.Begin() - text;
+        assert(begin >= 0 && (size_t) begin <= size);
+        PutVarint(code, token->tag - Token::INVALID);
+        PutVarint(code, found->second);
+        PutVarint(code, ZigZag(begin - offset));
+        PutVarint(code, ZigZag(token->loc.line - line));
+        PutVarint(code, token->loc.column);
+        offset = begin;
+        line = token->loc.line;
+    }
+    std::string header;
+    PutFixed(header, kMagic, 4);
+    PutFixed(header, Version(), 4);
+    PutFixed(header, size, 8);
+    PutFixed(header, list->tokens.size(), 4);
+    PutFixed(header, interned.size(), 4);
+    os.write(header.data(), header.size());
+    os.write(text, size);
+    os.put(0);
+    os.write(strs.data(), strs.size());
+    os.write(code.data(), code.size());
+}
+
+TokenCache *TokenCache::Open(const std::string &path) {
+    auto file = SourceBuffer::Open(path);
+    return file ? New(file) : nullptr;
+}
+
+TokenCache *TokenCache::New(SourceBuffer *file) {
+    auto ret = new TokenCache(file);
+    if (!ret->Load()) {
+        delete ret;
+        return nullptr;
+    }
+    return ret;
+}
+
+bool TokenCache::Load() {
+    auto p = _file->Begin(), end = _file->End();
+    if ((size_t) (end - p) < kHeaderSize || GetFixed(p, 4) != kMagic || GetFixed(p + 4, 4) != Version())
+        return false;
+    _textSize = GetFixed(p + 8, 8);
+    _tokens = (uint32_t) GetFixed(p + 16, 4);
+    auto strings = (uint32_t) GetFixed(p + 20, 4);
+    p += kHeaderSize;
+    if (_textSize >= (size_t) (end - p) || p[_textSize] != 0) return false;
+    // a byte a string and five a token at least, before anything is reserved
+    if (strings > (size_t) (end - p) || _tokens > (size_t) (end - p) / 5) return false;
+    _text = p;
+    p += _textSize + 1;
+    _strs.reserve(strings);
+    for (uint32_t i = 0; i < strings; ++i) {
+        auto size = GetVarint(p);
+        if (p > end || size > (size_t) (end - p)) return true;  // the text reads, the tokens do not
+        _strs.emplace_back(p, size);
+        p += size;
+    }
+    _syms.resize(strings);
+    _tags.assign(strings, Token::NOTOKEN);
+    _code = p;
+    return true;
+}
+
+bool TokenCache::Read(TokenSequence &ts, const std::string *filename) {
+    assert(ts._owner && ts.tokenList->size() == 0);
+    if (_code == nullptr) return false;
+    auto list = ts.tokenList;
+    auto arena = ts.GetArena();
+    list->tokens.reserve(_tokens);
+    list->prev.reserve(_tokens);
+    list->next.reserve(_tokens + 1);
+    auto p = _code, end = _file->End();
+    Token token(Token::END);
+    token.loc.filename = filename;
+    int64_t offset = 0, line = 0;
+    for (uint32_t i = 0; i < _tokens; ++i) {
+        token.tag = (int) GetVarint(p) + Token::INVALID;
+        auto index = GetVarint(p);
+        offset += UnZigZag(GetVarint(p));
+        line += UnZigZag(GetVarint(p));
+        auto column = GetVarint(p);
+        if (p > end || index >= _strs.size() || offset < 0 || (size_t) offset > _textSize ||
+            column == 0 || column > (uint64_t) offset + 1)
+            return false;
+        if (token.tag != _tags[index]) {  // each text lexes to one tag
+            if (_tags[index] != Token::NOTOKEN || !Lexes(token.tag, _strs[index])) return false;
+            _tags[index] = token.tag;
+        }
+        token.str = _strs[index];
+        token.loc.line = (unsigned) line;
+        token.loc.column = (unsigned) column;
+        token.loc.lineBegin = _text + offset - (column - 1);
+        token.sym = Symbol();
+        if (token.tag == Token::Var) {
+            if (_syms[index].Empty()) _syms[index] = Symbol::Intern(token.str.data(), token.str.size());
+            token.sym = _syms[index];
+        }
+        list->PushBack(Token::New(arena, token));
+    }
+    ts._end = list->size();
+    ts._begin = ts.Normalize(0);
+    return true;
+}
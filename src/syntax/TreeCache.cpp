@@ -0,0 +1,99 @@
+#include "syntax/TreeCache.h"
+#include "syntax/Source.h"
+#include "syntax/TokenCache.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "BuildId.h"  // generated, the hash of the sources of the passes
+
+#ifndef LEOML_VERSION
+#define LEOML_VERSION "unknown"
+#endif
+
+const uint32_t TreeCache::kMagic;
+const uint32_t TreeCache::kFormat;
+const size_t TreeCache::kHeaderSize;
+const char *const TreeCache::kVersion = LEOML_VERSION "+" LEOML_BUILD;
+
+struct TreeCacheHeader {
+    uint32_t magic;
+    uint32_t format;
+    uint64_t key;
+    uint64_t size;  // of the text, which follows, padded to 8 bytes
+    uint64_t sum;  // FNV-1a of the image, after the text
+};
+
+static size_t Padded(size_t size) { return (size + 7) & ~(size_t) 7; }
+
+static const uint64_t kFnvBasis = 0xcbf29ce484222325ull;
+
+static uint64_t Fnv1a(uint64_t hash, const char *p, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= (uint8_t) p[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+uint64_t TreeCache::Key(const char *text, size_t size) const {
+    uint32_t version[] = {kFormat, TokenCache::Version()};  // the ops and the constants are tags
+    auto hash = Fnv1a(kFnvBasis, (const char *) version, sizeof(version));
+    hash = Fnv1a(hash, kVersion, strlen(kVersion) + 1);  // the types are of the checks of this build
+    if (!_variant.empty()) hash = Fnv1a(hash, _variant.c_str(), _variant.size() + 1);
+    return Fnv1a(hash, text, size);
+}
+
+std::string TreeCache::Path(uint64_t key) const {
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.ftc", (unsigned long long) key);
+    return _dir + name;
+}
+
+FlatTree *TreeCache::Load(const char *text, size_t size) const {
+    auto key = Key(text, size);
+    auto file = SourceBuffer::Open(Path(key));
+    if (file == nullptr) return nullptr;
+    FlatTree *tree = nullptr;
+    TreeCacheHeader header{};
+    if (file->Size() >= kHeaderSize) {
+        memcpy(&header, file->Begin(), sizeof(header));
+        auto image = kHeaderSize + Padded(size);
+        // the image is summed, as FlatTree::Read checks its shape, not its values
+        if (header.magic == kMagic && header.format == kFormat && header.key == key && header.size == size &&
+            file->Size() >= image && memcmp(file->Begin() + kHeaderSize, text, size) == 0 &&
+            Fnv1a(kFnvBasis, file->Begin() + image, file->Size() - image) == header.sum)
+            tree = FlatTree::Read(file->Begin() + image, file->Size() - image);
+    }
+    delete file;
+    return tree;
+}
+
+void TreeCache::Store(const char *text, size_t size, const FlatTree &tree) const {
+    static std::atomic<unsigned> serial{0};
+    mkdir(_dir.c_str(), 0777);
+    auto key = Key(text, size);
+    auto path = Path(key);
+    auto temp = path + "." + std::to_string(getpid()) + "." + std::to_string(serial++);
+    {
+        std::ostringstream image;
+        tree.Write(image);
+        auto bytes = image.str();
+        std::ofstream os(temp, std::ios::binary);
+        TreeCacheHeader header{kMagic, kFormat, key, size, Fnv1a(kFnvBasis, bytes.data(), bytes.size())};
+        static const char pad[8] = {};
+        os.write((const char *) &header, sizeof(header));
+        os.write(text, size);
+        os.write(pad, Padded(size) - size);
+        os.write(bytes.data(), bytes.size());
+        if (!os) {
+            os.close();
+            unlink(temp.c_str());
+            return;
+        }
+    }
+    if (rename(temp.c_str(), path.c_str()) != 0) unlink(temp.c_str());
+}
@@ -4,7 +4,18 @@
 
 
 #include "syntax/Type.h"
+#include "syntax/Arena.h"
 #include "syntax/Error.h"
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+const Type::Id Type::Unknown;
+const Type::Id Type::Int;
+const Type::Id Type::Float;
+const Type::Id Type::Bool;
+const Type::Id Type::Unit;
+const Type::Id Type::String;
 
 const std::unordered_map<int, const char *> Type::KindMap{
         {T_Int,     "int"},
@@ -12,59 +23,209 @@ const std::unordered_map<int, const char *> Type::KindMap{
         {T_Bool,    "bool"},
         {T_Unit,    "unit"},
         {T_Func,    "fun"},
+        {T_Pair,    "pair"},
+        {T_String,  "string"},
+        {T_Var,     "var"},
         {T_Unknown, "unknown"},
 };
 
-std::string Type::KindLookup(int k) {
-    auto ret = KindMap.find(k);
-    if (ret == KindMap.end()) {
-        CompilePanic("unreachable");
-        return nullptr;
+/// TypeTable
+// The SymbolTable over the types: open addressing over the ids, keyed by the
+// kind and the ids of the args, which are copied into an arena. The entries are
+// kept in chunks doubling in size, so that a type is read without the lock.
+class TypeTable {
+public:
+    std::mutex lock;
+
+    TypeTable() : _slots(kInitSlots, kEmpty) {
+        Intern(Type::T_Unknown, nullptr, 0);
+        Intern(Type::T_Int, nullptr, 0);
+        Intern(Type::T_Float, nullptr, 0);
+        Intern(Type::T_Bool, nullptr, 0);
+        Intern(Type::T_Unit, nullptr, 0);
+        Intern(Type::T_String, nullptr, 0);
     }
-    return ret->second;
-}
 
-bool Type::Expect(int expect, const Token *token) {
-    if (kind != expect) {
-        CompileError(token, "Type `%s` expected, but got `%s`",
-                     Type::KindLookup(expect).c_str(),
-                     Type::KindLookup(kind).c_str());
-        return false;
+    ~TypeTable() {
+        for (auto chunk:_chunks) delete[] chunk;
     }
-    return true;
+
+    Type::Id Intern(int kind, const Type::Id *args, size_t nargs) {
+        auto hash = Hash(kind, args, nargs);
+        auto mask = _slots.size() - 1;
+        for (auto i = hash & mask;; i = (i + 1) & mask) {
+            auto id = _slots[i];
+            if (id == kEmpty) break;
+            auto &entry = At(id);
+            if (entry.hash == hash && entry.type.kind == kind && entry.type.nargs == nargs &&
+                memcmp(entry.type.args, args, nargs * sizeof(Type::Id)) == 0)
+                return id;
+        }
+        auto id = _count;
+        auto chunk = Chunk(id);
+        if (_chunks[chunk] == nullptr) _chunks[chunk] = new Entry[kChunkSize << chunk];
+        Type::Id *copy = nullptr;
+        if (nargs > 0) {
+            copy = (Type::Id *) _args.Alloc(nargs * sizeof(Type::Id), alignof(Type::Id));
+            memcpy(copy, args, nargs * sizeof(Type::Id));
+        }
+        At(id) = {{kind, id, (uint32_t) nargs, copy}, hash};
+        ++_count;
+        if ((size_t) _count * 2 > _slots.size()) {
+            Rehash(_slots.size() * 2);
+        } else {
+            Place(id);
+        }
+        return id;
+    }
+
+    const Type &Get(Type::Id id) const { return At(id).type; }
+
+    size_t Count() const { return _count; }
+
+private:
+    static const size_t kInitSlots = 256;
+    static const uint32_t kEmpty = UINT32_MAX;
+    static const uint32_t kChunkSize = 256;  // of the first chunk
+    static const int kChunks = 24;
+
+    struct Entry {
+        Type type;
+        uint32_t hash;
+    };
+
+    Entry *_chunks[kChunks]{};
+    uint32_t _count{0};
+    std::vector<uint32_t> _slots;
+    Arena _args;
+
+    // FNV-1a over the kind and the ids
+    static uint32_t Hash(int kind, const Type::Id *args, size_t nargs) {
+        uint32_t hash = 2166136261u;
+        auto mix = [&hash](uint32_t word) {
+            for (int i = 0; i < 4; ++i) {
+                hash ^= (uint8_t) (word >> (8 * i));
+                hash *= 16777619u;
+            }
+        };
+        mix((uint32_t) kind);
+        for (size_t i = 0; i < nargs; ++i) mix(args[i]);
+        return hash;
+    }
+
+    // Chunk k holds the ids from kChunkSize * (2^k - 1) on.
+    static int Chunk(uint32_t id) { return 31 - __builtin_clz(id / kChunkSize + 1); }
+
+    Entry &At(uint32_t id) const {
+        auto chunk = Chunk(id);
+        return _chunks[chunk][id - kChunkSize * ((1u << chunk) - 1)];
+    }
+
+    void Place(uint32_t id) {
+        auto mask = _slots.size() - 1;
+        auto i = At(id).hash & mask;
+        while (_slots[i] != kEmpty) i = (i + 1) & mask;
+        _slots[i] = id;
+    }
+
+    void Rehash(size_t nslots) {
+        _slots.assign(nslots, kEmpty);
+        for (uint32_t id = 0; id < _count; ++id) Place(id);
+    }
+};
+
+const uint32_t TypeTable::kEmpty;
+
+// Built on the first use, so that it is ready for static initializers.
+static TypeTable &Table() {
+    static TypeTable table;
+    return table;
 }
 
-void Type::UnExpect(int unexpect, const Token *token) {
-    CompileError(token, "Unexpected type `%s` found here", Type::KindLookup(unexpect).c_str());
+Type::Id Type::Function(const Id *params, size_t count, Id ret) {
+    SmallVec<Id> args;
+    for (size_t i = 0; i < count; ++i) args.push_back(params[i]);
+    args.push_back(ret);
+    auto &table = Table();
+    std::lock_guard<std::mutex> guard(table.lock);
+    return table.Intern(T_Func, &args[0], args.size());
 }
 
-void Type::operator=(const Type &rhs) {
-    kind = rhs.kind;
+Type::Id Type::Pair(Id first, Id second) {
+    Id args[2] = {first, second};
+    auto &table = Table();
+    std::lock_guard<std::mutex> guard(table.lock);
+    return table.Intern(T_Pair, args, 2);
 }
 
-bool Type::operator==(const Type &rhs) const {
-    return kind == rhs.kind;
+Type::Id Type::Variable(uint32_t n) {
+    auto &table = Table();
+    std::lock_guard<std::mutex> guard(table.lock);
+    return table.Intern(T_Var, &n, 1);
 }
 
-bool Type::operator!=(const Type &rhs) const {
-    return !(rhs == *this);
+const Type &Type::Get(Id id) { return Table().Get(id); }
+
+size_t Type::Count() {
+    auto &table = Table();
+    std::lock_guard<std::mutex> guard(table.lock);
+    return table.Count();
 }
 
-bool TFunc::operator==(const TFunc &rhs) const {
-    if (retType != rhs.retType) {
-        return false;
+std::string Type::KindLookup(int k) {
+    return KindName(k);
+}
+
+const char *Type::KindName(int k) {
+    auto ret = KindMap.find(k);
+    if (ret == KindMap.end()) {
+        CompilePanic("unreachable");
+        return nullptr;
+    }
+    return ret->second;
+}
+
+// The name, in parentheses if it is a compound type of one of the kinds.
+static std::string Operand(Type::Id id, bool pair, bool func) {
+    auto kind = Type::KindOf(id);
+    if ((pair && kind == Type::T_Pair) || (func && kind == Type::T_Func)) return "(" + Type::Name(id) + ")";
+    return Type::Name(id);
+}
+
+std::string Type::Name(Id id) {
+    auto &type = Get(id);
+    switch (type.kind) {
+        case T_Func: {
+            if (type.Params() == 0) return "unit -> " + Operand(type.Ret(), false, true);
+            std::string ret;
+            for (size_t i = 0; i < type.Params(); ++i) {
+                if (i > 0) ret += " * ";
+                ret += Operand(type.args[i], true, true);
+            }
+            return ret + " -> " + Operand(type.Ret(), false, true);
+        }
+        case T_Pair:
+            return Operand(type.args[0], true, true) + " * " + Operand(type.args[1], true, true);
+        case T_Var: {
+            std::string ret{'\'', (char) ('a' + type.args[0] % 26)};
+            if (type.args[0] >= 26) ret += std::to_string(type.args[0] / 26);
+            return ret;
+        }
+        default:
+            return KindName(type.kind);
     }
-    if (paramTypeList->size() != rhs.paramTypeList->size()) { return false; }
-    auto lp = paramTypeList->begin();
-    auto rp = rhs.paramTypeList->begin();
-    while (lp != paramTypeList->end() && rp != rhs.paramTypeList->end()) {
-        if (*(*lp) != *(*rp)) { return false; }
-        lp++;
-        rp++;
+}
+
+bool Type::Expect(Id type, Id expect, const Token *token) {
+    if (type != expect) {
+        CompileError(token, "Type `%s` expected, but got `%s`",
+                     Name(expect).c_str(),
+                     Name(type).c_str());
+        return false;
     }
     return true;
 }
 
-bool TFunc::operator!=(const TFunc &rhs) const {
-    return !(rhs == *this);
+void Type::UnExpect(Id unexpect, const Token *token) {
+    CompileError(token, "Unexpected type `%s` found here", Name(unexpect).c_str());
 }
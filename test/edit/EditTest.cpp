@@ -0,0 +1,129 @@
+#include "syntax/Document.h"
+#include "syntax/Lexer.h"
+#include "syntax/Parser.h"
+#include "syntax/Source.h"
+#include <cstdio>
+#include <sstream>
+#include <string>
+
+// The edits of a Document, checked against a parse of the whole text.
+
+static const std::string kName = "edit.ml";
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+/// FullParse
+// The serialized tree of the Parser, empty if the text has errors.
+static std::string FullParse(const std::string &text) {
+    Diagnostics diags(0);
+    DiagnosticsGuard guard(&diags);
+    auto buffer = SourceBuffer::New(text);
+    TokenSequence ts;
+    auto lexer = Lexer::New(buffer, &kName);
+    lexer->Tokenize(ts);
+    auto parser = Parser::New(ts);
+    parser->Parse();
+    std::ostringstream os;
+    if (diags.Errors() == 0) parser->Serialize(os);
+    delete parser;
+    delete lexer;
+    delete buffer;
+    return os.str();
+}
+
+static std::string Tree(Document *doc) {
+    std::ostringstream os;
+    doc->Serialize(os);
+    return os.str();
+}
+
+/// Edit
+// Make the edit on the document and on the text, the document is as parsed
+// from the text.
+static void Edit(Document *doc, std::string &text, size_t offset, size_t removed, const std::string &inserted) {
+    doc->Edit(offset, removed, inserted);
+    text.replace(offset, removed, inserted);
+    CHECK(doc->Text() == text);
+    CHECK(doc->Errors() == 0);
+    CHECK(doc->GetProgram() != nullptr);
+    CHECK(Tree(doc) == FullParse(text));
+}
+
+// The edits of the ints, of the globals and of the cuts, resolved again.
+static void TestEdits() {
+    std::string text = "let a = 1;;\n"
+                       "let f(x) = x + a;;\n"
+                       "let b = f(2);;\n"
+                       "let c = let y = b in y * 3;;\n";
+    auto doc = Document::New(text, kName);
+    CHECK(doc->Pieces() == 4);
+    CHECK(doc->Errors() == 0);
+    CHECK(Tree(doc) == FullParse(text));
+
+    Edit(doc, text, text.find('1'), 1, "7");  // an int
+    Edit(doc, text, 0, 0, "let z = 5;;\n");  // a new global, the later slots move
+    CHECK(doc->Pieces() == 5);
+    Edit(doc, text, text.find("x + a"), 5, "x + z");  // another global used
+    Edit(doc, text, text.find("let b"), 0, "let a = 2.0;;\n");  // a global shadowed
+    Edit(doc, text, text.find(";;\nlet c") + 3, 0, "\n\n");  // lines, no statement
+    Edit(doc, text, 0, text.find("let f"), "");  // the globals dropped, then defined again
+    Edit(doc, text, 0, 0, "let a = 4;;\nlet z = a;;\n");
+    delete doc;
+}
+
+// A statement with an error is dropped, the tree stays the last one without
+// errors until the error is fixed.
+static void TestErrors() {
+    std::string text = "let a = 1;;\n"
+                       "let b = a + 1;;\n"
+                       "let c = b * 2;;\n";
+    auto doc = Document::New(text, kName);
+    auto good = Tree(doc);
+    CHECK(good == FullParse(text));
+
+    doc->Edit(text.find("a + 1") + 4, 1, "");  // operand expected
+    CHECK(doc->Errors() == 1);
+    CHECK(doc->GetDiagnostics().Errors() == 1);
+    CHECK(doc->GetProgram() == nullptr);
+    CHECK(Tree(doc) == good);
+
+    doc->Edit(doc->Size(), 0, "let x = 0;;\n");  // elsewhere: the error stays, not reported again
+    CHECK(doc->Errors() == 1);
+    CHECK(doc->GetDiagnostics().Errors() == 0);
+    CHECK(Tree(doc) == good);
+
+    text += "let x = 0;;\n";
+    doc->Edit(doc->Text().find("a + ;;") + 4, 0, "1");  // fixed
+    CHECK(doc->Text() == text);
+    CHECK(doc->Errors() == 0);
+    CHECK(Tree(doc) == FullParse(text));
+    delete doc;
+
+    // Errors of the lexer, the other pieces of the region lexed again.
+    text = "let a = 1;;\n"
+           "let b = $;;\n"
+           "let c = 2;;\n";
+    doc = Document::New(text, kName);
+    CHECK(doc->Errors() > 0);
+    CHECK(Tree(doc).empty());
+    Edit(doc, text, text.find('$'), 1, "a");
+    delete doc;
+
+    // A string open at the end of the text, closed by an edit.
+    text = "let a = 1;;\n"
+           "let s = \"ab\n";
+    doc = Document::New(text, kName);
+    CHECK(doc->Errors() > 0);
+    Edit(doc, text, text.size(), 0, "\";;\n");
+    delete doc;
+}
+
+int main() {
+    TestEdits();
+    TestErrors();
+    if (failures > 0) fprintf(stderr, "%d checks failed\n", failures);
+    return failures > 0 ? 1 : 0;
+}
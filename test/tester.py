@@ -1,6 +1,8 @@
 import difflib
 import os
+import subprocess
 import sys
+import tempfile
 import re
 
 # ////////// config
@@ -78,6 +80,149 @@ class TesterCausal:
         print_with_color("parse result", result)
 
 
+class TesterGolden:
+    # A suite is a directory of NN.ml.txt cases and the NN.out.txt outputs they
+    # are expected to print, with the exit status at the end. A case is run with
+    # the options of its suite, or with those of its first line if it reads
+    # "(* options: ... *)". A case with "{cache}" in its options is run twice
+    # on a new cache directory, the second run must print the same from it.
+    suites = {
+        'recovery': ['-p'],
+        'infer': ['-c'],
+        'eval': ['-e'],
+        'sema': ['-p'],
+    }
+    ansi = re.compile(r'\x1b\[[0-9;]*m')
+    options = re.compile(r'\(\* options:(.*)\*\)')
+
+    def __init__(self, exe: str, update: bool = False):
+        super().__init__()
+        self.exe = os.path.abspath(exe)
+        self.update = update
+
+    def run(self, suite: str, filename: str) -> str:
+        args = self.suites[suite]
+        with open(filename) as f:
+            matched = self.options.match(f.readline())
+            if matched:
+                args = matched.group(1).split()
+        if not any('{cache}' in arg for arg in args):
+            return self.execute(args, filename)
+        with tempfile.TemporaryDirectory() as cache:
+            args = [arg.replace('{cache}', cache) for arg in args]
+            result = self.execute(args, filename)
+            cached = self.execute(args, filename)
+        return result if cached == result else result + '--- from the cache\n' + cached
+
+    def execute(self, args: list, filename: str) -> str:
+        # run in the suite, the diagnostics name the case without its directory
+        done = subprocess.run([self.exe] + args + [os.path.basename(filename)], cwd=os.path.dirname(filename),
+                              stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True, errors='replace',
+                              timeout=60)
+        return self.ansi.sub('', done.stdout) + 'exit %d\n' % done.returncode
+
+    def test_suite(self, suite: str) -> bool:
+        root = os.path.join(os.path.dirname(os.path.abspath(__file__)), suite)
+        passed = True
+        for name in sorted(os.listdir(root)):
+            if not name.endswith('.ml.txt'):
+                continue
+            filename = os.path.join(root, name)
+            result = self.run(suite, filename)
+            golden = filename[:-len('.ml.txt')] + '.out.txt'
+            if self.update:
+                with open(golden, 'w') as f:
+                    f.write(result)
+                continue
+            with open(golden) as f:
+                expected = f.read()
+            diff = list(difflib.unified_diff(expected.splitlines(True), result.splitlines(True), golden, 'result'))
+            if len(diff) != 0:
+                print_with_color(suite + '/' + name, ''.join(diff))
+                passed = False
+        return passed
+
+
+class TesterCache(TesterGolden):
+    # The caches of the cases of ml/: read back, they print what the cases do,
+    # corrupt, they are missed or read, but never crash the compiler.
+    caches = ['tokens', 'trees']
+
+    def cases(self, root: str):
+        ml = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'ml')
+        for name in sorted(os.listdir(ml)):
+            if os.path.getsize(os.path.join(ml, name)) == 0:
+                continue
+            source = os.path.join(root, name[:-len('.ml.txt')] + '.ml')
+            with open(os.path.join(ml, name)) as f, open(source, 'w') as out:
+                out.write(f.read())
+            yield name, source
+
+    def test_suite(self, suite: str) -> bool:
+        if suite not in self.caches:
+            return super().test_suite(suite)
+        if suite == 'trees':
+            return self.test_trees()
+        passed = True
+        with tempfile.TemporaryDirectory() as root:
+            for name, source in self.cases(root):
+                self.execute(['-l', '--binary', '-o', root], source)
+                tsb = source[:-len('.ml')] + '.tsb'
+                if self.execute(['-p'], tsb) != self.execute(['-p'], source):
+                    print_with_color('tokens/' + name, 'the tokens read back parse otherwise')
+                    passed = False
+                with open(tsb, 'rb') as f:
+                    image = f.read()
+                # the header, the text, a NUL, then the table and the tokens
+                text_end = 24 + int.from_bytes(image[8:16], 'little') + 1
+                corrupt = [image[:4] + b'\xff' + image[5:]]  # another version
+                for pos in range(text_end, len(image), 7):
+                    corrupt += [image[:pos] + bytes([value]) + image[pos + 1:] for value in (0x00, 0xff)]
+                bad = os.path.join(root, 'bad.tsb')
+                for i, data in enumerate(corrupt):
+                    with open(bad, 'wb') as f:
+                        f.write(data)
+                    result = self.execute(['-c'], bad)
+                    # exit 255 only for the version, "Not a token cache"
+                    if not result.endswith('exit 0\n') and not result.endswith('exit 1\n') and i > 0 or \
+                            i == 0 and 'Not a token cache' not in result:
+                        print_with_color('tokens/' + name, result)
+                        passed = False
+        return passed
+
+    def test_trees(self) -> bool:
+        passed = True
+        with tempfile.TemporaryDirectory() as root:
+            for name, source in self.cases(root):
+                cache = os.path.join(root, name + '.cache')
+                args = ['-c', '--cache', cache]
+                expected = self.execute(args, source)
+                if self.execute(args, source) != expected:
+                    print_with_color('trees/' + name, 'the tree read back prints otherwise')
+                    passed = False
+                if not os.path.isdir(cache):
+                    continue  # the errors of the parser, no tree
+                path = os.path.join(cache, os.listdir(cache)[0])
+                with open(path, 'rb') as f:
+                    image = f.read()
+                # the header, the text padded to 8 bytes, then the tree
+                text_end = 32 + int.from_bytes(image[16:24], 'little')
+                # another text of the same size and key, as a collision: a miss
+                with open(source, 'rb') as f:
+                    text = f.read()
+                corrupt = [image[:32] + text.replace(b'let', b'lat', 1) + image[text_end:]]
+                corrupt += [image[:pos] + bytes([image[pos] ^ 0xff]) + image[pos + 1:]
+                            for pos in list(range(0, 32, 3)) + list(range(32, len(image), 11))]
+                for i, data in enumerate(corrupt):
+                    with open(path, 'wb') as f:
+                        f.write(data)
+                    if self.execute(args, source) != expected:  # a miss, compiled again
+                        print_with_color('trees/%s, corrupt %d' % (name, i), self.execute(args, source))
+                        passed = False
+                os.remove(path)
+        return passed
+
+
 # not importent
 def gen_txt():
     for i in range(10, 20):
@@ -90,6 +235,14 @@ def gen_txt():
 
 
 def main():
+    # tester.py <leoml> [--update] [suite...]: check the suites against their outputs
+    if len(sys.argv) > 1:
+        update = '--update' in sys.argv
+        suites = [arg for arg in sys.argv[2:] if arg != '--update'] or list(TesterGolden.suites) + TesterCache.caches
+        tester = TesterCache(sys.argv[1], update)
+        failed = [suite for suite in suites if not tester.test_suite(suite)]
+        print('failed: ' + ' '.join(failed) if failed else 'passed: ' + ' '.join(suites))
+        sys.exit(1 if failed else 0)
     tester = TesterCausal()
     for i in [0, 1, 2] + [i for i in range(10, 17)]:  # positive + negative
         tester.test_parser("./ml/%.2d.ml.txt" % (i))